@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Times the conversion of colourised lines to HTML and ANSI, in chunks
+ * the way saving the contents and hibernation do it, for a quarter, half
+ * and all of the lines. Time and size per line should stay the same as
+ * the number of lines grows.
+ *
+ * Usage: bench-contents-formatter [LINES]
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "terminal-contents-formatter.h"
+
+#define ROW_LENGTH (80)
+#define CHUNK_ROWS (1024)
+
+/* A word every 8 columns, coloured in turn */
+static const PangoColor colors[] =
+{
+	{ 0xcccc, 0x0000, 0x0000 },
+	{ 0x4e4e, 0x9a9a, 0x0606 },
+	{ 0xc4c4, 0xa0a0, 0x0000 },
+	{ 0x3434, 0x6565, 0xa4a4 },
+	{ 0x7575, 0x5050, 0x7b7b },
+	{ 0x0606, 0x9898, 0x9a9a },
+	{ 0xd3d3, 0xd7d7, 0xcfcf },
+};
+
+/* Makes @n_rows rows from @first on, with one attribute per byte */
+static char *
+make_chunk (glong   first,
+            glong   n_rows,
+            GArray *attributes)
+{
+	static const PangoColor background = { 0x0000, 0x0000, 0x0000 };
+	GString *text;
+	glong row, column;
+
+	text = g_string_sized_new (n_rows * (ROW_LENGTH + 1));
+	g_array_set_size (attributes, 0);
+
+	for (row = first; row < first + n_rows; ++row)
+	{
+		for (column = 0; column <= ROW_LENGTH; ++column)
+		{
+			VteCharAttributes attr;
+
+			memset (&attr, 0, sizeof attr);
+			attr.row = row;
+			attr.column = column;
+			attr.fore = colors[(row + column / 8) % G_N_ELEMENTS (colors)];
+			attr.back = background;
+			g_array_append_val (attributes, attr);
+
+			if (column == ROW_LENGTH)
+				g_string_append_c (text, '\n');
+			else if (column % 8 == 7)
+				g_string_append_c (text, ' ');
+			else
+				g_string_append_c (text, "<&>abcdefghijklmnopqrstuvwxyz"[(row + column) % 29]);
+		}
+	}
+
+	return g_string_free (text, FALSE);
+}
+
+static void
+run (TerminalContentsFormat  format,
+     const char             *name,
+     glong                   n_rows)
+{
+	static const GdkRGBA foreground = { 1.0, 1.0, 1.0, 1.0 };
+	static const GdkRGBA background = { 0.0, 0.0, 0.0, 1.0 };
+	TerminalContentsFormatter *formatter;
+	GArray *attributes;
+	gint64 start, elapsed = 0;
+	guint64 size = 0;
+	glong row;
+	char *out;
+
+	formatter = terminal_contents_formatter_new (format, &foreground, &background);
+	attributes = g_array_new (FALSE, FALSE, sizeof (VteCharAttributes));
+
+	/* Only the formatting is timed, not making up the lines */
+	for (row = 0; row < n_rows; row += CHUNK_ROWS)
+	{
+		char *text = make_chunk (row, MIN (CHUNK_ROWS, n_rows - row), attributes);
+
+		start = g_get_monotonic_time ();
+		out = terminal_contents_formatter_format (formatter, text, attributes);
+		elapsed += g_get_monotonic_time () - start;
+
+		size += strlen (out);
+		g_free (out);
+	}
+
+	out = terminal_contents_formatter_get_footer (formatter);
+	if (out != NULL)
+		size += strlen (out);
+	g_free (out);
+
+	g_print ("%-5s %8ld lines: %8.3f s, %6.0f ns/line, %12" G_GUINT64_FORMAT " bytes, %6.1f bytes/line\n",
+	         name, n_rows,
+	         elapsed / (double) G_USEC_PER_SEC,
+	         elapsed * 1000.0 / n_rows,
+	         size, (double) size / n_rows);
+
+	g_array_free (attributes, TRUE);
+	terminal_contents_formatter_free (formatter);
+}
+
+int
+main (int argc, char **argv)
+{
+	glong n_rows = 1000000;
+	int i;
+
+	if (argc > 1)
+		n_rows = MAX (4, atol (argv[1]));
+
+	for (i = 4; i >= 1; i /= 2)
+	{
+		run (TERMINAL_CONTENTS_FORMAT_HTML, "HTML", n_rows / i);
+		run (TERMINAL_CONTENTS_FORMAT_ANSI, "ANSI", n_rows / i);
+	}
+
+	return 0;
+}
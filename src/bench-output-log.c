@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measures what output logging costs the main loop. Screenfuls of text
+ * are produced as fast as possible, the way the screen reads them back
+ * from VTE, first thrown away and then handed to output logs; the logs'
+ * shared writer then gets to finish. Without compression, fewer bytes on
+ * disk than were produced means the writer fell behind and dropped some.
+ *
+ * Usage: bench-output-log [MEGABYTES [LOGS]]
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "terminal-output-log.h"
+
+#define ROW_LENGTH (80)
+#define SCREEN_ROWS (24)
+
+static char *
+make_screen (guint n)
+{
+	GString *text;
+	guint row;
+
+	text = g_string_sized_new (SCREEN_ROWS * (ROW_LENGTH + 1));
+	for (row = 0; row < SCREEN_ROWS; ++row)
+	{
+		g_string_append_printf (text, "%08u ", n * SCREEN_ROWS + row);
+		while (text->len % (ROW_LENGTH + 1) != ROW_LENGTH)
+			g_string_append_c (text, 'a' + (text->len + n) % 26);
+		g_string_append_c (text, '\n');
+	}
+
+	return g_string_free (text, FALSE);
+}
+
+/* Returns the seconds taken, and in @drain the seconds until the logs
+ * were written too.
+ */
+static double
+run (const char *directory,
+     guint       n_screens,
+     guint       n_logs,
+     gboolean    compress,
+     double     *drain)
+{
+	TerminalOutputLog **logs = NULL;
+	gint64 start, produced;
+	guint i;
+
+	if (n_logs > 0)
+		logs = g_new (TerminalOutputLog *, n_logs);
+	for (i = 0; i < n_logs; ++i)
+	{
+		char *basename = g_strdup_printf ("bench-%u", i);
+
+		logs[i] = terminal_output_log_new (directory, basename, 0, 0, compress);
+		g_free (basename);
+	}
+
+	start = g_get_monotonic_time ();
+
+	for (i = 0; i < n_screens; ++i)
+	{
+		char *text = make_screen (i);
+
+		if (n_logs > 0)
+			terminal_output_log_append (logs[i % n_logs], text, strlen (text));
+		else
+			g_free (text);
+	}
+
+	produced = g_get_monotonic_time ();
+
+	for (i = 0; i < n_logs; ++i)
+		terminal_output_log_close (logs[i]);
+	terminal_output_log_wait_closed ();
+	g_free (logs);
+
+	*drain = (g_get_monotonic_time () - start) / (double) G_USEC_PER_SEC;
+
+	return (produced - start) / (double) G_USEC_PER_SEC;
+}
+
+static goffset
+remove_logs (const char *directory)
+{
+	const char *name;
+	goffset size = 0;
+	GDir *dir;
+
+	dir = g_dir_open (directory, 0, NULL);
+	if (dir == NULL)
+		return 0;
+
+	while ((name = g_dir_read_name (dir)) != NULL)
+	{
+		char *path = g_build_filename (directory, name, NULL);
+		GStatBuf buf;
+
+		if (g_stat (path, &buf) == 0)
+			size += buf.st_size;
+		g_unlink (path);
+		g_free (path);
+	}
+	g_dir_close (dir);
+
+	return size;
+}
+
+int
+main (int argc, char **argv)
+{
+	guint megabytes = 256, n_logs = 1, n_screens;
+	double seconds, drain, mb;
+	char *directory;
+
+	if (argc > 1)
+		megabytes = (guint) MAX (1, atoi (argv[1]));
+	if (argc > 2)
+		n_logs = (guint) MAX (1, atoi (argv[2]));
+
+	directory = g_dir_make_tmp ("mate-terminal-bench-XXXXXX", NULL);
+	if (directory == NULL)
+		return 1;
+
+	n_screens = (guint) ((guint64) megabytes * 1024 * 1024 / (SCREEN_ROWS * (ROW_LENGTH + 1)));
+	mb = (double) n_screens * SCREEN_ROWS * (ROW_LENGTH + 1) / (1024 * 1024);
+
+	seconds = run (directory, n_screens, 0, FALSE, &drain);
+	g_print ("logging off:        %7.1f MB/s\n", mb / seconds);
+
+	seconds = run (directory, n_screens, n_logs, FALSE, &drain);
+	g_print ("logging on:         %7.1f MB/s, written at %7.1f MB/s, %" G_GOFFSET_FORMAT " bytes on disk\n",
+	         mb / seconds, mb / drain, remove_logs (directory));
+
+	seconds = run (directory, n_screens, n_logs, TRUE, &drain);
+	g_print ("logging compressed: %7.1f MB/s, written at %7.1f MB/s, %" G_GOFFSET_FORMAT " bytes on disk\n",
+	         mb / seconds, mb / drain, remove_logs (directory));
+
+	g_print ("%u logs, %.0f MB of output\n", n_logs, mb);
+
+	g_rmdir (directory);
+	g_free (directory);
+
+	return 0;
+}
@@ -254,6 +254,10 @@ profile_notify_sensitivity_cb (TerminalProfile *profile,
 		SET_SENSITIVE ("copy-checkbutton",
 		               !terminal_profile_property_locked (profile, TERMINAL_PROFILE_COPY_SELECTION));
 
+	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_LOG_OUTPUT))
+		SET_SENSITIVE ("log-output-checkbutton",
+		               !terminal_profile_property_locked (profile, TERMINAL_PROFILE_LOG_OUTPUT));
+
 #ifdef ENABLE_SKEY
 	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_USE_SKEY))
 		SET_SENSITIVE ("use-skey-checkbutton",
@@ -619,6 +623,9 @@ profile_editor_destroyed (GtkWidget       *editor,
 
 	g_object_set_data (G_OBJECT (profile), "editor-window", NULL);
 	g_object_set_data (G_OBJECT (editor), "builder", NULL);
+
+	/* Don't wait for the save timeout */
+	terminal_profile_flush (profile);
 }
 
 static void
@@ -888,6 +895,7 @@ terminal_profile_edit (TerminalProfile *profile,
 	CONNECT_WITH_FLAGS ("bell-checkbutton", TERMINAL_PROFILE_SILENT_BELL, FLAG_INVERT_BOOL);
 	/* CONNECT_WITH_FLAGS ("copy-checkbutton", TERMINAL_PROFILE_COPY_SELECTION, FLAG_INVERT_BOOL); */
 	CONNECT ("copy-checkbutton", TERMINAL_PROFILE_COPY_SELECTION);
+	CONNECT ("log-output-checkbutton", TERMINAL_PROFILE_LOG_OUTPUT);
 #ifdef ENABLE_SKEY
 	CONNECT ("use-skey-checkbutton", TERMINAL_PROFILE_USE_SKEY);
 #endif
@@ -108,20 +108,6 @@
 #define KEY_ZOOM_OUT             "zoom-out"
 #define KEY_SWITCH_TAB_PREFIX    "switch-to-tab-"
 
-#if 1
-/*
-* We don't want to enable content saving until vte supports it async.
-* So we disable this code for stable versions.
-*/
-#include "terminal-version.h"
-
-#if (TERMINAL_MINOR_VERSION & 1) != 0
-#define ENABLE_SAVE
-#else
-#undef ENABLE_SAVE
-#endif
-#endif
-
 typedef struct
 {
 	const char *user_visible_name;
@@ -157,12 +143,10 @@ static KeyEntry file_entries[] =
 		N_("New Profile"),
 		KEY_NEW_PROFILE, ACCEL_PATH_NEW_PROFILE, 0, 0, NULL, FALSE, TRUE
 	},
-#ifdef ENABLE_SAVE
 	{
 		N_("Save Contents"),
 		KEY_SAVE_CONTENTS, ACCEL_PATH_SAVE_CONTENTS, 0, 0, NULL, FALSE, TRUE
 	},
-#endif
 	{
 		N_("Close Tab"),
 		KEY_CLOSE_TAB, ACCEL_PATH_CLOSE_TAB, GDK_SHIFT_MASK | GDK_CONTROL_MASK, GDK_KEY_w, NULL, FALSE, TRUE
@@ -379,8 +363,12 @@ static gboolean binding_from_value  (GVariant        *value,
                                      GdkModifierType *accelerator_mods);
 
 static gboolean sync_idle_cb (gpointer data);
+static void key_entry_set_from_value (KeyEntry *key_entry,
+                                      GVariant *value,
+                                      gboolean  writable);
 
 static guint sync_idle_id = 0;
+static GSList *dirty_entries = NULL;
 static GtkAccelGroup *notification_group = NULL;
 /* never set GSettings keys in response to receiving a GSettings notify. */
 static int inside_gsettings_notify = 0;
@@ -388,6 +376,7 @@ static GtkWidget *edit_keys_dialog = NULL;
 static GtkTreeStore *edit_keys_store = NULL;
 static GHashTable *gsettings_key_to_entry;
 static GSettings *settings_keybindings;
+static GSettings *settings_keybindings_delayed;
 
 static char*
 binding_name (guint            keyval,
@@ -445,7 +434,26 @@ terminal_accels_init (void)
 			gtk_accel_group_connect_by_path (notification_group,
 			                                 I_(key_entry->accel_path),
 			                                 key_entry->closure);
-			keys_change_notify (settings_keybindings, key_entry->gsettings_key, NULL);
+		}
+	}
+
+	/* Load all bindings in one pass; there's no edit dialogue or
+	 * accel-changed handler yet, so skip what keys_change_notify does
+	 * for those.
+	 */
+	for (i = 0; i < G_N_ELEMENTS (all_entries); ++i)
+	{
+		for (j = 0; j < all_entries[i].n_elements; ++j)
+		{
+			KeyEntry *key_entry;
+			GVariant *value;
+
+			key_entry = &(all_entries[i].key_entry[j]);
+
+			value = g_settings_get_value (settings_keybindings, key_entry->gsettings_key);
+			key_entry_set_from_value (key_entry, value,
+			                          g_settings_is_writable (settings_keybindings, key_entry->gsettings_key));
+			g_variant_unref (value);
 		}
 	}
 
@@ -470,6 +478,8 @@ terminal_accels_shutdown (void)
 		sync_idle_cb (NULL);
 	}
 
+	g_clear_object (&settings_keybindings_delayed);
+
 	g_hash_table_destroy (gsettings_key_to_entry);
 	gsettings_key_to_entry = NULL;
 
@@ -497,6 +507,60 @@ update_model_foreach (GtkTreeModel *model,
 	return FALSE;
 }
 
+static void
+key_entry_set_from_value (KeyEntry *key_entry,
+                          GVariant *value,
+                          gboolean  writable)
+{
+	GdkModifierType mask;
+	guint keyval;
+
+	if (!binding_from_value (value, &keyval, &mask))
+	{
+		const char *str = g_variant_is_of_type (value, G_VARIANT_TYPE_STRING) ? g_variant_get_string (value, NULL) : NULL;
+		g_printerr ("The value \"%s\" of configuration key %s is not a valid accelerator\n",
+		            str ? str : "(null)",
+		            key_entry->gsettings_key);
+		return;
+	}
+	key_entry->gsettings_keyval = keyval;
+	key_entry->gsettings_mask = mask;
+
+	/* Unlock the path, so we can change its accel */
+	if (!key_entry->accel_path_unlocked)
+		gtk_accel_map_unlock_path (key_entry->accel_path);
+
+	/* sync over to GTK */
+	_terminal_debug_print (TERMINAL_DEBUG_ACCELS,
+	                       "changing path %s to %s\n",
+	                       key_entry->accel_path,
+	                       binding_name (keyval, mask)); /* memleak */
+	inside_gsettings_notify += 1;
+	/* Note that this may return FALSE, e.g. when the entry was already set correctly. */
+	gtk_accel_map_change_entry (key_entry->accel_path,
+	                            keyval, mask,
+	                            TRUE);
+	inside_gsettings_notify -= 1;
+
+	/* Lock the path if the GSettings key isn't writable */
+	key_entry->accel_path_unlocked = writable;
+	if (!key_entry->accel_path_unlocked)
+		gtk_accel_map_lock_path (key_entry->accel_path);
+}
+
+static void
+key_entry_queue_sync (KeyEntry *key_entry)
+{
+	if (!key_entry->needs_gsettings_sync)
+	{
+		key_entry->needs_gsettings_sync = TRUE;
+		dirty_entries = g_slist_prepend (dirty_entries, key_entry);
+	}
+
+	if (sync_idle_id == 0)
+		sync_idle_id = g_idle_add (sync_idle_cb, NULL);
+}
+
 static void
 keys_change_notify (GSettings *settings,
                     const gchar *key,
@@ -504,8 +568,6 @@ keys_change_notify (GSettings *settings,
 {
 	GVariant *val;
 	KeyEntry *key_entry;
-	GdkModifierType mask;
-	guint keyval;
 
 	_terminal_debug_print (TERMINAL_DEBUG_ACCELS,
 	                       "key %s changed\n",
@@ -533,40 +595,11 @@ keys_change_notify (GSettings *settings,
 		/* shouldn't really happen, but let's be safe */
 		_terminal_debug_print (TERMINAL_DEBUG_ACCELS,
 		                       "  WARNING: KeyEntry for changed key not found, bailing out\n");
+		g_variant_unref (val);
 		return;
 	}
 
-	if (!binding_from_value (val, &keyval, &mask))
-	{
-		const char *str = g_variant_is_of_type (val, G_VARIANT_TYPE_STRING) ? g_variant_get_string (val, NULL) : NULL;
-		g_printerr ("The value \"%s\" of configuration key %s is not a valid accelerator\n",
-		            str ? str : "(null)",
-		            key_entry->gsettings_key);
-		return;
-	}
-	key_entry->gsettings_keyval = keyval;
-	key_entry->gsettings_mask = mask;
-
-	/* Unlock the path, so we can change its accel */
-	if (!key_entry->accel_path_unlocked)
-		gtk_accel_map_unlock_path (key_entry->accel_path);
-
-	/* sync over to GTK */
-	_terminal_debug_print (TERMINAL_DEBUG_ACCELS,
-	                       "changing path %s to %s\n",
-	                       key_entry->accel_path,
-	                       binding_name (keyval, mask)); /* memleak */
-	inside_gsettings_notify += 1;
-	/* Note that this may return FALSE, e.g. when the entry was already set correctly. */
-	gtk_accel_map_change_entry (key_entry->accel_path,
-	                            keyval, mask,
-	                            TRUE);
-	inside_gsettings_notify -= 1;
-
-	/* Lock the path if the GSettings key isn't writable */
-	key_entry->accel_path_unlocked = g_settings_is_writable (settings, key);
-	if (!key_entry->accel_path_unlocked)
-		gtk_accel_map_lock_path (key_entry->accel_path);
+	key_entry_set_from_value (key_entry, val, g_settings_is_writable (settings, key));
 
 	/* This seems necessary to update the tree model, since sometimes the
 	 * notification on the notification_group seems not to be emitted correctly.
@@ -613,10 +646,7 @@ accel_changed_callback (GtkAccelGroup  *accel_group,
 	key_entry = accel_closure->data;
 	g_assert (key_entry);
 
-	key_entry->needs_gsettings_sync = TRUE;
-
-	if (sync_idle_id == 0)
-		sync_idle_id = g_idle_add (sync_idle_cb, NULL);
+	key_entry_queue_sync (key_entry);
 }
 
 static gboolean
@@ -661,16 +691,12 @@ binding_from_value (GVariant         *value,
 	                            accelerator_mods);
 }
 
-static void
-add_key_entry_to_changeset (gpointer key,
-                            KeyEntry *key_entry,
+static gboolean
+add_key_entry_to_changeset (KeyEntry *key_entry,
                             GSettings *changeset)
 {
 	GtkAccelKey gtk_key;
 
-	if (!key_entry->needs_gsettings_sync)
-		return;
-
 	key_entry->needs_gsettings_sync = FALSE;
 
 	if (gtk_accel_map_lookup_entry (key_entry->accel_path, &gtk_key) &&
@@ -682,26 +708,38 @@ add_key_entry_to_changeset (gpointer key,
 		accel_name = binding_name (gtk_key.accel_key, gtk_key.accel_mods);
 		g_settings_set_string (changeset, key_entry->gsettings_key, accel_name);
 		g_free (accel_name);
+
+		return TRUE;
 	}
+
+	return FALSE;
 }
 
 static gboolean
 sync_idle_cb (gpointer data)
 {
-	GSettings *changeset;
+	GSList *l;
+	gboolean changed = FALSE;
 
 	_terminal_debug_print (TERMINAL_DEBUG_ACCELS,
 	                       "GSettings sync handler\n");
 
 	sync_idle_id = 0;
 
-	changeset = g_settings_new (CONF_KEYS_SCHEMA);
-	g_settings_delay (changeset);
+	if (settings_keybindings_delayed == NULL)
+	{
+		settings_keybindings_delayed = g_settings_new (CONF_KEYS_SCHEMA);
+		g_settings_delay (settings_keybindings_delayed);
+	}
 
-	g_hash_table_foreach (gsettings_key_to_entry, (GHFunc) add_key_entry_to_changeset, changeset);
-	g_settings_apply(changeset);
+	/* Only the entries GTK told us about; the rest can't have changed */
+	for (l = dirty_entries; l != NULL; l = l->next)
+		changed |= add_key_entry_to_changeset (l->data, settings_keybindings_delayed);
+	g_slist_free (dirty_entries);
+	dirty_entries = NULL;
 
-	g_object_unref (changeset);
+	if (changed)
+		g_settings_apply (settings_keybindings_delayed);
 
 	return FALSE;
 }
@@ -931,7 +969,7 @@ accel_cleared_callback (GtkCellRendererAccel *cell,
 
 	ke->gsettings_keyval = 0;
 	ke->gsettings_mask = 0;
-	ke->needs_gsettings_sync = TRUE;
+	key_entry_queue_sync (ke);
 
 	str = binding_name (0, 0);
 
@@ -38,6 +38,7 @@
 #include "terminal-util.h"
 #include "profile-editor.h"
 #include "terminal-encoding.h"
+#include "terminal-output-log.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -85,7 +86,7 @@ struct _TerminalApp
 {
 	GObject parent_instance;
 
-	GList *windows;
+	GList *windows; /* most recently created first */
 	GtkWidget *new_profile_dialog;
 	GtkWidget *manage_profiles_dialog;
 	GtkWidget *manage_profiles_list;
@@ -104,9 +105,32 @@ struct _TerminalApp
 	GHashTable *encodings;
 	gboolean encodings_locked;
 
+	/* The model shared by all windows' profile and encoding menus */
+	GArray *profile_menu;
+	guint profile_menu_serial;
+	guint encoding_menu_serial;
+
 	PangoFontDescription *system_font_desc;
 	gboolean enable_mnemonics;
 	gboolean enable_menu_accels;
+
+	/* Periodic session autosave */
+	guint autosave_interval; /* in seconds, 0 if disabled */
+	guint autosave_source_id;
+	GHashTable *autosave_snapshots; /* TerminalWindow -> GKeyFile, for windows that didn't change */
+	gboolean autosave_dirty;
+	gboolean autosave_in_progress;
+
+	/* Scrollback shared by all tabs; 0 means no limit */
+	guint scrollback_budget_lines;
+	guint scrollback_budget_size; /* in MiB */
+	guint scrollback_budget_source_id;
+
+	/* Scrollback hibernation of idle tabs */
+	guint hibernate_timeout; /* in minutes, 0 if disabled */
+	guint hibernate_source_id;
+
+	guint dump_stats_source_id;
 };
 
 enum
@@ -157,6 +181,14 @@ static TerminalApp *global_app = NULL;
 
 #define ENCODING_LIST_KEY "active-encodings"
 
+#define AUTOSAVE_INTERVAL_KEY "session-autosave-interval"
+#define AUTOSAVE_FILE_NAME "last-session"
+
+#define SCROLLBACK_BUDGET_LINES_KEY "scrollback-budget-lines"
+#define SCROLLBACK_BUDGET_SIZE_KEY "scrollback-budget-size"
+
+#define HIBERNATE_TIMEOUT_KEY "scrollback-hibernate-timeout"
+
 /* two following functions were copied from libmate-desktop to get rid
  * of dependency on it
  *
@@ -222,6 +254,55 @@ gsettings_remove_all_from_strv (GSettings   *settings,
 
 /* Helper functions */
 
+static char *
+escape_underscores (const char *name)
+{
+	GString *escaped_name;
+
+	g_assert (name != NULL);
+
+	/* Who'd use more that 4 underscores in a profile name... */
+	escaped_name = g_string_sized_new (strlen (name) + 4 + 1);
+
+	while (*name)
+	{
+		if (*name == '_')
+			g_string_append (escaped_name, "__");
+		else
+			g_string_append_c (escaped_name, *name);
+		name++;
+	}
+
+	return g_string_free (escaped_name, FALSE);
+}
+
+static void
+terminal_profile_menu_item_clear (TerminalProfileMenuItem *item)
+{
+	g_object_unref (item->profile);
+	g_free (item->label);
+	g_free (item->mnemonic_label);
+}
+
+static void
+terminal_app_invalidate_profile_menu (TerminalApp *app)
+{
+	app->profile_menu_serial++;
+
+	if (app->profile_menu != NULL)
+	{
+		g_array_free (app->profile_menu, TRUE);
+		app->profile_menu = NULL;
+	}
+}
+
+static void
+terminal_app_profile_visible_name_notify_cb (TerminalApp *app)
+{
+	/* The label changes, and so may the sort order */
+	terminal_app_invalidate_profile_menu (app);
+}
+
 static GdkScreen*
 terminal_app_get_screen_by_display_name (const char *display_name)
 {
@@ -329,10 +410,29 @@ terminal_window_destroyed (TerminalWindow *window,
 {
 	app->windows = g_list_remove (app->windows, window);
 
+	g_hash_table_remove (app->autosave_snapshots, window);
+	app->autosave_dirty = TRUE;
+
 	if (app->windows == NULL)
 		g_signal_emit (app, signals[QUIT], 0);
 }
 
+/* Every profile in the list goes through here, so that renaming any of
+ * them updates the profile menus.
+ */
+static void
+terminal_app_add_profile (TerminalApp     *app,
+                          TerminalProfile *profile)
+{
+	g_signal_connect_object (profile, "notify::" TERMINAL_PROFILE_VISIBLE_NAME,
+	                         G_CALLBACK (terminal_app_profile_visible_name_notify_cb),
+	                         app, G_CONNECT_SWAPPED);
+
+	g_hash_table_insert (app->profiles,
+	                     g_strdup (terminal_profile_get_property_string (profile, TERMINAL_PROFILE_NAME)),
+	                     profile /* adopts the refcount */);
+}
+
 static TerminalProfile *
 terminal_app_create_profile (TerminalApp *app,
                              const char *name)
@@ -342,10 +442,7 @@ terminal_app_create_profile (TerminalApp *app,
 	g_assert (terminal_app_get_profile_by_name (app, name) == NULL);
 
 	profile = _terminal_profile_new (name);
-
-	g_hash_table_insert (app->profiles,
-	                     g_strdup (terminal_profile_get_property_string (profile, TERMINAL_PROFILE_NAME)),
-	                     profile /* adopts the refcount */);
+	terminal_app_add_profile (app, profile);
 
 	if (app->default_profile == NULL &&
 	        app->default_profile_id != NULL &&
@@ -883,6 +980,9 @@ ensure_one_profile:
 			need_new_default = TRUE;
 		}
 
+		g_signal_handlers_disconnect_by_func (profile,
+		                                      G_CALLBACK (terminal_app_profile_visible_name_notify_cb),
+		                                      app);
 		_terminal_profile_forget (profile);
 		g_hash_table_remove (app->profiles, name);
 
@@ -914,6 +1014,7 @@ ensure_one_profile:
 
 	g_assert (g_hash_table_size (app->profiles) > 0);
 
+	terminal_app_invalidate_profile_menu (app);
 	g_signal_emit (app, signals[PROFILE_LIST_CHANGED], 0);
 
 	g_object_thaw_notify (object);
@@ -1019,6 +1120,7 @@ terminal_app_encoding_list_notify_cb (GSettings   *settings,
 		g_free (strings);
 	}
 
+	app->encoding_menu_serial++;
 	g_signal_emit (app, signals[ENCODING_LIST_CHANGED], 0);
 
 	if (val != NULL)
@@ -1158,9 +1260,7 @@ new_profile_response_cb (GtkWidget *new_profile_dialog,
 
 		new_profile = _terminal_profile_clone (base_profile, name);
 		new_profile_name = terminal_profile_get_property_string (new_profile, TERMINAL_PROFILE_NAME);
-		g_hash_table_insert (app->profiles,
-		                     g_strdup (new_profile_name),
-		                     new_profile /* adopts the refcount */);
+		terminal_app_add_profile (app, new_profile);
 
 		/* And now save the new profile name to GSettings */
 		gsettings_append_strv (settings_global,
@@ -1393,6 +1493,485 @@ terminal_app_client_quit_cb (EggSMClient *client,
 }
 #endif /* HAVE_SMCLIENT */
 
+/* Session autosave
+ *
+ * When enabled, the session is written out every AUTOSAVE_INTERVAL_KEY
+ * seconds if anything changed, so that --restore-last can bring it back
+ * after a crash. Each window's state is kept as its own GKeyFile and only
+ * rebuilt when the window reported a change; the snapshots are never
+ * modified afterwards, so the worker thread can serialise and write them
+ * without blocking the UI.
+ */
+
+typedef struct
+{
+	GPtrArray *snapshots; /* of GKeyFile, in window creation order */
+	char *file_name;
+} AutosaveData;
+
+static void
+autosave_data_free (AutosaveData *data)
+{
+	g_ptr_array_free (data->snapshots, TRUE);
+	g_free (data->file_name);
+	g_slice_free (AutosaveData, data);
+}
+
+static char *
+terminal_app_get_autosave_file_name (void)
+{
+	return g_build_filename (g_get_user_config_dir (), "mate-terminal", AUTOSAVE_FILE_NAME, NULL);
+}
+
+static void
+terminal_app_autosave_thread (GTask        *task,
+                              gpointer      source_object,
+                              AutosaveData *data,
+                              GCancellable *cancellable)
+{
+	GKeyFile *header;
+	GString *contents;
+	GPtrArray *window_names;
+	GError *error = NULL;
+	char *dir, *chunk;
+	guint i;
+
+	window_names = g_ptr_array_sized_new (data->snapshots->len + 1);
+	for (i = 0; i < data->snapshots->len; ++i)
+		g_ptr_array_add (window_names, g_key_file_get_start_group (g_ptr_array_index (data->snapshots, i)));
+	g_ptr_array_add (window_names, NULL);
+
+	header = g_key_file_new ();
+	g_key_file_set_comment (header, NULL, NULL, "Written by " PACKAGE_STRING, NULL);
+	g_key_file_set_integer (header, TERMINAL_CONFIG_GROUP, TERMINAL_CONFIG_PROP_VERSION, TERMINAL_CONFIG_VERSION);
+	g_key_file_set_integer (header, TERMINAL_CONFIG_GROUP, TERMINAL_CONFIG_PROP_COMPAT_VERSION, TERMINAL_CONFIG_COMPAT_VERSION);
+	g_key_file_set_string_list (header, TERMINAL_CONFIG_GROUP, TERMINAL_CONFIG_PROP_WINDOWS,
+	                            (const char * const *) window_names->pdata, data->snapshots->len);
+	g_ptr_array_free (window_names, TRUE);
+
+	contents = g_string_new (NULL);
+
+	chunk = g_key_file_to_data (header, NULL, NULL);
+	g_string_append (contents, chunk);
+	g_free (chunk);
+	g_key_file_free (header);
+
+	/* The groups of the different windows don't overlap, so the
+	 * snapshots can simply be concatenated.
+	 */
+	for (i = 0; i < data->snapshots->len; ++i)
+	{
+		chunk = g_key_file_to_data (g_ptr_array_index (data->snapshots, i), NULL, NULL);
+		g_string_append_c (contents, '\n');
+		g_string_append (contents, chunk);
+		g_free (chunk);
+	}
+
+	dir = g_path_get_dirname (data->file_name);
+	g_mkdir_with_parents (dir, 0700);
+	g_free (dir);
+
+	/* This writes to a temporary file and renames it over the old one,
+	 * so a crash never leaves a truncated session behind.
+	 */
+	if (g_file_set_contents (data->file_name, contents->str, contents->len, &error))
+		g_task_return_boolean (task, TRUE);
+	else
+		g_task_return_error (task, error);
+
+	g_string_free (contents, TRUE);
+}
+
+static void
+terminal_app_autosave_done_cb (TerminalApp  *app,
+                               GAsyncResult *result,
+                               gpointer      user_data)
+{
+	GError *error = NULL;
+
+	app->autosave_in_progress = FALSE;
+
+	if (!g_task_propagate_boolean (G_TASK (result), &error))
+	{
+		g_printerr ("Failed to save the session: %s\n", error->message);
+		g_error_free (error);
+
+		/* Try again next time */
+		app->autosave_dirty = TRUE;
+	}
+}
+
+static gboolean
+terminal_app_autosave_cb (TerminalApp *app)
+{
+	AutosaveData *data;
+	GTask *task;
+	GList *lw;
+
+	/* Don't replace the last session with an empty one when the last
+	 * window is closed.
+	 */
+	if (!app->autosave_dirty || app->autosave_in_progress || app->windows == NULL)
+		return G_SOURCE_CONTINUE;
+
+	data = g_slice_new (AutosaveData);
+	data->snapshots = g_ptr_array_new_with_free_func ((GDestroyNotify) g_key_file_unref);
+	data->file_name = terminal_app_get_autosave_file_name ();
+
+	for (lw = g_list_last (app->windows); lw != NULL; lw = lw->prev)
+	{
+		TerminalWindow *window = TERMINAL_WINDOW (lw->data);
+		GKeyFile *key_file;
+
+		key_file = g_hash_table_lookup (app->autosave_snapshots, window);
+		if (key_file == NULL)
+		{
+			char *group;
+
+			if (!gtk_widget_get_realized (GTK_WIDGET (window)))
+				continue;
+
+			_terminal_debug_print (TERMINAL_DEBUG_FACTORY,
+			                       "[window %p] taking autosave snapshot\n",
+			                       window);
+
+			key_file = g_key_file_new ();
+			group = g_strdup_printf ("Window%p", window);
+			terminal_window_save_state (window, key_file, group);
+			g_free (group);
+
+			g_hash_table_insert (app->autosave_snapshots, window, key_file);
+		}
+
+		g_ptr_array_add (data->snapshots, g_key_file_ref (key_file));
+	}
+
+	app->autosave_dirty = FALSE;
+	app->autosave_in_progress = TRUE;
+
+	task = g_task_new (app, NULL, (GAsyncReadyCallback) terminal_app_autosave_done_cb, NULL);
+	g_task_set_task_data (task, data, (GDestroyNotify) autosave_data_free);
+	g_task_run_in_thread (task, (GTaskThreadFunc) terminal_app_autosave_thread);
+	g_object_unref (task);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+terminal_app_autosave_interval_notify_cb (GSettings   *settings,
+                                          const gchar *key,
+                                          gpointer     user_data)
+{
+	TerminalApp *app = TERMINAL_APP (user_data);
+	guint interval;
+
+	interval = g_settings_get_uint (settings, key);
+	if (interval == app->autosave_interval)
+		return;
+
+	app->autosave_interval = interval;
+
+	if (app->autosave_source_id != 0)
+	{
+		g_source_remove (app->autosave_source_id);
+		app->autosave_source_id = 0;
+	}
+
+	/* Start over from a full snapshot */
+	g_hash_table_remove_all (app->autosave_snapshots);
+	app->autosave_dirty = TRUE;
+
+	if (interval > 0)
+		app->autosave_source_id = g_timeout_add_seconds (interval,
+		                                                 (GSourceFunc) terminal_app_autosave_cb,
+		                                                 app);
+}
+
+/**
+ * terminal_app_mark_session_dirty:
+ * @app:
+ * @window: the window whose saved state changed
+ *
+ * Makes the next session autosave take a new snapshot of @window.
+ */
+void
+terminal_app_mark_session_dirty (TerminalApp    *app,
+                                 TerminalWindow *window)
+{
+	if (app->autosave_interval == 0)
+		return;
+
+	g_hash_table_remove (app->autosave_snapshots, window);
+	app->autosave_dirty = TRUE;
+}
+
+/* Scrollback budget
+ *
+ * Every SCROLLBACK_BUDGET_INTERVAL seconds, the budget is shared out among
+ * the tabs in the order they were last viewed. Tabs on screen or viewed in
+ * the last SCROLLBACK_BUDGET_RECENT_USEC keep what their profile allows and
+ * only use up the budget with the history they have. The others get room
+ * to grow by SCROLLBACK_BUDGET_HEADROOM lines or a quarter of their
+ * history, as far as the budget lasts, so the least recently viewed tabs
+ * are the first to lose their oldest lines.
+ *
+ * The size in MiB is turned into lines with
+ * TERMINAL_SCREEN_SCROLLBACK_BYTES_PER_CELL.
+ */
+#define SCROLLBACK_BUDGET_INTERVAL (5) /* seconds */
+#define SCROLLBACK_BUDGET_RECENT_USEC (5 * 60 * G_USEC_PER_SEC)
+#define SCROLLBACK_BUDGET_HEADROOM (1000)
+#define SCROLLBACK_BUDGET_MIN_LINES (100)
+
+typedef struct
+{
+	TerminalScreen *screen;
+	gint64 last_viewed;
+} BudgetScreen;
+
+static int
+budget_screen_compare (const BudgetScreen *a,
+                       const BudgetScreen *b)
+{
+	/* Most recently viewed first */
+	if (a->last_viewed != b->last_viewed)
+		return a->last_viewed > b->last_viewed ? -1 : 1;
+
+	return 0;
+}
+
+static GArray *
+terminal_app_list_budget_screens (TerminalApp *app)
+{
+	GArray *screens;
+	GList *lw;
+
+	screens = g_array_new (FALSE, FALSE, sizeof (BudgetScreen));
+
+	for (lw = app->windows; lw != NULL; lw = lw->next)
+	{
+		GList *containers, *lc;
+
+		containers = terminal_window_list_screen_containers (TERMINAL_WINDOW (lw->data));
+		for (lc = containers; lc != NULL; lc = lc->next)
+		{
+			BudgetScreen item;
+
+			item.screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (lc->data));
+			item.last_viewed = terminal_screen_get_last_viewed (item.screen);
+			g_array_append_val (screens, item);
+		}
+		g_list_free (containers);
+	}
+
+	return screens;
+}
+
+static gboolean
+terminal_app_share_scrollback_budget (TerminalApp *app)
+{
+	GArray *screens;
+	gint64 now, lines_left, bytes_left;
+	guint i;
+
+	screens = terminal_app_list_budget_screens (app);
+	g_array_sort (screens, (GCompareFunc) budget_screen_compare);
+
+	now = g_get_monotonic_time ();
+	lines_left = app->scrollback_budget_lines > 0 ?
+	             (gint64) app->scrollback_budget_lines : G_MAXINT64;
+	bytes_left = app->scrollback_budget_size > 0 ?
+	             (gint64) app->scrollback_budget_size * 1024 * 1024 : G_MAXINT64;
+
+	for (i = 0; i < screens->len; ++i)
+	{
+		BudgetScreen *item = &g_array_index (screens, BudgetScreen, i);
+		TerminalProfile *profile;
+		gint64 line_size, wanted, usage, allowed, charged;
+
+		profile = terminal_screen_get_profile (item->screen);
+		if (profile == NULL)
+			continue;
+
+		wanted = terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED) ?
+		         G_MAXINT64 : terminal_profile_get_property_int (profile, TERMINAL_PROFILE_SCROLLBACK_LINES);
+		usage = MIN (terminal_screen_get_scrollback_usage (item->screen), wanted);
+		line_size = MAX (vte_terminal_get_column_count (VTE_TERMINAL (item->screen)), 1) *
+		            TERMINAL_SCREEN_SCROLLBACK_BYTES_PER_CELL;
+
+		if (item->last_viewed >= now - SCROLLBACK_BUDGET_RECENT_USEC)
+		{
+			allowed = -1;
+			charged = usage;
+		}
+		else
+		{
+			allowed = usage + MAX (SCROLLBACK_BUDGET_HEADROOM, usage / 4);
+			allowed = MIN (allowed, MIN (lines_left, bytes_left / line_size));
+			allowed = MAX (allowed, SCROLLBACK_BUDGET_MIN_LINES);
+			charged = MIN (allowed, wanted);
+		}
+
+		_terminal_debug_print (TERMINAL_DEBUG_SCROLLBACK,
+		                       "[screen %p] scrollback budget %" G_GINT64_FORMAT
+		                       " lines, using %" G_GINT64_FORMAT "\n",
+		                       item->screen, allowed, usage);
+
+		terminal_screen_set_scrollback_budget (item->screen, (glong) MIN (allowed, G_MAXLONG));
+
+		lines_left = MAX (lines_left - charged, 0);
+		bytes_left = MAX (bytes_left - charged * line_size, 0);
+	}
+
+	g_array_free (screens, TRUE);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+terminal_app_scrollback_budget_notify_cb (GSettings   *settings,
+                                          const gchar *key,
+                                          gpointer     user_data)
+{
+	TerminalApp *app = TERMINAL_APP (user_data);
+
+	app->scrollback_budget_lines = g_settings_get_uint (settings, SCROLLBACK_BUDGET_LINES_KEY);
+	app->scrollback_budget_size = g_settings_get_uint (settings, SCROLLBACK_BUDGET_SIZE_KEY);
+
+	if (app->scrollback_budget_lines > 0 || app->scrollback_budget_size > 0)
+	{
+		if (app->scrollback_budget_source_id == 0)
+			app->scrollback_budget_source_id =
+			    g_timeout_add_seconds (SCROLLBACK_BUDGET_INTERVAL,
+			                           (GSourceFunc) terminal_app_share_scrollback_budget,
+			                           app);
+
+		terminal_app_share_scrollback_budget (app);
+	}
+	else if (app->scrollback_budget_source_id != 0)
+	{
+		GArray *screens;
+		guint i;
+
+		g_source_remove (app->scrollback_budget_source_id);
+		app->scrollback_budget_source_id = 0;
+
+		/* Give every tab what its profile allows again */
+		screens = terminal_app_list_budget_screens (app);
+		for (i = 0; i < screens->len; ++i)
+			terminal_screen_set_scrollback_budget (g_array_index (screens, BudgetScreen, i).screen, -1);
+		g_array_free (screens, TRUE);
+	}
+}
+
+/* Scrollback hibernation
+ *
+ * One timer for all tabs; each tab decides whether it has been idle long
+ * enough, see terminal_screen_maybe_hibernate().
+ */
+#define HIBERNATE_CHECK_INTERVAL (60) /* seconds */
+
+static gboolean
+terminal_app_hibernate_cb (TerminalApp *app)
+{
+	gint64 idle_usec;
+	GList *lw;
+
+	idle_usec = (gint64) app->hibernate_timeout * 60 * G_USEC_PER_SEC;
+
+	for (lw = app->windows; lw != NULL; lw = lw->next)
+	{
+		GList *containers, *lc;
+
+		containers = terminal_window_list_screen_containers (TERMINAL_WINDOW (lw->data));
+		for (lc = containers; lc != NULL; lc = lc->next)
+		{
+			TerminalScreen *screen;
+
+			screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (lc->data));
+			terminal_screen_maybe_hibernate (screen, idle_usec);
+		}
+		g_list_free (containers);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+terminal_app_hibernate_timeout_notify_cb (GSettings   *settings,
+                                          const gchar *key,
+                                          gpointer     user_data)
+{
+	TerminalApp *app = TERMINAL_APP (user_data);
+
+	/* Hibernating tabs stay so until they are needed */
+	app->hibernate_timeout = g_settings_get_uint (settings, key);
+
+	if (app->hibernate_timeout > 0 && app->hibernate_source_id == 0)
+		app->hibernate_source_id = g_timeout_add_seconds (HIBERNATE_CHECK_INTERVAL,
+		                                                  (GSourceFunc) terminal_app_hibernate_cb,
+		                                                  app);
+	else if (app->hibernate_timeout == 0 && app->hibernate_source_id != 0)
+	{
+		g_source_remove (app->hibernate_source_id);
+		app->hibernate_source_id = 0;
+	}
+}
+
+/* Per-tab statistics
+ *
+ * With MATE_TERMINAL_DEBUG=stats, the statistics of every tab are printed
+ * periodically, so a tab that keeps growing can be found.
+ */
+#define DUMP_STATS_INTERVAL (10) /* seconds */
+
+static gboolean
+terminal_app_dump_stats_cb (TerminalApp *app)
+{
+	gint64 now, total_size = 0;
+	guint n_screens = 0;
+	GList *lw;
+
+	now = g_get_monotonic_time ();
+
+	for (lw = app->windows; lw != NULL; lw = lw->next)
+	{
+		GList *containers, *lc;
+
+		containers = terminal_window_list_screen_containers (TERMINAL_WINDOW (lw->data));
+		for (lc = containers; lc != NULL; lc = lc->next)
+		{
+			TerminalScreen *screen;
+			TerminalScreenStats stats;
+
+			screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (lc->data));
+			terminal_screen_get_stats (screen, &stats);
+
+			_terminal_debug_print (TERMINAL_DEBUG_STATS,
+			                       "[screen %p] scrollback %ld lines (~%" G_GINT64_FORMAT " bytes)%s, "
+			                       "received %" G_GUINT64_FORMAT " lines (%" G_GUINT64_FORMAT " cells), "
+			                       "sent %" G_GUINT64_FORMAT " bytes, idle %" G_GINT64_FORMAT " s: %s\n",
+			                       screen,
+			                       stats.scrollback_lines, stats.scrollback_size,
+			                       stats.hibernating ? " hibernating" : "",
+			                       stats.lines_received, stats.cells_received,
+			                       stats.bytes_sent,
+			                       (now - stats.last_activity) / G_USEC_PER_SEC,
+			                       terminal_screen_get_title (screen));
+
+			total_size += stats.scrollback_size;
+			n_screens++;
+		}
+		g_list_free (containers);
+	}
+
+	_terminal_debug_print (TERMINAL_DEBUG_STATS,
+	                       "%u screens, scrollback ~%" G_GINT64_FORMAT " bytes in total\n",
+	                       n_screens, total_size);
+
+	return G_SOURCE_CONTINUE;
+}
+
 /* Class implementation */
 
 G_DEFINE_TYPE (TerminalApp, terminal_app, G_TYPE_OBJECT)
@@ -1412,6 +1991,11 @@ terminal_app_init (TerminalApp *app)
 
 	app->encodings = terminal_encodings_get_builtins ();
 
+	app->profile_menu_serial = 1;
+	app->encoding_menu_serial = 1;
+
+	app->autosave_snapshots = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) g_key_file_unref);
+
 	settings_global = g_settings_new (CONF_GLOBAL_SCHEMA);
 	app->settings_font = g_settings_new (MONOSPACE_FONT_SCHEMA);
 
@@ -1445,6 +2029,26 @@ terminal_app_init (TerminalApp *app)
 	                  G_CALLBACK(terminal_app_enable_menu_accels_notify_cb),
 	                  app);
 
+	g_signal_connect (settings_global,
+	                  "changed::" AUTOSAVE_INTERVAL_KEY,
+	                  G_CALLBACK(terminal_app_autosave_interval_notify_cb),
+	                  app);
+
+	g_signal_connect (settings_global,
+	                  "changed::" SCROLLBACK_BUDGET_LINES_KEY,
+	                  G_CALLBACK(terminal_app_scrollback_budget_notify_cb),
+	                  app);
+
+	g_signal_connect (settings_global,
+	                  "changed::" SCROLLBACK_BUDGET_SIZE_KEY,
+	                  G_CALLBACK(terminal_app_scrollback_budget_notify_cb),
+	                  app);
+
+	g_signal_connect (settings_global,
+	                  "changed::" HIBERNATE_TIMEOUT_KEY,
+	                  G_CALLBACK(terminal_app_hibernate_timeout_notify_cb),
+	                  app);
+
 	/* Load the settings */
         terminal_app_profile_list_notify_cb (settings_global,
 					     PROFILE_LIST_KEY,
@@ -1464,6 +2068,20 @@ terminal_app_init (TerminalApp *app)
 	terminal_app_enable_mnemonics_notify_cb (settings_global,
 	                                         ENABLE_MNEMONICS_KEY,
 	                                         app);
+	terminal_app_autosave_interval_notify_cb (settings_global,
+	                                          AUTOSAVE_INTERVAL_KEY,
+	                                          app);
+	terminal_app_scrollback_budget_notify_cb (settings_global,
+	                                          SCROLLBACK_BUDGET_LINES_KEY,
+	                                          app);
+	terminal_app_hibernate_timeout_notify_cb (settings_global,
+	                                          HIBERNATE_TIMEOUT_KEY,
+	                                          app);
+
+	_TERMINAL_DEBUG_IF (TERMINAL_DEBUG_STATS)
+		app->dump_stats_source_id = g_timeout_add_seconds (DUMP_STATS_INTERVAL,
+		                                                   (GSourceFunc) terminal_app_dump_stats_cb,
+		                                                   app);
 
 	/* Ensure we have valid settings */
 	g_assert (app->default_profile_id != NULL);
@@ -1490,6 +2108,14 @@ terminal_app_init (TerminalApp *app)
 #endif /* HAVE_SMCLIENT */
 }
 
+static void
+terminal_app_flush_profile_foreach (gpointer key,
+                                    TerminalProfile *profile,
+                                    gpointer user_data)
+{
+	terminal_profile_flush (profile);
+}
+
 static void
 terminal_app_finalize (GObject *object)
 {
@@ -1521,12 +2147,42 @@ terminal_app_finalize (GObject *object)
 	g_signal_handlers_disconnect_by_func (settings_global,
 	                                      G_CALLBACK(terminal_app_enable_mnemonics_notify_cb),
 	                                      app);
+	g_signal_handlers_disconnect_by_func (settings_global,
+	                                      G_CALLBACK(terminal_app_autosave_interval_notify_cb),
+	                                      app);
+
+	g_signal_handlers_disconnect_by_func (settings_global,
+	                                      G_CALLBACK(terminal_app_scrollback_budget_notify_cb),
+	                                      app);
+	g_signal_handlers_disconnect_by_func (settings_global,
+	                                      G_CALLBACK(terminal_app_hibernate_timeout_notify_cb),
+	                                      app);
+
+	if (app->autosave_source_id != 0)
+		g_source_remove (app->autosave_source_id);
+	g_hash_table_destroy (app->autosave_snapshots);
+
+	if (app->scrollback_budget_source_id != 0)
+		g_source_remove (app->scrollback_budget_source_id);
+
+	if (app->hibernate_source_id != 0)
+		g_source_remove (app->hibernate_source_id);
+
+	if (app->dump_stats_source_id != 0)
+		g_source_remove (app->dump_stats_source_id);
 
 	g_object_unref (settings_global);
 	g_object_unref (app->settings_font);
 
 	g_free (app->default_profile_id);
 
+	/* Write out profile changes still waiting for their save timeout */
+	g_hash_table_foreach (app->profiles, (GHFunc) terminal_app_flush_profile_foreach, NULL);
+	g_settings_sync ();
+
+	if (app->profile_menu != NULL)
+		g_array_free (app->profile_menu, TRUE);
+
 	g_hash_table_destroy (app->profiles);
 
 	g_hash_table_destroy (app->encodings);
@@ -1693,6 +2349,9 @@ terminal_app_shutdown (void)
 
 	g_object_unref (global_app);
 	g_assert (global_app == NULL);
+
+	/* The screens are gone, but their logs may still be writing */
+	terminal_output_log_wait_closed ();
 }
 
 /**
@@ -1720,6 +2379,12 @@ terminal_app_handle_options (TerminalApp *app,
 
 	gdk_screen = terminal_app_get_screen_by_display_name (options->display_name);
 
+	if (options->export_profiles)
+		return terminal_app_export_profiles_file (app, options->profiles_file, error);
+
+	if (options->import_profiles)
+		return terminal_app_import_profiles_file (app, options->profiles_file, error);
+
 	if (options->save_config)
 	{
 		if (options->remote_arguments)
@@ -1746,6 +2411,34 @@ terminal_app_handle_options (TerminalApp *app,
 		/* fall-through on success */
 	}
 
+	if (options->restore_last)
+	{
+		GKeyFile *key_file;
+		char *file_name;
+		GError *load_error = NULL;
+		gboolean result = TRUE;
+
+		file_name = terminal_app_get_autosave_file_name ();
+		key_file = g_key_file_new ();
+
+		/* Nothing was saved yet; just open the default window */
+		if (g_key_file_load_from_file (key_file, file_name, 0, &load_error))
+			result = terminal_options_merge_config (options, key_file, SOURCE_SESSION, error);
+		else if (g_error_matches (load_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_error_free (load_error);
+		else
+		{
+			g_propagate_error (error, load_error);
+			result = FALSE;
+		}
+
+		g_key_file_free (key_file);
+		g_free (file_name);
+
+		if (!result)
+			return FALSE;
+	}
+
 #ifdef HAVE_SMCLIENT
 	EggSMClient *sm_client;
 
@@ -1774,6 +2467,7 @@ terminal_app_handle_options (TerminalApp *app,
 	{
 		InitialWindow *iw = lw->data;
 		TerminalWindow *window = NULL;
+		TerminalScreen *active_screen = NULL, *last_screen = NULL;
 		GList *lt;
 
 		g_assert (iw->tabs);
@@ -1840,17 +2534,33 @@ terminal_app_handle_options (TerminalApp *app,
 				profile = terminal_app_get_profile_for_new_term (app);
 			g_assert (profile);
 
-			screen = terminal_app_new_terminal (app, window, profile,
-			                                    it->exec_argv ? it->exec_argv : options->exec_argv,
-			                                    it->title ? it->title : options->default_title,
-			                                    it->working_dir ? it->working_dir : options->default_working_dir,
-			                                    options->env,
-			                                    it->zoom_set ? it->zoom : options->zoom);
+			/* Add all the tabs first and only switch once at the end;
+			 * the window's menus and size follow the active tab and are
+			 * only brought up to date for the final one.
+			 */
+			screen = terminal_screen_new (profile,
+			                              it->exec_argv ? it->exec_argv : options->exec_argv,
+			                              it->title ? it->title : options->default_title,
+			                              it->working_dir ? it->working_dir : options->default_working_dir,
+			                              options->env,
+			                              it->zoom_set ? it->zoom : options->zoom);
+			terminal_window_add_screen (window, screen, -1);
+
+			/* Background tabs are kept hidden, see notebook_page_selected_callback */
+			if (screen != terminal_window_get_active (window))
+				gtk_widget_hide (GTK_WIDGET (screen));
 
 			if (it->active)
-				terminal_window_switch_screen (window, screen);
+				active_screen = screen;
+			last_screen = screen;
 		}
 
+		if (active_screen == NULL)
+			active_screen = last_screen;
+
+		terminal_window_switch_screen (window, active_screen);
+		gtk_widget_grab_focus (GTK_WIDGET (active_screen));
+
 		if (iw->geometry)
 		{
 			_terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
@@ -1878,7 +2588,7 @@ terminal_app_new_window (TerminalApp *app,
 
 	window = terminal_window_new ();
 
-	app->windows = g_list_append (app->windows, window);
+	app->windows = g_list_prepend (app->windows, window);
 	g_signal_connect (window, "destroy",
 	                  G_CALLBACK (terminal_window_destroyed), app);
 
@@ -1945,29 +2655,30 @@ terminal_app_get_current_window (TerminalApp *app,
                                  GdkScreen *from_screen,
                                  int workspace)
 {
-    GList *res = NULL;
+    GList *res;
     TerminalWindow *ret = NULL;
 
-	if (app->windows == NULL)
-		return NULL;
-
-    res = g_list_last (app->windows);
-
     g_assert (from_screen != NULL);
 
-    while (res)
+    for (res = app->windows; res != NULL; res = res->next)
     {
+      TerminalWindow *window = TERMINAL_WINDOW (res->data);
       int win_workspace;
-      if (gtk_window_get_screen(GTK_WINDOW(res->data)) != from_screen)
+
+      if (gtk_window_get_screen (GTK_WINDOW (window)) != from_screen)
         continue;
 
-      win_workspace = terminal_app_get_workspace_for_window(res->data);
+      /* Only ask the X server for the workspace of windows that would
+       * actually win, it's a round trip per window.
+       */
+      if (ret != NULL && terminal_window_get_latest_focused (ret, window) == ret)
+        continue;
+
+      win_workspace = terminal_app_get_workspace_for_window (window);
 
       /* Same workspace or if the window is set to show up on all workspaces */
       if (win_workspace == workspace || win_workspace == -1)
-        ret = terminal_window_get_latest_focused (ret, TERMINAL_WINDOW(res->data));
-
-      res = g_list_previous (res);
+        ret = window;
     }
 
   return ret;
@@ -2044,6 +2755,84 @@ terminal_app_get_profile_for_new_term (TerminalApp *app)
 	return NULL;
 }
 
+/**
+ * terminal_app_get_profile_menu:
+ * @app:
+ *
+ * Returns the items of the profile menus, sorted by visible name. The
+ * array is owned by @app and shared by all windows; it stays valid until
+ * the value returned by terminal_app_get_profile_menu_serial() changes.
+ *
+ * Returns: (transfer none): a #GArray of #TerminalProfileMenuItem
+ */
+GArray *
+terminal_app_get_profile_menu (TerminalApp *app)
+{
+	GList *profiles, *l;
+	guint n;
+
+	if (app->profile_menu != NULL)
+		return app->profile_menu;
+
+	app->profile_menu = g_array_sized_new (FALSE, TRUE, sizeof (TerminalProfileMenuItem),
+	                                       g_hash_table_size (app->profiles));
+	g_array_set_clear_func (app->profile_menu, (GDestroyNotify) terminal_profile_menu_item_clear);
+
+	profiles = terminal_app_get_profile_list (app);
+	for (l = profiles, n = 0; l != NULL; l = l->next, ++n)
+	{
+		TerminalProfile *profile = TERMINAL_PROFILE (l->data);
+		TerminalProfileMenuItem item;
+
+		item.profile = g_object_ref (profile);
+		item.label = escape_underscores (terminal_profile_get_property_string (profile, TERMINAL_PROFILE_VISIBLE_NAME));
+
+		if (n < 10)
+			/* Translators: This is the label of a menu item to choose a profile.
+			 * _%d is used as the accelerator (with d between 1 and 9), and
+			 * the %s is the name of the terminal profile.
+			 */
+			item.mnemonic_label = g_strdup_printf (_("_%d. %s"), n, item.label);
+		else if (n < 36)
+			/* Translators: This is the label of a menu item to choose a profile.
+			 * _%c is used as the accelerator (it will be a character between A and Z),
+			 * and the %s is the name of the terminal profile.
+			 */
+			item.mnemonic_label = g_strdup_printf (_("_%c. %s"), ('A' + n - 10), item.label);
+		else
+			item.mnemonic_label = g_strdup (item.label);
+
+		g_array_append_val (app->profile_menu, item);
+	}
+	g_list_free (profiles);
+
+	return app->profile_menu;
+}
+
+/**
+ * terminal_app_get_profile_menu_serial:
+ * @app:
+ *
+ * Returns: a number that changes whenever the profile menu model does
+ */
+guint
+terminal_app_get_profile_menu_serial (TerminalApp *app)
+{
+	return app->profile_menu_serial;
+}
+
+/**
+ * terminal_app_get_encoding_menu_serial:
+ * @app:
+ *
+ * Returns: a number that changes whenever the list of active encodings does
+ */
+guint
+terminal_app_get_encoding_menu_serial (TerminalApp *app)
+{
+	return app->encoding_menu_serial;
+}
+
 GHashTable *
 terminal_app_get_encodings (TerminalApp *app)
 {
@@ -2121,7 +2910,8 @@ terminal_app_save_config (TerminalApp *app,
 
 	window_names_array = g_ptr_array_sized_new (g_list_length (app->windows) + 1);
 
-	for (lw = app->windows; lw != NULL; lw = lw->next)
+	/* Save the windows in the order they were created */
+	for (lw = g_list_last (app->windows); lw != NULL; lw = lw->prev)
 	{
 		TerminalWindow *window = TERMINAL_WINDOW (lw->data);
 		char *group;
@@ -2158,3 +2948,268 @@ terminal_app_save_config_file (TerminalApp *app,
 
 	return result;
 }
+
+static GSettingsSchema *
+terminal_app_lookup_profile_schema (GError **error)
+{
+	GSettingsSchema *schema;
+
+	schema = g_settings_schema_source_lookup (g_settings_schema_source_get_default (),
+	                                          CONF_PROFILE_SCHEMA, TRUE);
+	if (schema == NULL)
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+		             "Settings schema '%s' is not installed", CONF_PROFILE_SCHEMA);
+
+	return schema;
+}
+
+/**
+ * terminal_app_export_profiles_file:
+ * @app:
+ * @file_name: the file to write the bundle to
+ * @error: a #GError to fill in
+ *
+ * Writes all profiles, in profile list order, to a keyfile bundle. Only
+ * keys that differ from the schema defaults are stored.
+ *
+ * Returns: %TRUE on success, or %FALSE on error
+ */
+gboolean
+terminal_app_export_profiles_file (TerminalApp *app,
+                                   const char *file_name,
+                                   GError **error)
+{
+	GSettingsSchema *schema;
+	GKeyFile *key_file;
+	char **profiles, **keys;
+	char *data;
+	gsize len;
+	guint i, j;
+	gboolean result;
+
+	schema = terminal_app_lookup_profile_schema (error);
+	if (schema == NULL)
+		return FALSE;
+
+	/* Make sure edits still waiting on the save timeout end up in the bundle */
+	g_hash_table_foreach (app->profiles, terminal_app_flush_profile_foreach, NULL);
+
+	keys = g_settings_schema_list_keys (schema);
+	profiles = g_settings_get_strv (settings_global, PROFILE_LIST_KEY);
+
+	key_file = g_key_file_new ();
+	g_key_file_set_comment (key_file, NULL, NULL, "Written by " PACKAGE_STRING, NULL);
+	g_key_file_set_integer (key_file, TERMINAL_PROFILES_BUNDLE_GROUP, TERMINAL_PROFILES_BUNDLE_PROP_VERSION, TERMINAL_PROFILES_BUNDLE_VERSION);
+	g_key_file_set_string_list (key_file, TERMINAL_PROFILES_BUNDLE_GROUP, TERMINAL_PROFILES_BUNDLE_PROP_PROFILES,
+	                            (const char * const *) profiles, g_strv_length (profiles));
+
+	for (i = 0; profiles[i] != NULL; ++i)
+	{
+		GSettings *settings;
+		char *path, *group;
+
+		path = g_strconcat (CONF_PROFILE_PREFIX, profiles[i], "/", NULL);
+		group = g_strconcat (TERMINAL_PROFILES_BUNDLE_PROFILE_GROUP, profiles[i], NULL);
+		settings = g_settings_new_full (schema, NULL, path);
+
+		for (j = 0; keys[j] != NULL; ++j)
+		{
+			GVariant *value;
+			char *text;
+
+			value = g_settings_get_user_value (settings, keys[j]);
+			if (value == NULL)
+				continue;
+
+			text = g_variant_print (value, FALSE);
+			g_key_file_set_value (key_file, group, keys[j], text);
+			g_free (text);
+			g_variant_unref (value);
+		}
+
+		g_object_unref (settings);
+		g_free (group);
+		g_free (path);
+	}
+
+	data = g_key_file_to_data (key_file, &len, NULL);
+	result = g_file_set_contents (file_name, data, len, error);
+	g_free (data);
+
+	g_key_file_free (key_file);
+	g_strfreev (profiles);
+	g_strfreev (keys);
+	g_settings_schema_unref (schema);
+
+	return result;
+}
+
+/**
+ * terminal_app_import_profiles_file:
+ * @app:
+ * @file_name: the bundle file to read
+ * @error: a #GError to fill in
+ *
+ * Imports the profiles stored in @file_name. Existing profiles with the
+ * same name are overwritten, keys missing from the bundle are reset to
+ * their defaults, and new profiles are appended to the profile list.
+ *
+ * Everything, including the profile list, is written as one dconf
+ * changeset, so the bundle is applied atomically and running instances
+ * rebuild their profile list only once.
+ *
+ * Returns: %TRUE on success, or %FALSE on error
+ */
+gboolean
+terminal_app_import_profiles_file (TerminalApp *app,
+                                   const char *file_name,
+                                   GError **error)
+{
+	GSettingsSchema *schema = NULL;
+	GKeyFile *key_file;
+	DConfChangeset *changeset = NULL;
+	DConfClient *client;
+	GPtrArray *profile_list = NULL;
+	char **profiles = NULL, **old_profiles = NULL, **keys = NULL;
+	char *global_path = NULL, *list_path;
+	gsize n_profiles;
+	guint i, j;
+	int version;
+	gboolean result = FALSE;
+
+	key_file = g_key_file_new ();
+	if (!g_key_file_load_from_file (key_file, file_name, 0, error))
+		goto out;
+
+	if (!g_key_file_has_group (key_file, TERMINAL_PROFILES_BUNDLE_GROUP))
+	{
+		g_set_error_literal (error, TERMINAL_OPTION_ERROR,
+		                     TERMINAL_OPTION_ERROR_INVALID_CONFIG_FILE,
+		                     _("Not a valid terminal profile bundle."));
+		goto out;
+	}
+
+	version = g_key_file_get_integer (key_file, TERMINAL_PROFILES_BUNDLE_GROUP, TERMINAL_PROFILES_BUNDLE_PROP_VERSION, NULL);
+	if (version <= 0 || version > TERMINAL_PROFILES_BUNDLE_VERSION)
+	{
+		g_set_error_literal (error, TERMINAL_OPTION_ERROR,
+		                     TERMINAL_OPTION_ERROR_INCOMPATIBLE_CONFIG_FILE,
+		                     _("Incompatible terminal profile bundle version."));
+		goto out;
+	}
+
+	profiles = g_key_file_get_string_list (key_file, TERMINAL_PROFILES_BUNDLE_GROUP, TERMINAL_PROFILES_BUNDLE_PROP_PROFILES, &n_profiles, error);
+	if (profiles == NULL)
+		goto out;
+
+	if (!g_settings_is_writable (settings_global, PROFILE_LIST_KEY))
+	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+		             "The \"%s\" key is locked", PROFILE_LIST_KEY);
+		goto out;
+	}
+
+	schema = terminal_app_lookup_profile_schema (error);
+	if (schema == NULL)
+		goto out;
+
+	keys = g_settings_schema_list_keys (schema);
+
+	old_profiles = g_settings_get_strv (settings_global, PROFILE_LIST_KEY);
+	profile_list = g_ptr_array_sized_new (g_strv_length (old_profiles) + n_profiles + 1);
+	for (i = 0; old_profiles[i] != NULL; ++i)
+		g_ptr_array_add (profile_list, old_profiles[i]);
+
+	changeset = dconf_changeset_new ();
+
+	for (i = 0; i < n_profiles; ++i)
+	{
+		const char *name = profiles[i];
+		char *group;
+		gboolean known = FALSE;
+
+		group = g_strconcat (TERMINAL_PROFILES_BUNDLE_PROFILE_GROUP, name, NULL);
+		if (name[0] == '\0' || strchr (name, '/') != NULL ||
+		        !g_key_file_has_group (key_file, group))
+		{
+			g_set_error (error, TERMINAL_OPTION_ERROR,
+			             TERMINAL_OPTION_ERROR_INVALID_CONFIG_FILE,
+			             _("Invalid profile \"%s\" in terminal profile bundle."), name);
+			g_free (group);
+			goto out;
+		}
+
+		for (j = 0; keys[j] != NULL; ++j)
+		{
+			GSettingsSchemaKey *schema_key;
+			GVariant *value = NULL;
+			char *path, *text;
+
+			path = g_strconcat (CONF_PROFILE_PREFIX, name, "/", keys[j], NULL);
+			text = g_key_file_get_value (key_file, group, keys[j], NULL);
+
+			if (text != NULL)
+			{
+				schema_key = g_settings_schema_get_key (schema, keys[j]);
+				value = g_variant_parse (g_settings_schema_key_get_value_type (schema_key),
+				                         text, NULL, NULL, NULL);
+				if (value != NULL && !g_settings_schema_key_range_check (schema_key, value))
+					g_clear_pointer (&value, g_variant_unref);
+				g_settings_schema_key_unref (schema_key);
+
+				if (value == NULL)
+				{
+					g_set_error (error, TERMINAL_OPTION_ERROR,
+					             TERMINAL_OPTION_ERROR_INVALID_CONFIG_FILE,
+					             _("Invalid value for \"%s\" in profile \"%s\"."), keys[j], name);
+					g_free (text);
+					g_free (path);
+					g_free (group);
+					goto out;
+				}
+			}
+
+			/* A NULL value resets the key to the schema default */
+			dconf_changeset_set (changeset, path, value);
+
+			if (value != NULL)
+				g_variant_unref (value);
+			g_free (text);
+			g_free (path);
+		}
+
+		g_free (group);
+
+		for (j = 0; j < profile_list->len && !known; ++j)
+			known = strcmp (g_ptr_array_index (profile_list, j), name) == 0;
+		if (!known)
+			g_ptr_array_add (profile_list, (gpointer) name);
+	}
+
+	g_ptr_array_add (profile_list, NULL);
+
+	g_object_get (settings_global, "path", &global_path, NULL);
+	list_path = g_strconcat (global_path, PROFILE_LIST_KEY, NULL);
+	dconf_changeset_set (changeset, list_path,
+	                     g_variant_new_strv ((const char * const *) profile_list->pdata, -1));
+	g_free (list_path);
+
+	client = dconf_client_new ();
+	result = dconf_client_change_sync (client, changeset, NULL, NULL, error);
+	g_object_unref (client);
+
+out:
+	if (changeset != NULL)
+		dconf_changeset_unref (changeset);
+	if (profile_list != NULL)
+		g_ptr_array_free (profile_list, TRUE);
+	if (schema != NULL)
+		g_settings_schema_unref (schema);
+	g_free (global_path);
+	g_strfreev (old_profiles);
+	g_strfreev (profiles);
+	g_strfreev (keys);
+	g_key_file_free (key_file);
+
+	return result;
+}
@@ -56,6 +56,13 @@ G_BEGIN_DECLS
 #define TERMINAL_CONFIG_TERMINAL_PROP_WORKING_DIRECTORY  "WorkingDirectory"
 #define TERMINAL_CONFIG_TERMINAL_PROP_ZOOM               "Zoom"
 
+#define TERMINAL_PROFILES_BUNDLE_VERSION         (1) /* Bump this for incompatible changes */
+
+#define TERMINAL_PROFILES_BUNDLE_GROUP           "MATE Terminal Profiles"
+#define TERMINAL_PROFILES_BUNDLE_PROP_VERSION    "Version"
+#define TERMINAL_PROFILES_BUNDLE_PROP_PROFILES   "Profiles"
+#define TERMINAL_PROFILES_BUNDLE_PROFILE_GROUP   "Profile "
+
 /* Configuration */
 
 #define CONF_PREFIX           "org.mate.terminal"
@@ -84,6 +91,13 @@ G_BEGIN_DECLS
 typedef struct _TerminalAppClass TerminalAppClass;
 typedef struct _TerminalApp TerminalApp;
 
+typedef struct
+{
+	TerminalProfile *profile;
+	char *label;          /* the visible name, with underscores escaped */
+	char *mnemonic_label; /* the label prefixed with a numbered mnemonic */
+} TerminalProfileMenuItem;
+
 extern GSettings *settings_global;
 
 GType terminal_app_get_type (void);
@@ -122,6 +136,9 @@ TerminalWindow *terminal_app_get_current_window (TerminalApp *app,
                                                  GdkScreen *screen,
                                                  int curr_workspace);
 
+void terminal_app_mark_session_dirty (TerminalApp    *app,
+                                      TerminalWindow *window);
+
 void terminal_app_manage_profiles (TerminalApp     *app,
                                    GtkWindow       *transient_parent);
 
@@ -146,6 +163,12 @@ TerminalProfile* terminal_app_get_default_profile (TerminalApp *app);
 /* never returns NULL if any profiles exist, one is always supposed to */
 TerminalProfile* terminal_app_get_profile_for_new_term (TerminalApp *app);
 
+GArray *terminal_app_get_profile_menu (TerminalApp *app);
+
+guint terminal_app_get_profile_menu_serial (TerminalApp *app);
+
+guint terminal_app_get_encoding_menu_serial (TerminalApp *app);
+
 TerminalEncoding *terminal_app_ensure_encoding (TerminalApp *app,
         const char *charset);
 
@@ -160,6 +183,14 @@ gboolean terminal_app_save_config_file (TerminalApp *app,
                                         const char *file_name,
                                         GError **error);
 
+gboolean terminal_app_export_profiles_file (TerminalApp *app,
+                                            const char *file_name,
+                                            GError **error);
+
+gboolean terminal_app_import_profiles_file (TerminalApp *app,
+                                            const char *file_name,
+                                            GError **error);
+
 G_END_DECLS
 
 #endif /* !TERMINAL_APP_H */
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "terminal-contents-formatter.h"
+
+/* Turns the text of a terminal and its cell attributes into HTML or text
+ * with ANSI escape sequences. Each run of cells with the same colours and
+ * decorations becomes one span or SGR sequence, so the output stays
+ * proportional to the text.
+ */
+
+/* Marks a colour that is the terminal's default one */
+#define DEFAULT_COLOR (G_MAXUINT32)
+
+typedef struct
+{
+	guint32 fore; /* 0xRRGGBB, or DEFAULT_COLOR */
+	guint32 back;
+	gboolean underline;
+	gboolean strikethrough;
+} CellStyle;
+
+struct _TerminalContentsFormatter
+{
+	TerminalContentsFormat format;
+
+	/* The colours that need no markup, or DEFAULT_COLOR if unknown */
+	guint32 foreground;
+	guint32 background;
+
+	CellStyle style; /* of the current run */
+};
+
+/* Converts the way VTE does, so the default colours compare equal */
+static guint32
+rgba_to_rgb (const GdkRGBA *color)
+{
+	return (((guint32) ((guint16) (color->red * 65535.) >> 8)) << 16) |
+	       (((guint32) ((guint16) (color->green * 65535.) >> 8)) << 8) |
+	       ((guint32) ((guint16) (color->blue * 65535.) >> 8));
+}
+
+static guint32
+pango_color_to_rgb (const PangoColor *color)
+{
+	return ((guint32) (color->red >> 8) << 16) |
+	       ((guint32) (color->green >> 8) << 8) |
+	       (guint32) (color->blue >> 8);
+}
+
+static void
+cell_style_from_attributes (TerminalContentsFormatter *formatter,
+                            const VteCharAttributes   *attr,
+                            CellStyle                 *style)
+{
+	style->fore = pango_color_to_rgb (&attr->fore);
+	if (style->fore == formatter->foreground)
+		style->fore = DEFAULT_COLOR;
+
+	style->back = pango_color_to_rgb (&attr->back);
+	if (style->back == formatter->background)
+		style->back = DEFAULT_COLOR;
+
+	style->underline = attr->underline;
+	style->strikethrough = attr->strikethrough;
+}
+
+static gboolean
+cell_style_equal (const CellStyle *a,
+                  const CellStyle *b)
+{
+	return a->fore == b->fore &&
+	       a->back == b->back &&
+	       a->underline == b->underline &&
+	       a->strikethrough == b->strikethrough;
+}
+
+static gboolean
+cell_style_is_default (const CellStyle *style)
+{
+	return style->fore == DEFAULT_COLOR &&
+	       style->back == DEFAULT_COLOR &&
+	       !style->underline &&
+	       !style->strikethrough;
+}
+
+/* Ends the current run and starts one with @style */
+static void
+append_style_change (TerminalContentsFormatter *formatter,
+                     GString                   *string,
+                     const CellStyle           *style)
+{
+	if (formatter->format == TERMINAL_CONTENTS_FORMAT_HTML)
+	{
+		if (!cell_style_is_default (&formatter->style))
+			g_string_append (string, "</span>");
+
+		if (!cell_style_is_default (style))
+		{
+			g_string_append (string, "<span style=\"");
+			if (style->fore != DEFAULT_COLOR)
+				g_string_append_printf (string, "color:#%06x;", style->fore);
+			if (style->back != DEFAULT_COLOR)
+				g_string_append_printf (string, "background-color:#%06x;", style->back);
+			if (style->underline || style->strikethrough)
+				g_string_append_printf (string, "text-decoration:%s%s;",
+				                        style->underline ? " underline" : "",
+				                        style->strikethrough ? " line-through" : "");
+			g_string_append (string, "\">");
+		}
+	}
+	else
+	{
+		/* Reset, then set what differs from the defaults */
+		g_string_append (string, "\033[0");
+		if (style->underline)
+			g_string_append (string, ";4");
+		if (style->strikethrough)
+			g_string_append (string, ";9");
+		if (style->fore != DEFAULT_COLOR)
+			g_string_append_printf (string, ";38;2;%u;%u;%u",
+			                        (style->fore >> 16) & 0xff,
+			                        (style->fore >> 8) & 0xff,
+			                        style->fore & 0xff);
+		if (style->back != DEFAULT_COLOR)
+			g_string_append_printf (string, ";48;2;%u;%u;%u",
+			                        (style->back >> 16) & 0xff,
+			                        (style->back >> 8) & 0xff,
+			                        style->back & 0xff);
+		g_string_append_c (string, 'm');
+	}
+
+	formatter->style = *style;
+}
+
+static void
+append_run (TerminalContentsFormatter *formatter,
+            GString                   *string,
+            const char                *text,
+            gsize                      len)
+{
+	const char *end = text + len;
+
+	if (formatter->format != TERMINAL_CONTENTS_FORMAT_HTML)
+	{
+		g_string_append_len (string, text, len);
+		return;
+	}
+
+	for (; text < end; ++text)
+	{
+		switch (*text)
+		{
+		case '<':
+			g_string_append (string, "&lt;");
+			break;
+		case '>':
+			g_string_append (string, "&gt;");
+			break;
+		case '&':
+			g_string_append (string, "&amp;");
+			break;
+		default:
+			g_string_append_c (string, *text);
+			break;
+		}
+	}
+}
+
+/**
+ * terminal_contents_formatter_new:
+ * @format: the format to produce
+ * @foreground: (allow-none): the default foreground colour of the terminal
+ * @background: (allow-none): the default background colour of the terminal
+ *
+ * Text in the default colours gets no colour markup; without @foreground
+ * and @background, all colours are written out.
+ *
+ * Returns: a new formatter, to be freed with
+ *   terminal_contents_formatter_free()
+ */
+TerminalContentsFormatter *
+terminal_contents_formatter_new (TerminalContentsFormat  format,
+                                 const GdkRGBA          *foreground,
+                                 const GdkRGBA          *background)
+{
+	TerminalContentsFormatter *formatter;
+
+	formatter = g_slice_new0 (TerminalContentsFormatter);
+	formatter->format = format;
+	formatter->foreground = foreground != NULL ? rgba_to_rgb (foreground) : DEFAULT_COLOR;
+	formatter->background = background != NULL ? rgba_to_rgb (background) : DEFAULT_COLOR;
+	formatter->style.fore = formatter->style.back = DEFAULT_COLOR;
+
+	return formatter;
+}
+
+void
+terminal_contents_formatter_free (TerminalContentsFormatter *formatter)
+{
+	g_slice_free (TerminalContentsFormatter, formatter);
+}
+
+/**
+ * terminal_contents_formatter_format:
+ * @formatter:
+ * @text: (transfer full): text from vte_terminal_get_text_range()
+ * @attributes: (allow-none): the attributes that came with @text, one
+ *   entry per byte
+ *
+ * Formats the next chunk of text. The current run carries over from one
+ * chunk to the next.
+ *
+ * Returns: the formatted text
+ */
+char *
+terminal_contents_formatter_format (TerminalContentsFormatter *formatter,
+                                    char                      *text,
+                                    GArray                    *attributes)
+{
+	GString *string;
+	gsize len, start, i;
+
+	if (formatter->format == TERMINAL_CONTENTS_FORMAT_TEXT || attributes == NULL)
+		return text;
+
+	len = MIN (strlen (text), attributes->len);
+	string = g_string_sized_new (len + len / 8);
+
+	for (start = 0; start < len; start = i)
+	{
+		CellStyle style;
+
+		cell_style_from_attributes (formatter, &g_array_index (attributes, VteCharAttributes, start),
+		                            &style);
+		if (!cell_style_equal (&style, &formatter->style))
+			append_style_change (formatter, string, &style);
+
+		/* Extend the run up to the next character that looks different;
+		 * the bytes of one character always share its attributes.
+		 */
+		for (i = start + 1; i < len; ++i)
+		{
+			CellStyle next;
+
+			if ((text[i] & 0xc0) == 0x80)
+				continue;
+
+			cell_style_from_attributes (formatter, &g_array_index (attributes, VteCharAttributes, i),
+			                            &next);
+			if (!cell_style_equal (&next, &style))
+				break;
+		}
+
+		append_run (formatter, string, text + start, i - start);
+	}
+
+	g_free (text);
+
+	return g_string_free (string, FALSE);
+}
+
+/**
+ * terminal_contents_formatter_get_header:
+ * @formatter:
+ * @title: (allow-none): the title of the document
+ *
+ * Returns: (allow-none): what goes before the text, or %NULL if nothing
+ */
+char *
+terminal_contents_formatter_get_header (TerminalContentsFormatter *formatter,
+                                        const char                *title)
+{
+	GString *string;
+	char *escaped_title;
+
+	if (formatter->format != TERMINAL_CONTENTS_FORMAT_HTML)
+		return NULL;
+
+	string = g_string_new ("<!DOCTYPE html>\n"
+	                       "<html>\n"
+	                       "<head>\n"
+	                       "<meta charset=\"utf-8\">\n");
+
+	escaped_title = g_markup_escape_text (title != NULL ? title : "", -1);
+	g_string_append_printf (string, "<title>%s</title>\n", escaped_title);
+	g_free (escaped_title);
+
+	g_string_append (string, "</head>\n");
+	if (formatter->foreground != DEFAULT_COLOR && formatter->background != DEFAULT_COLOR)
+		g_string_append_printf (string,
+		                        "<body style=\"background-color:#%06x;\">\n"
+		                        "<pre style=\"color:#%06x;\">",
+		                        formatter->background, formatter->foreground);
+	else
+		g_string_append (string, "<body>\n<pre>");
+
+	return g_string_free (string, FALSE);
+}
+
+/**
+ * terminal_contents_formatter_get_footer:
+ * @formatter:
+ *
+ * Returns: (allow-none): what goes after the text, or %NULL if nothing
+ */
+char *
+terminal_contents_formatter_get_footer (TerminalContentsFormatter *formatter)
+{
+	GString *string;
+
+	if (formatter->format == TERMINAL_CONTENTS_FORMAT_TEXT)
+		return NULL;
+
+	string = g_string_new (NULL);
+
+	if (formatter->format == TERMINAL_CONTENTS_FORMAT_HTML)
+	{
+		if (!cell_style_is_default (&formatter->style))
+			g_string_append (string, "</span>");
+		g_string_append (string, "</pre>\n</body>\n</html>\n");
+	}
+	else if (!cell_style_is_default (&formatter->style))
+		g_string_append (string, "\033[0m");
+
+	return g_string_free (string, FALSE);
+}
+
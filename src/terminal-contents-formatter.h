@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TERMINAL_CONTENTS_FORMATTER_H
+#define TERMINAL_CONTENTS_FORMATTER_H
+
+#include <gtk/gtk.h>
+#include <vte/vte.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+    TERMINAL_CONTENTS_FORMAT_TEXT,
+    TERMINAL_CONTENTS_FORMAT_HTML,
+    TERMINAL_CONTENTS_FORMAT_ANSI
+} TerminalContentsFormat;
+
+typedef struct _TerminalContentsFormatter TerminalContentsFormatter;
+
+TerminalContentsFormatter *terminal_contents_formatter_new (TerminalContentsFormat  format,
+        const GdkRGBA          *foreground,
+        const GdkRGBA          *background);
+
+void terminal_contents_formatter_free (TerminalContentsFormatter *formatter);
+
+char *terminal_contents_formatter_get_header (TerminalContentsFormatter *formatter,
+        const char                *title);
+
+char *terminal_contents_formatter_format (TerminalContentsFormatter *formatter,
+        char                      *text,
+        GArray                    *attributes);
+
+char *terminal_contents_formatter_get_footer (TerminalContentsFormatter *formatter);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_CONTENTS_FORMATTER_H */
@@ -37,7 +37,10 @@ _terminal_debug_init(void)
 		{ "geometry",  TERMINAL_DEBUG_GEOMETRY  },
 		{ "mdi",       TERMINAL_DEBUG_MDI       },
 		{ "processes", TERMINAL_DEBUG_PROCESSES },
-		{ "profile",   TERMINAL_DEBUG_PROFILE   }
+		{ "profile",   TERMINAL_DEBUG_PROFILE   },
+		{ "search",    TERMINAL_DEBUG_SEARCH    },
+		{ "stats",     TERMINAL_DEBUG_STATS     },
+		{ "scrollback", TERMINAL_DEBUG_SCROLLBACK }
 	};
 
 	_terminal_debug_flags = g_parse_debug_string (g_getenv ("MATE_TERMINAL_DEBUG"),
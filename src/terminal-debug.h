@@ -34,7 +34,10 @@ typedef enum
     TERMINAL_DEBUG_GEOMETRY   = 1 << 3,
     TERMINAL_DEBUG_MDI        = 1 << 4,
     TERMINAL_DEBUG_PROCESSES  = 1 << 5,
-    TERMINAL_DEBUG_PROFILE    = 1 << 6
+    TERMINAL_DEBUG_PROFILE    = 1 << 6,
+    TERMINAL_DEBUG_SEARCH     = 1 << 7,
+    TERMINAL_DEBUG_STATS      = 1 << 8,
+    TERMINAL_DEBUG_SCROLLBACK = 1 << 9
 } TerminalDebugFlags;
 
 void _terminal_debug_init(void);
@@ -88,6 +88,30 @@ initial_window_free (InitialWindow *iw)
 	g_slice_free (InitialWindow, iw);
 }
 
+/* The options are parsed one at a time and usually refer to the window
+ * or tab that was added last, so keep the tails around to make appending
+ * and looking them up O(1).
+ */
+static void
+initial_window_append_tab (InitialWindow *iw,
+                           InitialTab    *it)
+{
+	if (iw->tabs_tail == NULL)
+		iw->tabs = iw->tabs_tail = g_list_prepend (NULL, it);
+	else
+		iw->tabs_tail = g_list_append (iw->tabs_tail, it)->next;
+}
+
+static void
+options_append_window (TerminalOptions *options,
+                       InitialWindow   *iw)
+{
+	if (options->initial_windows_tail == NULL)
+		options->initial_windows = options->initial_windows_tail = g_list_prepend (NULL, iw);
+	else
+		options->initial_windows_tail = g_list_append (options->initial_windows_tail, iw)->next;
+}
+
 static void
 apply_defaults (TerminalOptions *options,
                 InitialWindow        *iw)
@@ -121,14 +145,14 @@ ensure_top_window (TerminalOptions *options)
 	if (options->initial_windows == NULL)
 	{
 		iw = initial_window_new (0);
-		iw->tabs = g_list_append (NULL, initial_tab_new (NULL, FALSE));
+		initial_window_append_tab (iw, initial_tab_new (NULL, FALSE));
 		apply_defaults (options, iw);
 
-		options->initial_windows = g_list_append (options->initial_windows, iw);
+		options_append_window (options, iw);
 	}
 	else
 	{
-		iw = g_list_last (options->initial_windows)->data;
+		iw = options->initial_windows_tail->data;
 	}
 
 	g_assert (iw->tabs);
@@ -146,7 +170,7 @@ ensure_top_tab (TerminalOptions *options)
 
 	g_assert (iw->tabs);
 
-	it = g_list_last (iw->tabs)->data;
+	it = iw->tabs_tail->data;
 
 	return it;
 }
@@ -159,10 +183,10 @@ add_new_window (TerminalOptions *options,
 	InitialWindow *iw;
 
 	iw = initial_window_new (0);
-	iw->tabs = g_list_prepend (NULL, initial_tab_new (profile, is_id));
+	initial_window_append_tab (iw, initial_tab_new (profile, is_id));
 	apply_defaults (options, iw);
 
-	options->initial_windows = g_list_append (options->initial_windows, iw);
+	options_append_window (options, iw);
 
 	return iw;
 }
@@ -312,13 +336,13 @@ option_tab_callback (const gchar *option_name,
 
 	if (options->initial_windows)
 	{
-		iw = g_list_last (options->initial_windows)->data;
-		iw->tabs = g_list_append (iw->tabs, initial_tab_new (value, is_profile_id));
+		iw = options->initial_windows_tail->data;
+		initial_window_append_tab (iw, initial_tab_new (value, is_profile_id));
 	}
 	else
 	{
 		iw = add_new_window (options, value, is_profile_id);
-		it = g_list_last(iw->tabs)->data;
+		it = iw->tabs_tail->data;
 		it->attach_window = TRUE;
 	}
 
@@ -336,7 +360,7 @@ option_role_callback (const gchar *option_name,
 
 	if (options->initial_windows)
 	{
-		iw = g_list_last (options->initial_windows)->data;
+		iw = options->initial_windows_tail->data;
 		iw->role = g_strdup (value);
 	}
 	else if (!options->default_role)
@@ -362,7 +386,7 @@ option_show_menubar_callback (const gchar *option_name,
 
 	if (options->initial_windows)
 	{
-		iw = g_list_last (options->initial_windows)->data;
+		iw = options->initial_windows_tail->data;
 		if (iw->force_menubar_state && iw->menubar_state == TRUE)
 		{
 			g_printerr (_("\"%s\" option given twice for the same window\n"),
@@ -394,7 +418,7 @@ option_hide_menubar_callback (const gchar *option_name,
 
 	if (options->initial_windows)
 	{
-		iw = g_list_last (options->initial_windows)->data;
+		iw = options->initial_windows_tail->data;
 
 		if (iw->force_menubar_state && iw->menubar_state == FALSE)
 		{
@@ -426,7 +450,7 @@ option_maximize_callback (const gchar *option_name,
 
 	if (options->initial_windows)
 	{
-		iw = g_list_last (options->initial_windows)->data;
+		iw = options->initial_windows_tail->data;
 		iw->start_maximized = TRUE;
 	}
 	else
@@ -447,7 +471,7 @@ option_fullscreen_callback (const gchar *option_name,
 	{
 		InitialWindow *iw;
 
-		iw = g_list_last (options->initial_windows)->data;
+		iw = options->initial_windows_tail->data;
 		iw->start_fullscreen = TRUE;
 	}
 	else
@@ -468,7 +492,7 @@ option_geometry_callback (const gchar *option_name,
 	{
 		InitialWindow *iw;
 
-		iw = g_list_last (options->initial_windows)->data;
+		iw = options->initial_windows_tail->data;
 		iw->geometry = g_strdup (value);
 	}
 	else
@@ -490,6 +514,19 @@ option_disable_factory_callback (const gchar *option_name,
 	return TRUE;
 }
 
+static gboolean
+option_restore_last_callback (const gchar *option_name,
+                              const gchar *value,
+                              gpointer     data,
+                              GError     **error)
+{
+	TerminalOptions *options = data;
+
+	options->restore_last = TRUE;
+
+	return TRUE;
+}
+
 static gboolean
 option_load_save_config_cb (const gchar *option_name,
                             const gchar *value,
@@ -512,6 +549,28 @@ option_load_save_config_cb (const gchar *option_name,
 	return TRUE;
 }
 
+static gboolean
+option_import_export_profiles_cb (const gchar *option_name,
+                                  const gchar *value,
+                                  gpointer     data,
+                                  GError     **error)
+{
+	TerminalOptions *options = data;
+
+	if (options->profiles_file)
+	{
+		g_set_error_literal (error, TERMINAL_OPTION_ERROR, TERMINAL_OPTION_ERROR_EXCLUSIVE_OPTIONS,
+		                     "Options \"--import-profiles\" and \"--export-profiles\" are mutually exclusive");
+		return FALSE;
+	}
+
+	options->profiles_file = terminal_util_resolve_relative_path (options->default_working_dir, value);
+	options->import_profiles = strcmp (option_name, "--import-profiles") == 0;
+	options->export_profiles = strcmp (option_name, "--export-profiles") == 0;
+
+	return TRUE;
+}
+
 static gboolean
 option_title_callback (const gchar *option_name,
                        const gchar *value,
@@ -717,6 +776,7 @@ terminal_options_parse (const char *working_directory,
 	options->startup_id = g_strdup (startup_id && startup_id[0] ? startup_id : NULL);
 	options->display_name = g_strdup (display_name);
 	options->initial_windows = NULL;
+	options->initial_windows_tail = NULL;
 	options->default_role = NULL;
 	options->default_geometry = NULL;
 	options->default_title = NULL;
@@ -802,7 +862,7 @@ terminal_options_merge_config (TerminalOptions *options,
 	char **groups;
 	guint i;
 	gboolean have_error = FALSE;
-	GList *initial_windows = NULL;
+	GList *initial_windows = NULL, *initial_windows_tail = NULL;
 
 	if (!g_key_file_has_group (key_file, TERMINAL_CONFIG_GROUP))
 	{
@@ -841,7 +901,10 @@ terminal_options_merge_config (TerminalOptions *options,
 			continue; /* no tabs in this window, skip it */
 
 		iw = initial_window_new (source_tag);
-		initial_windows = g_list_append (initial_windows, iw);
+		if (initial_windows_tail == NULL)
+			initial_windows = initial_windows_tail = g_list_prepend (NULL, iw);
+		else
+			initial_windows_tail = g_list_append (initial_windows_tail, iw)->next;
 		apply_defaults (options, iw);
 
 		iw->role = g_key_file_get_string (key_file, window_group, TERMINAL_CONFIG_WINDOW_PROP_ROLE, NULL);
@@ -864,7 +927,7 @@ terminal_options_merge_config (TerminalOptions *options,
 			it = initial_tab_new (profile, TRUE);
 			g_free (profile);
 
-			iw->tabs = g_list_append (iw->tabs, it);
+			initial_window_append_tab (iw, it);
 
 			/*          it->width = g_key_file_get_integer (key_file, tab_group, TERMINAL_CONFIG_TERMINAL_PROP_WIDTH, NULL);
 			          it->height = g_key_file_get_integer (key_file, tab_group, TERMINAL_CONFIG_TERMINAL_PROP_HEIGHT, NULL);*/
@@ -894,7 +957,15 @@ terminal_options_merge_config (TerminalOptions *options,
 		return FALSE;
 	}
 
-	options->initial_windows = g_list_concat (options->initial_windows, initial_windows);
+	if (initial_windows != NULL)
+	{
+		if (options->initial_windows_tail == NULL)
+			options->initial_windows = initial_windows;
+		else
+			g_list_concat (options->initial_windows_tail, initial_windows);
+
+		options->initial_windows_tail = initial_windows_tail;
+	}
 
 	return TRUE;
 }
@@ -929,6 +1000,7 @@ terminal_options_free (TerminalOptions *options)
 	g_free (options->default_working_dir);
 	g_free (options->default_title);
 	g_free (options->default_profile);
+	g_free (options->profiles_file);
 
 	g_strfreev (options->exec_argv);
 
@@ -970,6 +1042,33 @@ get_goption_context (TerminalOptions *options)
 			N_("Save the terminal configuration to a file"),
 			N_("FILE")
 		},
+		{
+			"restore-last",
+			0,
+			G_OPTION_FLAG_NO_ARG,
+			G_OPTION_ARG_CALLBACK,
+			option_restore_last_callback,
+			N_("Restore the windows and tabs of the last automatically saved session"),
+			NULL
+		},
+		{
+			"import-profiles",
+			0,
+			G_OPTION_FLAG_FILENAME,
+			G_OPTION_ARG_CALLBACK,
+			option_import_export_profiles_cb,
+			N_("Import profiles from a profile bundle file"),
+			N_("FILE")
+		},
+		{
+			"export-profiles",
+			0,
+			G_OPTION_FLAG_FILENAME,
+			G_OPTION_ARG_CALLBACK,
+			option_import_export_profiles_cb,
+			N_("Export all profiles to a profile bundle file"),
+			N_("FILE")
+		},
 		{ "version", 0, G_OPTION_FLAG_NO_ARG | G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_CALLBACK, option_version_cb, NULL, NULL },
 		{ NULL, 0, 0, 0, NULL, NULL, NULL }
 	};
@@ -34,6 +34,7 @@ typedef struct
 	char    *startup_id;
 	char    *display_name;
 	GList   *initial_windows;
+	GList   *initial_windows_tail; /* last link of initial_windows */
 	gboolean default_window_menubar_forced;
 	gboolean default_window_menubar_state;
 	gboolean default_fullscreen;
@@ -53,6 +54,10 @@ typedef struct
 	char    *config_file;
 	gboolean load_config;
 	gboolean save_config;
+	char    *profiles_file;
+	gboolean import_profiles;
+	gboolean export_profiles;
+	gboolean restore_last;
 	int      initial_workspace;
 } TerminalOptions;
 
@@ -74,6 +79,7 @@ typedef struct
 	guint source_tag;
 
 	GList *tabs; /* list of InitialTab */
+	GList *tabs_tail; /* last link of tabs */
 
 	gboolean force_menubar_state;
 	gboolean menubar_state;
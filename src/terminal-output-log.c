@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "terminal-output-log.h"
+
+/* The text is handed to a writer thread through a queue, so the main loop
+ * (and with it VTE reading from the child) never waits for the disk. The
+ * queue is bounded; if the disk can't keep up, output is dropped and a
+ * note saying how much is written in its place.
+ *
+ * All logs share one writer, a thread pool running at most one thread. A
+ * log with something queued is pushed to the pool once; the writer writes
+ * one batch of it and pushes it again if more has come in since, so a busy
+ * log doesn't keep the others waiting.
+ */
+#define QUEUE_MAX_BYTES (4 * 1024 * 1024)
+
+/* How many names to try when a log file with the same timestamp exists */
+#define MAX_NAME_ATTEMPTS (100)
+
+static GThreadPool *writer_pool;
+
+/* Closed logs whose queues are still being written, counted so that
+ * terminal_output_log_wait_closed() can wait for them before the process
+ * exits.
+ */
+static GMutex closing_lock;
+static GCond closing_cond;
+static guint n_closing;
+
+struct _TerminalOutputLog
+{
+	GMutex lock;
+
+	/* Protected by the lock */
+	GQueue chunks; /* of GBytes */
+	gsize queued_bytes;
+	gsize dropped_bytes;
+	gboolean scheduled; /* pushed to the writer pool */
+	gboolean closing;
+
+	/* Only used by the writer thread */
+	char *directory;
+	char *basename;
+	goffset max_size;
+	gint64 rotate_interval; /* usec */
+	gboolean compress;
+
+	GOutputStream *stream;
+	goffset file_size;
+	gint64 file_opened;
+	gboolean open_failed;
+};
+
+static void
+output_log_close_file (TerminalOutputLog *log)
+{
+	if (log->stream == NULL)
+		return;
+
+	g_output_stream_close (log->stream, NULL, NULL);
+	g_clear_object (&log->stream);
+}
+
+static gboolean
+output_log_open_file (TerminalOutputLog *log)
+{
+	GFileOutputStream *file_stream = NULL;
+	GDateTime *now;
+	char *timestamp;
+	guint i;
+
+	if (g_mkdir_with_parents (log->directory, 0700) != 0)
+		return FALSE;
+
+	now = g_date_time_new_now_local ();
+	timestamp = g_date_time_format (now, "%Y%m%d-%H%M%S");
+	g_date_time_unref (now);
+
+	for (i = 0; file_stream == NULL && i < MAX_NAME_ATTEMPTS; ++i)
+	{
+		GError *error = NULL;
+		GFile *file;
+		char *name, *path;
+
+		if (i == 0)
+			name = g_strdup_printf ("%s-%s.log%s", log->basename, timestamp,
+			                        log->compress ? ".gz" : "");
+		else
+			name = g_strdup_printf ("%s-%s-%u.log%s", log->basename, timestamp, i,
+			                        log->compress ? ".gz" : "");
+
+		path = g_build_filename (log->directory, name, NULL);
+		file = g_file_new_for_path (path);
+
+		file_stream = g_file_create (file, G_FILE_CREATE_PRIVATE, NULL, &error);
+
+		g_object_unref (file);
+		g_free (path);
+		g_free (name);
+
+		if (error == NULL)
+			break;
+
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+		{
+			g_error_free (error);
+			break;
+		}
+		g_error_free (error);
+	}
+
+	g_free (timestamp);
+
+	if (file_stream == NULL)
+		return FALSE;
+
+	if (log->compress)
+	{
+		GZlibCompressor *compressor;
+
+		compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+		log->stream = g_converter_output_stream_new (G_OUTPUT_STREAM (file_stream),
+		                                             G_CONVERTER (compressor));
+		g_object_unref (compressor);
+		g_object_unref (file_stream);
+	}
+	else
+		log->stream = G_OUTPUT_STREAM (file_stream);
+
+	log->file_size = 0;
+	log->file_opened = g_get_monotonic_time ();
+
+	return TRUE;
+}
+
+static void
+output_log_write (TerminalOutputLog *log,
+                  const char        *data,
+                  gsize              len)
+{
+	/* The limits count the text, not what ends up on disk after compression */
+	if (log->stream != NULL &&
+	        ((log->max_size > 0 && log->file_size >= log->max_size) ||
+	         (log->rotate_interval > 0 &&
+	          g_get_monotonic_time () - log->file_opened >= log->rotate_interval)))
+		output_log_close_file (log);
+
+	if (log->stream == NULL)
+	{
+		/* Give up rather than retry for every chunk */
+		if (log->open_failed)
+			return;
+
+		if (!output_log_open_file (log))
+		{
+			g_warning ("Could not open an output log file in %s", log->directory);
+			log->open_failed = TRUE;
+			return;
+		}
+	}
+
+	if (!g_output_stream_write_all (log->stream, data, len, NULL, NULL, NULL))
+	{
+		output_log_close_file (log);
+		return;
+	}
+
+	log->file_size += len;
+}
+
+/* Called with the log locked */
+static void
+output_log_schedule (TerminalOutputLog *log)
+{
+	if (log->scheduled)
+		return;
+
+	log->scheduled = TRUE;
+	g_thread_pool_push (writer_pool, log, NULL);
+}
+
+static void
+output_log_free (TerminalOutputLog *log)
+{
+	output_log_close_file (log);
+
+	g_mutex_clear (&log->lock);
+	g_free (log->directory);
+	g_free (log->basename);
+	g_slice_free (TerminalOutputLog, log);
+}
+
+static void
+output_log_writer (TerminalOutputLog *log,
+                   gpointer           user_data)
+{
+	GQueue chunks;
+	gsize dropped_bytes;
+	gboolean closed;
+	GBytes *bytes;
+
+	/* Take everything queued so far and write it without the lock */
+	g_mutex_lock (&log->lock);
+	chunks = log->chunks;
+	g_queue_init (&log->chunks);
+	log->queued_bytes = 0;
+	dropped_bytes = log->dropped_bytes;
+	log->dropped_bytes = 0;
+	g_mutex_unlock (&log->lock);
+
+	while ((bytes = g_queue_pop_head (&chunks)) != NULL)
+	{
+		gsize len;
+		const char *data = g_bytes_get_data (bytes, &len);
+
+		output_log_write (log, data, len);
+		g_bytes_unref (bytes);
+	}
+
+	if (dropped_bytes > 0)
+	{
+		char *note;
+
+		note = g_strdup_printf ("\n[%" G_GSIZE_FORMAT " bytes of output not logged]\n",
+		                        dropped_bytes);
+		output_log_write (log, note, strlen (note));
+		g_free (note);
+	}
+
+	g_mutex_lock (&log->lock);
+	log->scheduled = FALSE;
+	if (!g_queue_is_empty (&log->chunks) || log->dropped_bytes > 0)
+		output_log_schedule (log);
+	closed = log->closing && !log->scheduled;
+	g_mutex_unlock (&log->lock);
+
+	if (!closed)
+		return;
+
+	/* The log was closed, so nobody else refers to it any more */
+	output_log_free (log);
+
+	g_mutex_lock (&closing_lock);
+	if (--n_closing == 0)
+		g_cond_broadcast (&closing_cond);
+	g_mutex_unlock (&closing_lock);
+}
+
+/**
+ * terminal_output_log_new:
+ * @directory: the directory to write the log files to
+ * @basename: the start of the name of the log files
+ * @max_size: the size in bytes after which a new file is started, or 0
+ * @rotate_interval: the age in seconds after which a new file is
+ *   started, or 0
+ * @compress: whether to compress the files with gzip
+ *
+ * Starts a log, written by the shared writer thread. The log files are named
+ * after @basename and the time they were started; the first one is only
+ * created once there is something to write.
+ *
+ * Returns: the new log, to be closed with terminal_output_log_close()
+ */
+TerminalOutputLog *
+terminal_output_log_new (const char *directory,
+                         const char *basename,
+                         goffset     max_size,
+                         guint       rotate_interval,
+                         gboolean    compress)
+{
+	TerminalOutputLog *log;
+
+	g_return_val_if_fail (directory != NULL, NULL);
+	g_return_val_if_fail (basename != NULL, NULL);
+
+	if (writer_pool == NULL)
+		writer_pool = g_thread_pool_new ((GFunc) output_log_writer, NULL,
+		                                 1, FALSE, NULL);
+
+	log = g_slice_new0 (TerminalOutputLog);
+	g_mutex_init (&log->lock);
+	g_queue_init (&log->chunks);
+
+	log->directory = g_strdup (directory);
+	log->basename = g_strdup (basename);
+	log->max_size = max_size;
+	log->rotate_interval = (gint64) rotate_interval * G_USEC_PER_SEC;
+	log->compress = compress != FALSE;
+
+	return log;
+}
+
+/**
+ * terminal_output_log_append:
+ * @log:
+ * @text: (transfer full): the text to log
+ * @len: the length of @text
+ *
+ * Queues @text to be written. This never waits for the disk; if too much
+ * is queued already, @text is dropped instead.
+ */
+void
+terminal_output_log_append (TerminalOutputLog *log,
+                            char              *text,
+                            gsize              len)
+{
+	g_return_if_fail (log != NULL);
+
+	g_mutex_lock (&log->lock);
+
+	if (log->queued_bytes + len > QUEUE_MAX_BYTES)
+	{
+		log->dropped_bytes += len;
+		g_free (text);
+	}
+	else
+	{
+		g_queue_push_tail (&log->chunks, g_bytes_new_take (text, len));
+		log->queued_bytes += len;
+	}
+
+	output_log_schedule (log);
+	g_mutex_unlock (&log->lock);
+}
+
+/**
+ * terminal_output_log_close:
+ * @log:
+ *
+ * Closes @log. What is queued is still written, in the background; @log
+ * must not be used any more.
+ */
+void
+terminal_output_log_close (TerminalOutputLog *log)
+{
+	g_return_if_fail (log != NULL);
+
+	g_mutex_lock (&closing_lock);
+	n_closing++;
+	g_mutex_unlock (&closing_lock);
+
+	/* The writer frees the log once its queue is written */
+	g_mutex_lock (&log->lock);
+	log->closing = TRUE;
+	output_log_schedule (log);
+	g_mutex_unlock (&log->lock);
+}
+
+/**
+ * terminal_output_log_wait_closed:
+ *
+ * Waits until everything queued on the logs closed so far is written
+ * and their files are closed. Call this before exiting, or the ends of
+ * the logs are lost and compressed ones are left corrupt.
+ */
+void
+terminal_output_log_wait_closed (void)
+{
+	g_mutex_lock (&closing_lock);
+	while (n_closing > 0)
+		g_cond_wait (&closing_cond, &closing_lock);
+	g_mutex_unlock (&closing_lock);
+}
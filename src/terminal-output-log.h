@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TERMINAL_OUTPUT_LOG_H
+#define TERMINAL_OUTPUT_LOG_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalOutputLog TerminalOutputLog;
+
+TerminalOutputLog *terminal_output_log_new (const char *directory,
+        const char *basename,
+        goffset     max_size,
+        guint       rotate_interval,
+        gboolean    compress);
+
+void terminal_output_log_append (TerminalOutputLog *log,
+                                 char              *text,
+                                 gsize              len);
+
+void terminal_output_log_close (TerminalOutputLog *log);
+
+void terminal_output_log_wait_closed (void);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_OUTPUT_LOG_H */
@@ -65,6 +65,11 @@ enum
     PROP_EXIT_ACTION,
     PROP_FONT,
     PROP_FOREGROUND_COLOR,
+    PROP_LOG_COMPRESS,
+    PROP_LOG_DIRECTORY,
+    PROP_LOG_MAX_SIZE,
+    PROP_LOG_OUTPUT,
+    PROP_LOG_ROTATE_INTERVAL,
     PROP_LOGIN_SHELL,
     PROP_NAME,
     PROP_PALETTE,
@@ -107,6 +112,11 @@ enum
 #define KEY_EXIT_ACTION "exit-action"
 #define KEY_FONT "font"
 #define KEY_FOREGROUND_COLOR "foreground-color"
+#define KEY_LOG_COMPRESS "log-compress"
+#define KEY_LOG_DIRECTORY "log-directory"
+#define KEY_LOG_MAX_SIZE "log-max-size"
+#define KEY_LOG_OUTPUT "log-output"
+#define KEY_LOG_ROTATE_INTERVAL "log-rotate-interval"
 #define KEY_LOGIN_SHELL "login-shell"
 #define KEY_PALETTE "palette"
 #define KEY_SCROLL_BACKGROUND "scroll-background"
@@ -146,6 +156,11 @@ enum
 #define DEFAULT_EXIT_ACTION           (TERMINAL_EXIT_CLOSE)
 #define DEFAULT_FONT                  ("Monospace 12")
 #define DEFAULT_FOREGROUND_COLOR      ("#000000")
+#define DEFAULT_LOG_COMPRESS          (FALSE)
+#define DEFAULT_LOG_DIRECTORY         ("")
+#define DEFAULT_LOG_MAX_SIZE          (16)
+#define DEFAULT_LOG_OUTPUT            (FALSE)
+#define DEFAULT_LOG_ROTATE_INTERVAL   (24)
 #define DEFAULT_LOGIN_SHELL           (FALSE)
 #define DEFAULT_NAME                  (NULL)
 #define DEFAULT_PALETTE               (terminal_palettes[TERMINAL_PALETTE_TANGO])
@@ -168,21 +183,42 @@ enum
 #define DEFAULT_VISIBLE_NAME          (N_("Unnamed"))
 #define DEFAULT_WORD_CHARS            ("-A-Za-z0-9,./?%&#:_=+@~")
 
+/* Quiet period before pending changes are written to GSettings, in ms */
+#define SAVE_DELAY (250)
+
+/* The palette is kept out of the GValueArray; it is only boxed into a
+ * GValueArray of GdkRGBA at the GObject property boundary.
+ */
+typedef struct
+{
+	GdkRGBA colors[TERMINAL_PALETTE_SIZE];
+	guint stamp; /* incremented on every change */
+} TerminalPalette;
+
 struct _TerminalProfilePrivate
 {
 	GValueArray *properties;
+	TerminalPalette palette;
 	gboolean *locked;
 
 	GSettings *settings;
 	char *profile_dir;
 
 	GSList *dirty_pspecs;
-	guint save_idle_id;
+	guint save_timeout_id;
+	GSettings *changeset; /* delayed-apply, created on first save */
 
 	GParamSpec *gsettings_notification_pspec;
 
+	TerminalProfileConfig *config;
+
 	gboolean background_load_failed;
 
+	/* Cached result of terminal_profile_get_palette_is_builtin */
+	guint palette_builtin_stamp;
+	int palette_builtin;
+
+	guint locks_loaded : 1;
 	guint forgotten : 1;
 };
 
@@ -367,6 +403,9 @@ get_prop_value_from_prop_name (TerminalProfile *profile,
 	if (G_UNLIKELY (pspec->param_id == PROP_BACKGROUND_IMAGE))
 		ensure_pixbuf_property (profile, PROP_BACKGROUND_IMAGE_FILE, PROP_BACKGROUND_IMAGE, &priv->background_load_failed);
 
+	/* The palette isn't stored in the GValueArray; use terminal_profile_get_palette */
+	g_return_val_if_fail (pspec->param_id != PROP_PALETTE, NULL);
+
 	return g_value_array_get_nth (priv->properties, pspec->param_id);
 }
 
@@ -403,6 +442,169 @@ set_value_from_palette (GValue *ret_value,
 	g_value_take_boxed (ret_value, array);
 }
 
+/* Palette channels are stored quantized to the 16 bits per channel used in
+ * GSettings, so a palette read back from GSettings is bitwise identical to
+ * the one that was written.
+ */
+static inline double
+palette_channel_quantize (double value)
+{
+	return (double) (guint) (CLAMP (value, 0., 1.) * 65535. + .5) / 65535.;
+}
+
+static void
+palette_color_pack (GdkRGBA *dest,
+                    const GdkRGBA *color)
+{
+	dest->red = palette_channel_quantize (color->red);
+	dest->green = palette_channel_quantize (color->green);
+	dest->blue = palette_channel_quantize (color->blue);
+	dest->alpha = 1.;
+}
+
+static gboolean
+palette_color_parse (GdkRGBA *color,
+                     const char *str,
+                     gsize len)
+{
+	char buf[64];
+
+	/* Fast path for the #RGB .. #RRRRGGGGBBBB forms we write ourselves */
+	if (len >= 4 && str[0] == '#' && (len - 1) % 3 == 0 && (len - 1) / 3 <= 4)
+	{
+		guint n_digits = (len - 1) / 3;
+		guint channels[3];
+		guint c, i;
+
+		for (c = 0; c < 3; ++c)
+		{
+			channels[c] = 0;
+			for (i = 0; i < n_digits; ++i)
+			{
+				int digit = g_ascii_xdigit_value (str[1 + c * n_digits + i]);
+
+				if (digit < 0)
+					goto slow_path;
+
+				channels[c] = (channels[c] << 4) | digit;
+			}
+		}
+
+		color->red = (double) channels[0] / ((1U << (4 * n_digits)) - 1);
+		color->green = (double) channels[1] / ((1U << (4 * n_digits)) - 1);
+		color->blue = (double) channels[2] / ((1U << (4 * n_digits)) - 1);
+		color->alpha = 1.;
+		return TRUE;
+	}
+
+slow_path:
+	if (len >= sizeof (buf))
+		return FALSE;
+
+	memcpy (buf, str, len);
+	buf[len] = '\0';
+	return gdk_rgba_parse (color, buf);
+}
+
+static void
+terminal_palette_init_from_colors (TerminalPalette *palette,
+                                   const GdkRGBA *colors,
+                                   guint n_colors)
+{
+	guint i;
+
+	for (i = 0; i < TERMINAL_PALETTE_SIZE; ++i)
+		palette_color_pack (&palette->colors[i], i < n_colors ? &colors[i] : &DEFAULT_PALETTE[i]);
+	palette->stamp = 0;
+}
+
+static void
+terminal_palette_init_from_value (TerminalPalette *palette,
+                                  const GValue *value)
+{
+	GValueArray *array;
+	guint i;
+
+	terminal_palette_init_from_colors (palette, DEFAULT_PALETTE, TERMINAL_PALETTE_SIZE);
+
+	array = g_value_get_boxed (value);
+	if (!array)
+		return;
+
+	for (i = 0; i < MIN (array->n_values, TERMINAL_PALETTE_SIZE); ++i)
+	{
+		const GdkRGBA *color = g_value_get_boxed (g_value_array_get_nth (array, i));
+
+		if (color)
+			palette_color_pack (&palette->colors[i], color);
+	}
+}
+
+/* Parses the colon separated GSettings representation. We continue even with
+ * a palette size != TERMINAL_PALETTE_SIZE, so we can change the palette size
+ * in future versions without causing too many issues; missing or invalid
+ * entries are taken from the default palette.
+ */
+static void
+terminal_palette_init_from_string (TerminalPalette *palette,
+                                   const char *str)
+{
+	guint i;
+
+	terminal_palette_init_from_colors (palette, DEFAULT_PALETTE, TERMINAL_PALETTE_SIZE);
+
+	for (i = 0; i < TERMINAL_PALETTE_SIZE && str != NULL; ++i)
+	{
+		const char *end = strchr (str, ':');
+		GdkRGBA color;
+
+		if (palette_color_parse (&color, str, end ? (gsize) (end - str) : strlen (str)))
+			palette_color_pack (&palette->colors[i], &color);
+
+		str = end ? end + 1 : NULL;
+	}
+}
+
+static char *
+terminal_palette_to_string (const TerminalPalette *palette)
+{
+	/* "#RRRRGGGGBBBB" per colour, plus separators and the terminating NUL */
+	const gsize size = TERMINAL_PALETTE_SIZE * (1 + 3 * 4 + 1);
+	char *str;
+	gsize len;
+	guint i;
+
+	str = g_malloc (size);
+	for (i = 0, len = 0; i < TERMINAL_PALETTE_SIZE; ++i)
+	{
+		const GdkRGBA *color = &palette->colors[i];
+
+		len += g_snprintf (str + len, size - len, "%s#%04X%04X%04X",
+		                i > 0 ? ":" : "",
+		                (guint) (color->red * 65535. + .5),
+		                (guint) (color->green * 65535. + .5),
+		                (guint) (color->blue * 65535. + .5));
+	}
+
+	return str;
+}
+
+/* Returns whether the profile's palette changed */
+static gboolean
+terminal_profile_set_palette_internal (TerminalProfile *profile,
+                                       const TerminalPalette *palette)
+{
+	TerminalProfilePrivate *priv = profile->priv;
+
+	if (memcmp (priv->palette.colors, palette->colors, sizeof (palette->colors)) == 0)
+		return FALSE;
+
+	memcpy (priv->palette.colors, palette->colors, sizeof (palette->colors));
+	priv->palette.stamp++;
+
+	return TRUE;
+}
+
 static int
 values_equal (GParamSpec *pspec,
               const GValue *va,
@@ -425,26 +627,6 @@ values_equal (GParamSpec *pspec,
 	if (G_PARAM_SPEC_VALUE_TYPE (pspec) == PANGO_TYPE_FONT_DESCRIPTION)
 		return pango_font_description_equal (g_value_get_boxed (va), g_value_get_boxed (vb));
 
-	if (G_IS_PARAM_SPEC_VALUE_ARRAY (pspec) &&
-	        G_PARAM_SPEC_VALUE_TYPE (G_PARAM_SPEC_VALUE_ARRAY (pspec)->element_spec) == GDK_TYPE_RGBA)
-	{
-		GValueArray *ara, *arb;
-		guint i;
-
-		ara = g_value_get_boxed (va);
-		arb = g_value_get_boxed (vb);
-
-		if (!ara || !arb || ara->n_values != arb->n_values)
-			return FALSE;
-
-		for (i = 0; i < ara->n_values; ++i)
-			if (!rgba_equal (g_value_get_boxed (g_value_array_get_nth (ara, i)),
-			                      g_value_get_boxed (g_value_array_get_nth (arb, i))))
-				return FALSE;
-
-		return TRUE;
-	}
-
 	return FALSE;
 }
 
@@ -546,6 +728,14 @@ terminal_profile_reset_property_internal (TerminalProfile *profile,
 			break;
 
 		case PROP_PALETTE:
+			if (!notify)
+			{
+				TerminalPalette palette;
+
+				terminal_palette_init_from_colors (&palette, DEFAULT_PALETTE, TERMINAL_PALETTE_SIZE);
+				terminal_profile_set_palette_internal (profile, &palette);
+				return;
+			}
 			set_value_from_palette (value, DEFAULT_PALETTE, TERMINAL_PALETTE_SIZE);
 			break;
 
@@ -561,132 +751,141 @@ terminal_profile_reset_property_internal (TerminalProfile *profile,
 	}
 }
 
-static void
-terminal_profile_gsettings_notify_cb (GSettings *settings,
-                                      gchar *key,
-                                      gpointer     user_data)
+/* Converts the GSettings value of @key into @value, which must be initialised
+ * to the value type of @pspec. The palette is handled separately, see
+ * terminal_palette_init_from_string. Returns FALSE if the value is unusable.
+ */
+static gboolean
+terminal_profile_value_from_settings (GSettings *settings,
+                                      const char *key,
+                                      GParamSpec *pspec,
+                                      GVariant *settings_value,
+                                      GValue *value)
 {
-	TerminalProfile *profile = TERMINAL_PROFILE (user_data);
-	TerminalProfilePrivate *priv = profile->priv;
-	TerminalProfileClass *klass;
-	GVariant *settings_value;
-	GParamSpec *pspec;
-	GValue value = { 0, };
-	gboolean equal;
-	gboolean force_set = FALSE;
-
-	if (!key) return;
-
-	_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
-	                       "GSettings notification for key %s [%s]\n",
-	                       key,
-	                       g_settings_is_writable (settings, key) ? "writable" : "LOCKED");
-
-	klass = TERMINAL_PROFILE_GET_CLASS (profile);
-	pspec = g_hash_table_lookup (klass->gsettings_keys, key);
-	if (!pspec)
-		return; /* ignore unknown keys, for future extensibility */
-
-	priv->locked[pspec->param_id] = !g_settings_is_writable (settings, key);
-
-	settings_value = g_settings_get_value (settings, key);
-	if (!settings_value)
-		return;
-
-	g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (pspec));
-
 	if (G_IS_PARAM_SPEC_BOOLEAN (pspec))
 	{
 		if (!g_variant_is_of_type (settings_value, G_VARIANT_TYPE_BOOLEAN))
-			goto out;
+			return FALSE;
 
-		g_value_set_boolean (&value, g_variant_get_boolean (settings_value));
+		g_value_set_boolean (value, g_variant_get_boolean (settings_value));
 	}
 	else if (G_IS_PARAM_SPEC_STRING (pspec))
 	{
 		if (!g_variant_is_of_type (settings_value, G_VARIANT_TYPE_STRING))
-			goto out;
+			return FALSE;
 
-		g_value_set_string (&value, g_variant_get_string (settings_value, NULL));
+		g_value_set_string (value, g_variant_get_string (settings_value, NULL));
 	}
 	else if (G_IS_PARAM_SPEC_ENUM (pspec))
 	{
 
 		if (!g_variant_is_of_type (settings_value, G_VARIANT_TYPE_STRING))
-			goto out;
+			return FALSE;
 
-		g_value_set_enum (&value, g_settings_get_enum (settings, key));
+		g_value_set_enum (value, g_settings_get_enum (settings, key));
 	}
 	else if (G_PARAM_SPEC_VALUE_TYPE (pspec) == GDK_TYPE_RGBA)
 	{
 		GdkRGBA color;
 
 		if (!g_variant_is_of_type (settings_value, G_VARIANT_TYPE_STRING))
-			goto out;
+			return FALSE;
 
 		if (!gdk_rgba_parse (&color, g_variant_get_string (settings_value, NULL)))
-			goto out;
+			return FALSE;
 
-		g_value_set_boxed (&value, &color);
+		g_value_set_boxed (value, &color);
 	}
 	else if (G_PARAM_SPEC_VALUE_TYPE (pspec) == PANGO_TYPE_FONT_DESCRIPTION)
 	{
 		if (!g_variant_is_of_type (settings_value, G_VARIANT_TYPE_STRING))
-			goto out;
+			return FALSE;
 
-		g_value_take_boxed (&value, pango_font_description_from_string (g_variant_get_string (settings_value, NULL)));
+		g_value_take_boxed (value, pango_font_description_from_string (g_variant_get_string (settings_value, NULL)));
 	}
 	else if (G_IS_PARAM_SPEC_DOUBLE (pspec))
 	{
 		if (!g_variant_is_of_type (settings_value, G_VARIANT_TYPE_DOUBLE))
-			goto out;
+			return FALSE;
 
-		g_value_set_double (&value, g_variant_get_double (settings_value));
+		g_value_set_double (value, g_variant_get_double (settings_value));
 	}
 	else if (G_IS_PARAM_SPEC_INT (pspec))
 	{
 		if (!g_variant_is_of_type (settings_value, G_VARIANT_TYPE_INT16) &&
 		    !g_variant_is_of_type (settings_value, G_VARIANT_TYPE_INT32) &&
 		    !g_variant_is_of_type (settings_value, G_VARIANT_TYPE_INT64))
-			goto out;
+			return FALSE;
 
-		g_value_set_int (&value, g_settings_get_int(settings, key));
+		g_value_set_int (value, g_settings_get_int(settings, key));
 	}
-	else if (G_IS_PARAM_SPEC_VALUE_ARRAY (pspec) &&
-	         G_PARAM_SPEC_VALUE_TYPE (G_PARAM_SPEC_VALUE_ARRAY (pspec)->element_spec) == GDK_TYPE_RGBA)
+	else
 	{
-		char **color_strings;
-		GdkRGBA *colors;
-		int n_colors, i;
+		g_printerr ("Unhandled value type %s of pspec %s\n", g_type_name (G_PARAM_SPEC_VALUE_TYPE (pspec)), pspec->name);
+		return FALSE;
+	}
 
-		if (!g_variant_is_of_type (settings_value, G_VARIANT_TYPE_STRING))
-			goto out;
+	return TRUE;
+}
+
+static void
+terminal_profile_gsettings_notify_cb (GSettings *settings,
+                                      gchar *key,
+                                      gpointer     user_data)
+{
+	TerminalProfile *profile = TERMINAL_PROFILE (user_data);
+	TerminalProfilePrivate *priv = profile->priv;
+	TerminalProfileClass *klass;
+	GVariant *settings_value;
+	GParamSpec *pspec;
+	GValue value = { 0, };
+	gboolean equal;
+	gboolean force_set = FALSE;
+
+	if (!key) return;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+	                       "GSettings notification for key %s [%s]\n",
+	                       key,
+	                       g_settings_is_writable (settings, key) ? "writable" : "LOCKED");
 
-		color_strings = g_strsplit (g_variant_get_string (settings_value, NULL), ":", -1);
-		if (!color_strings)
-			goto out;
+	klass = TERMINAL_PROFILE_GET_CLASS (profile);
+	pspec = g_hash_table_lookup (klass->gsettings_keys, key);
+	if (!pspec)
+		return; /* ignore unknown keys, for future extensibility */
+
+	priv->locked[pspec->param_id] = !g_settings_is_writable (settings, key);
+
+	settings_value = g_settings_get_value (settings, key);
+	if (!settings_value)
+		return;
+
+	if (pspec->param_id == PROP_PALETTE)
+	{
+		TerminalPalette palette;
 
-		n_colors = g_strv_length (color_strings);
-		colors = g_new0 (GdkRGBA, n_colors);
-		for (i = 0; i < n_colors; ++i)
+		/* Parsed straight into the packed representation, bypassing the
+		 * GValue round trip; only notify if it actually changed.
+		 */
+		if (g_variant_is_of_type (settings_value, G_VARIANT_TYPE_STRING))
 		{
-			if (!gdk_rgba_parse (&colors[i], color_strings[i]))
-				continue; /* ignore errors */
+			terminal_palette_init_from_string (&palette, g_variant_get_string (settings_value, NULL));
+			if (terminal_profile_set_palette_internal (profile, &palette))
+			{
+				priv->gsettings_notification_pspec = pspec;
+				g_object_notify_by_pspec (G_OBJECT (profile), pspec);
+				priv->gsettings_notification_pspec = NULL;
+			}
 		}
-		g_strfreev (color_strings);
 
-		/* We continue even with a palette size != TERMINAL_PALETTE_SIZE,
-		 * so we can change the palette size in future versions without
-		 * causing too many issues.
-		 */
-		set_value_from_palette (&value, colors, n_colors);
-		g_free (colors);
+		g_variant_unref (settings_value);
+		return;
 	}
-	else
-	{
-		g_printerr ("Unhandled value type %s of pspec %s\n", g_type_name (G_PARAM_SPEC_VALUE_TYPE (pspec)), pspec->name);
+
+	g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (pspec));
+
+	if (!terminal_profile_value_from_settings (settings, key, pspec, settings_value, &value))
 		goto out;
-	}
 
 	if (g_param_value_validate (pspec, &value))
 	{
@@ -731,6 +930,100 @@ out:
 	g_variant_unref (settings_value);
 }
 
+/* Loads all properties that were not set as construction params from GSettings
+ * in one pass. Unlike going through terminal_profile_gsettings_notify_cb for
+ * each key, the values are stored directly without emitting notifications, and
+ * key writability is only looked up once someone asks for it, see
+ * terminal_profile_property_locked.
+ */
+static void
+terminal_profile_load (TerminalProfile *profile,
+                       guint n_construct_properties,
+                       GObjectConstructParam *construct_params)
+{
+	TerminalProfilePrivate *priv = profile->priv;
+	GParamSpec **pspecs;
+	guint n_pspecs, i;
+
+	pspecs = g_object_class_list_properties (G_OBJECT_CLASS (TERMINAL_PROFILE_GET_CLASS (profile)), &n_pspecs);
+	for (i = 0; i < n_pspecs; ++i)
+	{
+		GParamSpec *pspec = pspecs[i];
+		GVariant *settings_value;
+		GValue value = { 0, };
+		guint j;
+		gboolean is_construct = FALSE;
+		char *key;
+
+		if (pspec->owner_type != TERMINAL_TYPE_PROFILE)
+			continue;
+
+		if ((pspec->flags & G_PARAM_WRITABLE) == 0 ||
+		        (pspec->flags & G_PARAM_CONSTRUCT_ONLY) != 0)
+			continue;
+
+		for (j = 0; j < n_construct_properties; ++j)
+			if (pspec == construct_params[j].pspec)
+			{
+				is_construct = TRUE;
+				break;
+			}
+
+		if (is_construct)
+			continue;
+
+		key = g_param_spec_get_qdata (pspec, gsettings_key_quark);
+		if (!key)
+			continue;
+
+		settings_value = g_settings_get_value (priv->settings, key);
+		if (!settings_value)
+			continue;
+
+		if (pspec->param_id == PROP_PALETTE)
+		{
+			TerminalPalette palette;
+
+			if (g_variant_is_of_type (settings_value, G_VARIANT_TYPE_STRING))
+			{
+				terminal_palette_init_from_string (&palette, g_variant_get_string (settings_value, NULL));
+				terminal_profile_set_palette_internal (profile, &palette);
+			}
+		}
+		else
+		{
+			g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (pspec));
+
+			if (terminal_profile_value_from_settings (priv->settings, key, pspec, settings_value, &value))
+			{
+				g_param_value_validate (pspec, &value);
+				g_value_copy (&value, g_value_array_get_nth (priv->properties, pspec->param_id));
+			}
+
+			g_value_unset (&value);
+		}
+
+		g_variant_unref (settings_value);
+	}
+
+	g_free (pspecs);
+}
+
+static void
+terminal_profile_load_locks (TerminalProfile *profile)
+{
+	TerminalProfilePrivate *priv = profile->priv;
+	TerminalProfileClass *klass = TERMINAL_PROFILE_GET_CLASS (profile);
+	GHashTableIter iter;
+	gpointer key, pspec;
+
+	g_hash_table_iter_init (&iter, klass->gsettings_keys);
+	while (g_hash_table_iter_next (&iter, &key, &pspec))
+		priv->locked[((GParamSpec *) pspec)->param_id] = !g_settings_is_writable (priv->settings, key);
+
+	priv->locks_loaded = TRUE;
+}
+
 static void
 terminal_profile_gsettings_changeset_add (TerminalProfile *profile,
         GSettings *changeset,
@@ -753,6 +1046,21 @@ terminal_profile_gsettings_changeset_add (TerminalProfile *profile,
 	if (!key)
 		return;
 
+	if (pspec->param_id == PROP_PALETTE)
+	{
+		char *str;
+
+		str = terminal_palette_to_string (&priv->palette);
+
+		_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+		                       "Adding pspec %s with value %s to the GSettings changeset\n",
+		                       pspec->name, str);
+
+		g_settings_set_string (changeset, key, str);
+		g_free (str);
+		return;
+	}
+
 	value = g_value_array_get_nth (priv->properties, pspec->param_id);
 
 	_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
@@ -810,44 +1118,6 @@ terminal_profile_gsettings_changeset_add (TerminalProfile *profile,
 		g_settings_set_double (changeset, key, g_value_get_double (value));
 	else if (G_IS_PARAM_SPEC_INT (pspec))
 		g_settings_set_int (changeset, key, g_value_get_int (value));
-	else if (G_IS_PARAM_SPEC_VALUE_ARRAY (pspec) &&
-	         G_PARAM_SPEC_VALUE_TYPE (G_PARAM_SPEC_VALUE_ARRAY (pspec)->element_spec) == GDK_TYPE_RGBA)
-	{
-		GValueArray *array;
-		GString *string;
-		guint n_colors, i;
-
-		/* We need to do this ourselves, because the gtk_color_selection_palette_to_string
-		 * does not carry all the bytes, and xterm's palette is messed up...
-		 */
-
-		array = g_value_get_boxed (value);
-		if (!array)
-			goto cleanup;
-
-		n_colors = array->n_values;
-		string = g_string_sized_new (n_colors * (1 /* # */ + 3 * 4) + n_colors /* : separators and terminating \0 */);
-		for (i = 0; i < n_colors; ++i)
-		{
-			GdkRGBA *color;
-
-			if (i > 0)
-				g_string_append_c (string, ':');
-
-			color = g_value_get_boxed (g_value_array_get_nth (array, i));
-			if (!color)
-				continue;
-
-			g_string_append_printf (string,
-			                        "#%04X%04X%04X",
-			                        (guint) (color->red * 65535),
-			                        (guint) (color->green * 65535),
-			                        (guint) (color->blue * 65535));
-		}
-
-		g_settings_set_string (changeset, key, string->str);
-		g_string_free (string, TRUE);
-	}
 	else
 		g_printerr ("Unhandled value type %s of pspec %s\n", g_type_name (G_PARAM_SPEC_VALUE_TYPE (pspec)), pspec->name);
 
@@ -859,15 +1129,23 @@ static void
 terminal_profile_save (TerminalProfile *profile)
 {
 	TerminalProfilePrivate *priv = profile->priv;
-	GSettings *changeset;
 	GSList *l;
-	gchar *concat;
 
-	priv->save_idle_id = 0;
-	concat = g_strconcat (CONF_PROFILE_PREFIX, priv->profile_dir,"/", NULL);
-	changeset = g_settings_new_with_path (CONF_PROFILE_SCHEMA, concat);
-	g_free (concat);
-	g_settings_delay (changeset);
+	priv->save_timeout_id = 0;
+
+	if (priv->dirty_pspecs == NULL)
+		return;
+
+	/* Reuse the same delayed GSettings for every save */
+	if (priv->changeset == NULL)
+	{
+		gchar *concat;
+
+		concat = g_strconcat (CONF_PROFILE_PREFIX, priv->profile_dir,"/", NULL);
+		priv->changeset = g_settings_new_with_path (CONF_PROFILE_SCHEMA, concat);
+		g_free (concat);
+		g_settings_delay (priv->changeset);
+	}
 
 	for (l = priv->dirty_pspecs; l != NULL; l = l->next)
 	{
@@ -879,18 +1157,17 @@ terminal_profile_save (TerminalProfile *profile)
 		if ((pspec->flags & G_PARAM_WRITABLE) == 0)
 			continue;
 
-		terminal_profile_gsettings_changeset_add (profile, changeset, pspec);
+		terminal_profile_gsettings_changeset_add (profile, priv->changeset, pspec);
 	}
 
 	g_slist_free (priv->dirty_pspecs);
 	priv->dirty_pspecs = NULL;
 
-	g_settings_apply (changeset);
-	g_object_unref (changeset);
+	g_settings_apply (priv->changeset);
 }
 
 static gboolean
-terminal_profile_save_idle_cb (TerminalProfile *profile)
+terminal_profile_save_timeout_cb (TerminalProfile *profile)
 {
 	terminal_profile_save (profile);
 
@@ -909,10 +1186,13 @@ terminal_profile_schedule_save (TerminalProfile *profile,
 	if (!g_slist_find (priv->dirty_pspecs, pspec))
 		priv->dirty_pspecs = g_slist_prepend (priv->dirty_pspecs, pspec);
 
-	if (priv->save_idle_id != 0)
-		return;
+	/* Restart the timer, so that a continuous stream of changes (e.g. while
+	 * dragging a colour picker) results in a single write once it settles.
+	 */
+	if (priv->save_timeout_id != 0)
+		g_source_remove (priv->save_timeout_id);
 
-	priv->save_idle_id = g_idle_add ((GSourceFunc) terminal_profile_save_idle_cb, profile);
+	priv->save_timeout_id = g_timeout_add (SAVE_DELAY, (GSourceFunc) terminal_profile_save_timeout_cb, profile);
 }
 
 static void
@@ -967,8 +1247,6 @@ terminal_profile_constructor (GType type,
 	TerminalProfile *profile;
 	TerminalProfilePrivate *priv;
 	const char *name;
-	GParamSpec **pspecs;
-	guint n_pspecs, i;
 	gchar *concat;
 
 	object = G_OBJECT_CLASS (terminal_profile_parent_class)->constructor
@@ -993,39 +1271,7 @@ terminal_profile_constructor (GType type,
 	g_free (concat);
 
 	/* Now load those properties from GSettings that were not set as construction params */
-	pspecs = g_object_class_list_properties (G_OBJECT_CLASS (TERMINAL_PROFILE_GET_CLASS (profile)), &n_pspecs);
-	for (i = 0; i < n_pspecs; ++i)
-	{
-		GParamSpec *pspec = pspecs[i];
-		guint j;
-		gboolean is_construct = FALSE;
-		char *key;
-
-		if (pspec->owner_type != TERMINAL_TYPE_PROFILE)
-			continue;
-
-		if ((pspec->flags & G_PARAM_WRITABLE) == 0 ||
-		        (pspec->flags & G_PARAM_CONSTRUCT_ONLY) != 0)
-			continue;
-
-		for (j = 0; j < n_construct_properties; ++j)
-			if (pspec == construct_params[j].pspec)
-			{
-				is_construct = TRUE;
-				break;
-			}
-
-		if (is_construct)
-			continue;
-
-		key = g_param_spec_get_qdata (pspec, gsettings_key_quark);
-		if (!key)
-			continue;
-
-		terminal_profile_gsettings_notify_cb (priv->settings, key,  profile);
-	}
-
-	g_free (pspecs);
+	terminal_profile_load (profile, n_construct_properties, construct_params);
 
 	return object;
 }
@@ -1040,17 +1286,17 @@ terminal_profile_finalize (GObject *object)
 		G_CALLBACK(terminal_profile_gsettings_notify_cb),
 		profile);
 
-	if (priv->save_idle_id)
-	{
-		g_source_remove (priv->save_idle_id);
-
-		/* Save now */
-		terminal_profile_save (profile);
-	}
+	/* Save now */
+	terminal_profile_flush (profile);
 
 	_terminal_profile_forget (profile);
 
 	g_object_unref (priv->settings);
+	if (priv->changeset)
+		g_object_unref (priv->changeset);
+
+	if (priv->config)
+		terminal_profile_config_unref (priv->config);
 
 	g_free (priv->profile_dir);
 	g_free (priv->locked);
@@ -1080,6 +1326,9 @@ terminal_profile_get_property (GObject *object,
 	case PROP_BACKGROUND_IMAGE:
 		ensure_pixbuf_property (profile, PROP_BACKGROUND_IMAGE_FILE, PROP_BACKGROUND_IMAGE, &priv->background_load_failed);
 		break;
+	case PROP_PALETTE:
+		set_value_from_palette (value, priv->palette.colors, TERMINAL_PALETTE_SIZE);
+		return;
 	default:
 		break;
 	}
@@ -1127,6 +1376,14 @@ terminal_profile_set_property (GObject *object,
 		/* fall-through */
 	}
 #endif
+	case PROP_PALETTE:
+	{
+		TerminalPalette palette;
+
+		terminal_palette_init_from_value (&palette, value);
+		terminal_profile_set_palette_internal (profile, &palette);
+		break;
+	}
 	default:
 		g_value_copy (value, prop_value);
 		break;
@@ -1141,6 +1398,7 @@ terminal_profile_set_property (GObject *object,
 
 		g_assert (name != NULL);
 		priv->profile_dir = g_strdup (name);
+		g_clear_object (&priv->changeset);
 		if (priv->settings != NULL) {
 			gchar *concat;
 			g_signal_handlers_disconnect_by_func (priv->settings,
@@ -1183,6 +1441,13 @@ terminal_profile_notify (GObject *object,
 	                       "Property notification for prop %s\n",
 	                       pspec->name);
 
+	/* Recompiled on demand by the next terminal_profile_ref_config() */
+	if (priv->config && pspec->owner_type == TERMINAL_TYPE_PROFILE)
+	{
+		terminal_profile_config_unref (priv->config);
+		priv->config = NULL;
+	}
+
 	if (notify)
 		notify (object, pspec);
 
@@ -1301,6 +1566,8 @@ terminal_profile_class_init (TerminalProfileClass *klass)
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (ALLOW_BOLD, DEFAULT_ALLOW_BOLD, KEY_ALLOW_BOLD);
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (BOLD_COLOR_SAME_AS_FG, DEFAULT_BOLD_COLOR_SAME_AS_FG, KEY_BOLD_COLOR_SAME_AS_FG);
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (DEFAULT_SHOW_MENUBAR, DEFAULT_DEFAULT_SHOW_MENUBAR, KEY_DEFAULT_SHOW_MENUBAR);
+	TERMINAL_PROFILE_PROPERTY_BOOLEAN (LOG_COMPRESS, DEFAULT_LOG_COMPRESS, KEY_LOG_COMPRESS);
+	TERMINAL_PROFILE_PROPERTY_BOOLEAN (LOG_OUTPUT, DEFAULT_LOG_OUTPUT, KEY_LOG_OUTPUT);
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (LOGIN_SHELL, DEFAULT_LOGIN_SHELL, KEY_LOGIN_SHELL);
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (SCROLL_BACKGROUND, DEFAULT_SCROLL_BACKGROUND, KEY_SCROLL_BACKGROUND);
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (SCROLLBACK_UNLIMITED, DEFAULT_SCROLLBACK_UNLIMITED, KEY_SCROLLBACK_UNLIMITED);
@@ -1335,12 +1602,15 @@ terminal_profile_class_init (TerminalProfileClass *klass)
 	TERMINAL_PROFILE_PROPERTY_INT (DEFAULT_SIZE_COLUMNS, 1, 1024, DEFAULT_DEFAULT_SIZE_COLUMNS, KEY_DEFAULT_SIZE_COLUMNS);
 	TERMINAL_PROFILE_PROPERTY_INT (DEFAULT_SIZE_ROWS, 1, 1024, DEFAULT_DEFAULT_SIZE_ROWS, KEY_DEFAULT_SIZE_ROWS);
 	TERMINAL_PROFILE_PROPERTY_INT (SCROLLBACK_LINES, 1, G_MAXINT, DEFAULT_SCROLLBACK_LINES, KEY_SCROLLBACK_LINES);
+	TERMINAL_PROFILE_PROPERTY_INT (LOG_MAX_SIZE, 0, G_MAXINT, DEFAULT_LOG_MAX_SIZE, KEY_LOG_MAX_SIZE);
+	TERMINAL_PROFILE_PROPERTY_INT (LOG_ROTATE_INTERVAL, 0, G_MAXINT, DEFAULT_LOG_ROTATE_INTERVAL, KEY_LOG_ROTATE_INTERVAL);
 
 	TERMINAL_PROFILE_PROPERTY_OBJECT (BACKGROUND_IMAGE, GDK_TYPE_PIXBUF, NULL);
 
 	TERMINAL_PROFILE_PROPERTY_STRING_CO (NAME, DEFAULT_NAME, NULL);
 	TERMINAL_PROFILE_PROPERTY_STRING (BACKGROUND_IMAGE_FILE, DEFAULT_BACKGROUND_IMAGE_FILE, KEY_BACKGROUND_IMAGE_FILE);
 	TERMINAL_PROFILE_PROPERTY_STRING (CUSTOM_COMMAND, DEFAULT_CUSTOM_COMMAND, KEY_CUSTOM_COMMAND);
+	TERMINAL_PROFILE_PROPERTY_STRING (LOG_DIRECTORY, DEFAULT_LOG_DIRECTORY, KEY_LOG_DIRECTORY);
 	TERMINAL_PROFILE_PROPERTY_STRING (TITLE, _(DEFAULT_TITLE), KEY_TITLE);
 	TERMINAL_PROFILE_PROPERTY_STRING (VISIBLE_NAME, _(DEFAULT_VISIBLE_NAME), KEY_VISIBLE_NAME);
 	TERMINAL_PROFILE_PROPERTY_STRING (WORD_CHARS, DEFAULT_WORD_CHARS, KEY_WORD_CHARS);
@@ -1442,10 +1712,10 @@ _terminal_profile_clone (TerminalProfile *base_profile,
 
 	g_slist_free (new_priv->dirty_pspecs);
 	new_priv->dirty_pspecs = NULL;
-	if (new_priv->save_idle_id != 0)
+	if (new_priv->save_timeout_id != 0)
 	{
-		g_source_remove (new_priv->save_idle_id);
-		new_priv->save_idle_id = 0;
+		g_source_remove (new_priv->save_timeout_id);
+		new_priv->save_timeout_id = 0;
 	}
 
 	for (i = 0; i < n_pspecs; ++i)
@@ -1565,6 +1835,27 @@ terminal_profile_get_property_string (TerminalProfile *profile,
 	return g_value_get_string (value);
 }
 
+/**
+ * terminal_profile_flush:
+ * @profile: a #TerminalProfile
+ *
+ * Writes any changes still waiting for the save timeout to GSettings now.
+ */
+void
+terminal_profile_flush (TerminalProfile *profile)
+{
+	TerminalProfilePrivate *priv;
+
+	g_return_if_fail (TERMINAL_IS_PROFILE (profile));
+
+	priv = profile->priv;
+	if (priv->save_timeout_id == 0)
+		return;
+
+	g_source_remove (priv->save_timeout_id);
+	terminal_profile_save (profile);
+}
+
 gboolean
 terminal_profile_property_locked (TerminalProfile *profile,
                                   const char *prop_name)
@@ -1577,6 +1868,9 @@ terminal_profile_property_locked (TerminalProfile *profile,
 	if (!pspec)
 		return FALSE;
 
+	if (!priv->locks_loaded)
+		terminal_profile_load_locks (profile);
+
 	return priv->locked[pspec->param_id];
 }
 
@@ -1601,26 +1895,15 @@ terminal_profile_get_palette (TerminalProfile *profile,
                               guint *n_colors)
 {
 	TerminalProfilePrivate *priv;
-	GValueArray *array;
-	guint i, n;
+	guint n;
 
 	g_return_val_if_fail (TERMINAL_IS_PROFILE (profile), FALSE);
 	g_return_val_if_fail (colors != NULL && n_colors != NULL, FALSE);
 
 	priv = profile->priv;
-	array = g_value_get_boxed (g_value_array_get_nth (priv->properties, PROP_PALETTE));
-	if (!array)
-		return FALSE;
 
-	n = MIN (array->n_values, *n_colors);
-	for (i = 0; i < n; ++i)
-	{
-		GdkRGBA *color = g_value_get_boxed (g_value_array_get_nth (array, i));
-		if (!color)
-			continue; /* shouldn't happen!! */
-
-		colors[i] = *color;
-	}
+	n = MIN (TERMINAL_PALETTE_SIZE, *n_colors);
+	memcpy (colors, priv->palette.colors, n * sizeof (GdkRGBA));
 
 	*n_colors = n;
 	return TRUE;
@@ -1630,37 +1913,40 @@ gboolean
 terminal_profile_get_palette_is_builtin (TerminalProfile *profile,
         guint *n)
 {
-	GdkRGBA colors[TERMINAL_PALETTE_SIZE];
-	guint n_colors;
+	TerminalProfilePrivate *priv = profile->priv;
 	guint i;
 
-	n_colors = G_N_ELEMENTS (colors);
-	if (!terminal_profile_get_palette (profile, colors, &n_colors) ||
-	        n_colors != TERMINAL_PALETTE_SIZE)
-		return FALSE;
+	if (priv->palette_builtin_stamp != priv->palette.stamp)
+	{
+		priv->palette_builtin_stamp = priv->palette.stamp;
+		priv->palette_builtin = -1;
 
-	for (i = 0; i < TERMINAL_PALETTE_N_BUILTINS; ++i)
-		if (palette_cmp (colors, terminal_palettes[i]))
-		{
-			*n = i;
-			return TRUE;
-		}
+		for (i = 0; i < TERMINAL_PALETTE_N_BUILTINS; ++i)
+			if (palette_cmp (priv->palette.colors, terminal_palettes[i]))
+			{
+				priv->palette_builtin = i;
+				break;
+			}
+	}
 
-	return FALSE;
+	if (priv->palette_builtin < 0)
+		return FALSE;
+
+	*n = priv->palette_builtin;
+	return TRUE;
 }
 
 void
 terminal_profile_set_palette_builtin (TerminalProfile *profile,
                                       guint n)
 {
-	GValue value = { 0, };
+	TerminalPalette palette;
 
 	g_return_if_fail (n < TERMINAL_PALETTE_N_BUILTINS);
 
-	g_value_init (&value, G_TYPE_VALUE_ARRAY);
-	set_value_from_palette (&value, terminal_palettes[n], TERMINAL_PALETTE_SIZE);
-	g_object_set_property (G_OBJECT (profile), TERMINAL_PROFILE_PALETTE, &value);
-	g_value_unset (&value);
+	terminal_palette_init_from_colors (&palette, terminal_palettes[n], TERMINAL_PALETTE_SIZE);
+	if (terminal_profile_set_palette_internal (profile, &palette))
+		g_object_notify (G_OBJECT (profile), TERMINAL_PROFILE_PALETTE);
 }
 
 gboolean
@@ -1669,23 +1955,110 @@ terminal_profile_modify_palette_entry (TerminalProfile *profile,
                                        const GdkRGBA   *color)
 {
 	TerminalProfilePrivate *priv = profile->priv;
-	GValueArray *array;
-	GValue *value;
-	GdkRGBA *old_color;
+	TerminalPalette palette;
 
-	array = g_value_get_boxed (g_value_array_get_nth (priv->properties, PROP_PALETTE));
-	if (!array ||
-	        i >= array->n_values)
+	if (i >= TERMINAL_PALETTE_SIZE)
 		return FALSE;
 
-	value = g_value_array_get_nth (array, i);
-	old_color = g_value_get_boxed (value);
-	if (!old_color ||
-	        !rgba_equal (old_color, color))
-	{
-		g_value_set_boxed (value, color);
+	palette = priv->palette;
+	palette_color_pack (&palette.colors[i], color);
+	if (terminal_profile_set_palette_internal (profile, &palette))
 		g_object_notify (G_OBJECT (profile), TERMINAL_PROFILE_PALETTE);
-	}
 
 	return TRUE;
 }
+
+static TerminalProfileConfig *
+terminal_profile_compile_config (TerminalProfile *profile)
+{
+	TerminalProfilePrivate *priv = profile->priv;
+	TerminalProfileConfig *config;
+	const GdkRGBA *color;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+	                       "Compiling config for profile %s\n",
+	                       terminal_profile_get_property_string (profile, TERMINAL_PROFILE_NAME));
+
+	config = g_slice_new0 (TerminalProfileConfig);
+	config->refcount = 1;
+
+	config->use_theme_colors = g_value_get_boolean (g_value_array_get_nth (priv->properties, PROP_USE_THEME_COLORS)) != FALSE;
+	config->use_bold_color = !g_value_get_boolean (g_value_array_get_nth (priv->properties, PROP_BOLD_COLOR_SAME_AS_FG));
+	config->use_system_font = g_value_get_boolean (g_value_array_get_nth (priv->properties, PROP_USE_SYSTEM_FONT)) != FALSE;
+
+	if ((color = g_value_get_boxed (g_value_array_get_nth (priv->properties, PROP_FOREGROUND_COLOR))))
+		config->foreground = *color;
+	if ((color = g_value_get_boxed (g_value_array_get_nth (priv->properties, PROP_BACKGROUND_COLOR))))
+		config->background = *color;
+	if ((color = g_value_get_boxed (g_value_array_get_nth (priv->properties, PROP_BOLD_COLOR))))
+		config->bold = *color;
+	else
+		config->use_bold_color = FALSE;
+
+	memcpy (config->palette, priv->palette.colors, sizeof (config->palette));
+	config->n_palette = TERMINAL_PALETTE_SIZE;
+
+	config->background_type = g_value_get_enum (g_value_array_get_nth (priv->properties, PROP_BACKGROUND_TYPE));
+	switch (config->background_type)
+	{
+	case TERMINAL_BACKGROUND_TRANSPARENT:
+		config->background_alpha = g_value_get_double (g_value_array_get_nth (priv->properties, PROP_BACKGROUND_DARKNESS));
+		break;
+	case TERMINAL_BACKGROUND_IMAGE:
+		config->background_alpha = 0.0;
+		ensure_pixbuf_property (profile, PROP_BACKGROUND_IMAGE_FILE, PROP_BACKGROUND_IMAGE, &priv->background_load_failed);
+		config->background_image = g_value_dup_object (g_value_array_get_nth (priv->properties, PROP_BACKGROUND_IMAGE));
+		break;
+	default:
+		config->background_alpha = 1.0;
+		break;
+	}
+
+	if (!config->use_system_font)
+		config->font = pango_font_description_copy (g_value_get_boxed (g_value_array_get_nth (priv->properties, PROP_FONT)));
+
+	return config;
+}
+
+/**
+ * terminal_profile_ref_config:
+ * @profile: a #TerminalProfile
+ *
+ * Returns: (transfer full): the current #TerminalProfileConfig of @profile.
+ *   It is computed at most once per profile change, and must not be modified.
+ */
+TerminalProfileConfig *
+terminal_profile_ref_config (TerminalProfile *profile)
+{
+	TerminalProfilePrivate *priv;
+
+	g_return_val_if_fail (TERMINAL_IS_PROFILE (profile), NULL);
+
+	priv = profile->priv;
+	if (!priv->config)
+		priv->config = terminal_profile_compile_config (profile);
+
+	return terminal_profile_config_ref (priv->config);
+}
+
+TerminalProfileConfig *
+terminal_profile_config_ref (TerminalProfileConfig *config)
+{
+	g_return_val_if_fail (config != NULL, NULL);
+
+	config->refcount++;
+	return config;
+}
+
+void
+terminal_profile_config_unref (TerminalProfileConfig *config)
+{
+	if (--config->refcount > 0)
+		return;
+
+	if (config->background_image)
+		g_object_unref (config->background_image);
+	if (config->font)
+		pango_font_description_free (config->font);
+	g_slice_free (TerminalProfileConfig, config);
+}
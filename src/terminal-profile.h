@@ -86,6 +86,11 @@ typedef enum
 #define TERMINAL_PROFILE_EXIT_ACTION            "exit-action"
 #define TERMINAL_PROFILE_FONT                   "font"
 #define TERMINAL_PROFILE_FOREGROUND_COLOR       "foreground-color"
+#define TERMINAL_PROFILE_LOG_COMPRESS           "log-compress"
+#define TERMINAL_PROFILE_LOG_DIRECTORY          "log-directory"
+#define TERMINAL_PROFILE_LOG_MAX_SIZE           "log-max-size"
+#define TERMINAL_PROFILE_LOG_OUTPUT             "log-output"
+#define TERMINAL_PROFILE_LOG_ROTATE_INTERVAL    "log-rotate-interval"
 #define TERMINAL_PROFILE_LOGIN_SHELL            "login-shell"
 #define TERMINAL_PROFILE_NAME                   "name"
 #define TERMINAL_PROFILE_PALETTE                "palette"
@@ -108,6 +113,30 @@ typedef enum
 #define TERMINAL_PROFILE_VISIBLE_NAME           "visible-name"
 #define TERMINAL_PROFILE_WORD_CHARS             "word-chars"
 
+/* Immutable snapshot of the appearance settings of a profile, computed
+ * once per change and shared by all screens using the profile.
+ */
+typedef struct
+{
+	int refcount;
+
+	guint use_theme_colors : 1;
+	guint use_bold_color   : 1;
+	guint use_system_font  : 1;
+
+	GdkRGBA foreground;
+	GdkRGBA background;
+	GdkRGBA bold;
+	GdkRGBA palette[TERMINAL_PALETTE_SIZE];
+	guint n_palette;
+
+	TerminalBackgroundType background_type;
+	double background_alpha;
+	GdkPixbuf *background_image; /* NULL unless background_type is TERMINAL_BACKGROUND_IMAGE */
+
+	PangoFontDescription *font; /* NULL when use_system_font is set */
+} TerminalProfileConfig;
+
 /* TerminalProfile object */
 
 #define TERMINAL_TYPE_PROFILE              (terminal_profile_get_type ())
@@ -148,6 +177,8 @@ gboolean         _terminal_profile_get_forgotten          (TerminalProfile *prof
 TerminalProfile* _terminal_profile_clone                  (TerminalProfile *base_profile,
         const char *visible_name);
 
+void              terminal_profile_flush                  (TerminalProfile *profile);
+
 gboolean          terminal_profile_property_locked        (TerminalProfile *profile,
         const char *prop_name);
 
@@ -189,6 +220,12 @@ gboolean          terminal_profile_modify_palette_entry   (TerminalProfile *prof
         guint            i,
         const GdkRGBA  *color);
 
+TerminalProfileConfig *terminal_profile_ref_config       (TerminalProfile *profile);
+
+TerminalProfileConfig *terminal_profile_config_ref       (TerminalProfileConfig *config);
+
+void              terminal_profile_config_unref           (TerminalProfileConfig *config);
+
 G_END_DECLS
 
 #endif /* TERMINAL_PROFILE_H */
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "terminal-intl.h"
+#include "terminal-save-contents.h"
+#include "terminal-util.h"
+
+/* vte_terminal_write_contents_sync() blocks until the whole scrollback is
+ * on disk, which freezes every window of the process for a big one.
+ * Instead the text is fetched a few rows at a time and each chunk is
+ * written asynchronously before the next one is fetched, so the main loop
+ * keeps running in between.
+ *
+ * The rows to save are fixed when the file has been opened; output that
+ * arrives afterwards isn't saved, and rows that scroll out of the history
+ * before they are reached are skipped.
+ *
+ * For HTML and ANSI, the text is fetched with its attributes and handed
+ * to a TerminalContentsFormatter.
+ */
+#define CHUNK_ROWS (1024)
+
+typedef struct
+{
+	VteTerminal *terminal;
+	GFile *file;
+	gboolean compress;
+	GtkWindow *parent; /* weak */
+	TerminalContentsFormatter *formatter;
+
+	GCancellable *cancellable;
+	GOutputStream *stream;
+	char *chunk; /* the text being written */
+	GArray *attributes; /* NULL for plain text */
+	gboolean footer_written;
+
+	glong first_row;
+	glong end_row;
+	glong row;
+
+	GtkWidget *dialog;
+	GtkWidget *progress_bar;
+	gulong terminal_destroy_id;
+} SaveContentsJob;
+
+static void save_contents_write_next_chunk (SaveContentsJob *job);
+static void save_contents_write_cb (GObject      *source,
+                                    GAsyncResult *result,
+                                    gpointer      user_data);
+
+static void
+save_contents_job_finish (SaveContentsJob *job,
+                          GError          *error)
+{
+	if (job->stream != NULL)
+	{
+		/* Closing with the cancellable cancelled drops what was written
+		 * and leaves any existing file untouched.
+		 */
+		if (error != NULL)
+			g_cancellable_cancel (job->cancellable);
+
+		g_output_stream_close (job->stream, job->cancellable, NULL);
+		g_object_unref (job->stream);
+	}
+
+	if (error != NULL &&
+	        !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		terminal_util_show_error_dialog (job->parent, NULL, error,
+		                                 "%s", _("Could not save contents"));
+
+	if (job->dialog != NULL)
+	{
+		g_signal_handlers_disconnect_matched (job->dialog, G_SIGNAL_MATCH_DATA,
+		                                      0, 0, NULL, NULL, job);
+		gtk_widget_destroy (job->dialog);
+	}
+
+	if (job->parent != NULL)
+		g_object_remove_weak_pointer (G_OBJECT (job->parent), (gpointer *) &job->parent);
+
+	g_signal_handler_disconnect (job->terminal, job->terminal_destroy_id);
+	g_object_unref (job->terminal);
+	g_object_unref (job->file);
+	g_object_unref (job->cancellable);
+	g_free (job->chunk);
+	if (job->attributes != NULL)
+		g_array_free (job->attributes, TRUE);
+	terminal_contents_formatter_free (job->formatter);
+	g_slice_free (SaveContentsJob, job);
+}
+
+static void
+save_contents_close_cb (GObject      *source,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+	SaveContentsJob *job = user_data;
+	GError *error = NULL;
+
+	g_output_stream_close_finish (G_OUTPUT_STREAM (source), result, &error);
+
+	g_clear_object (&job->stream);
+	save_contents_job_finish (job, error);
+
+	if (error)
+		g_error_free (error);
+}
+
+static void
+save_contents_write_cb (GObject      *source,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+	SaveContentsJob *job = user_data;
+	GError *error = NULL;
+
+	g_clear_pointer (&job->chunk, g_free);
+
+	if (!g_output_stream_write_all_finish (G_OUTPUT_STREAM (source), result, NULL, &error))
+	{
+		save_contents_job_finish (job, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (job->dialog != NULL && job->end_row > job->first_row)
+		gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (job->progress_bar),
+		                               (double) (job->row - job->first_row) /
+		                               (job->end_row - job->first_row));
+
+	save_contents_write_next_chunk (job);
+}
+
+static void
+save_contents_write_chunk (SaveContentsJob *job)
+{
+	g_output_stream_write_all_async (job->stream,
+	                                 job->chunk, strlen (job->chunk),
+	                                 G_PRIORITY_DEFAULT,
+	                                 job->cancellable,
+	                                 save_contents_write_cb, job);
+}
+
+static void
+save_contents_write_next_chunk (SaveContentsJob *job)
+{
+	GtkAdjustment *adjustment;
+	glong last;
+
+	adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (job->terminal));
+	job->row = MAX (job->row, (glong) gtk_adjustment_get_lower (adjustment));
+
+	if (job->row >= job->end_row)
+	{
+		if (!job->footer_written)
+		{
+			job->footer_written = TRUE;
+			job->chunk = terminal_contents_formatter_get_footer (job->formatter);
+			if (job->chunk != NULL)
+			{
+				save_contents_write_chunk (job);
+				return;
+			}
+		}
+
+		g_output_stream_close_async (job->stream, G_PRIORITY_DEFAULT,
+		                             job->cancellable,
+		                             save_contents_close_cb, job);
+		return;
+	}
+
+	last = MIN (job->row + CHUNK_ROWS, job->end_row);
+	job->chunk = vte_terminal_get_text_range (job->terminal,
+	                                          job->row, 0,
+	                                          last - 1, vte_terminal_get_column_count (job->terminal) - 1,
+	                                          NULL, NULL, job->attributes);
+	job->row = last;
+
+	if (job->chunk == NULL)
+		job->chunk = g_strdup ("");
+	else
+		job->chunk = terminal_contents_formatter_format (job->formatter, job->chunk, job->attributes);
+
+	save_contents_write_chunk (job);
+}
+
+static void
+save_contents_replace_cb (GObject      *source,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+	SaveContentsJob *job = user_data;
+	GFileOutputStream *file_stream;
+	GtkAdjustment *adjustment;
+	GError *error = NULL;
+
+	file_stream = g_file_replace_finish (G_FILE (source), result, &error);
+	if (file_stream == NULL)
+	{
+		save_contents_job_finish (job, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (job->compress)
+	{
+		GZlibCompressor *compressor;
+
+		compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+		job->stream = g_converter_output_stream_new (G_OUTPUT_STREAM (file_stream),
+		                                             G_CONVERTER (compressor));
+		g_object_unref (compressor);
+		g_object_unref (file_stream);
+	}
+	else
+		job->stream = G_OUTPUT_STREAM (file_stream);
+
+	adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (job->terminal));
+	job->first_row = job->row = (glong) gtk_adjustment_get_lower (adjustment);
+	job->end_row = (glong) gtk_adjustment_get_upper (adjustment);
+
+	job->chunk = terminal_contents_formatter_get_header (job->formatter,
+	                                                     vte_terminal_get_window_title (job->terminal));
+	if (job->chunk != NULL)
+		save_contents_write_chunk (job);
+	else
+		save_contents_write_next_chunk (job);
+}
+
+static void
+save_contents_cancel (SaveContentsJob *job)
+{
+	/* The pending operation fails and finishes the job */
+	g_cancellable_cancel (job->cancellable);
+}
+
+static void
+save_contents_dialog_response_cb (GtkDialog       *dialog,
+                                  int              response,
+                                  SaveContentsJob *job)
+{
+	save_contents_cancel (job);
+}
+
+static void
+save_contents_dialog_destroy_cb (GtkWidget       *dialog,
+                                 SaveContentsJob *job)
+{
+	job->dialog = NULL;
+	save_contents_cancel (job);
+}
+
+/**
+ * terminal_save_contents:
+ * @terminal: the terminal whose scrollback to save
+ * @file: the file to save to
+ * @format: the format to save in
+ * @compress: whether to compress the file with gzip
+ * @foreground: (allow-none): the default foreground colour of @terminal
+ * @background: (allow-none): the default background colour of @terminal
+ * @parent: (allow-none): the window to show the progress and errors on
+ *
+ * Saves the text of @terminal to @file in the background, showing the
+ * progress in a dialog that also allows cancelling. If the save fails or
+ * is cancelled, an existing @file is left as it was.
+ */
+void
+terminal_save_contents (VteTerminal            *terminal,
+                        GFile                  *file,
+                        TerminalContentsFormat  format,
+                        gboolean                compress,
+                        const GdkRGBA          *foreground,
+                        const GdkRGBA          *background,
+                        GtkWindow              *parent)
+{
+	SaveContentsJob *job;
+	GtkWidget *content_area, *label;
+	char *name, *text;
+
+	g_return_if_fail (VTE_IS_TERMINAL (terminal));
+	g_return_if_fail (G_IS_FILE (file));
+
+	job = g_slice_new0 (SaveContentsJob);
+	job->terminal = g_object_ref (terminal);
+	job->file = g_object_ref (file);
+	job->compress = compress != FALSE;
+	job->cancellable = g_cancellable_new ();
+	job->formatter = terminal_contents_formatter_new (format, foreground, background);
+
+	if (format != TERMINAL_CONTENTS_FORMAT_TEXT)
+		job->attributes = g_array_new (FALSE, FALSE, sizeof (VteCharAttributes));
+
+	job->parent = parent;
+	if (parent != NULL)
+		g_object_add_weak_pointer (G_OBJECT (parent), (gpointer *) &job->parent);
+
+	/* Closing the tab while saving cancels the save */
+	job->terminal_destroy_id = g_signal_connect_swapped (terminal, "destroy",
+	                                                     G_CALLBACK (save_contents_cancel), job);
+
+	job->dialog = gtk_dialog_new_with_buttons (_("Saving Contents"),
+	                                           parent,
+	                                           GTK_DIALOG_DESTROY_WITH_PARENT,
+	                                           _("_Cancel"), GTK_RESPONSE_CANCEL,
+	                                           NULL);
+	gtk_window_set_resizable (GTK_WINDOW (job->dialog), FALSE);
+	gtk_container_set_border_width (GTK_CONTAINER (job->dialog), 5);
+
+	content_area = gtk_dialog_get_content_area (GTK_DIALOG (job->dialog));
+	gtk_box_set_spacing (GTK_BOX (content_area), 6);
+
+	name = g_file_get_parse_name (file);
+	text = g_strdup_printf (_("Saving to “%s”"), name);
+	label = gtk_label_new (text);
+	gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_MIDDLE);
+	gtk_label_set_max_width_chars (GTK_LABEL (label), 50);
+	gtk_widget_set_halign (label, GTK_ALIGN_START);
+	gtk_box_pack_start (GTK_BOX (content_area), label, FALSE, FALSE, 0);
+	g_free (text);
+	g_free (name);
+
+	job->progress_bar = gtk_progress_bar_new ();
+	gtk_progress_bar_set_show_text (GTK_PROGRESS_BAR (job->progress_bar), TRUE);
+	gtk_box_pack_start (GTK_BOX (content_area), job->progress_bar, FALSE, FALSE, 0);
+
+	g_signal_connect (job->dialog, "response",
+	                  G_CALLBACK (save_contents_dialog_response_cb), job);
+	g_signal_connect (job->dialog, "delete-event",
+	                  G_CALLBACK (terminal_util_dialog_response_on_delete), NULL);
+	g_signal_connect (job->dialog, "destroy",
+	                  G_CALLBACK (save_contents_dialog_destroy_cb), job);
+
+	gtk_widget_show_all (job->dialog);
+
+	g_file_replace_async (file, NULL, FALSE, G_FILE_CREATE_NONE,
+	                      G_PRIORITY_DEFAULT, job->cancellable,
+	                      save_contents_replace_cb, job);
+}
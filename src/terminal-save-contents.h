@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TERMINAL_SAVE_CONTENTS_H
+#define TERMINAL_SAVE_CONTENTS_H
+
+#include <gtk/gtk.h>
+#include <vte/vte.h>
+
+#include "terminal-contents-formatter.h"
+
+G_BEGIN_DECLS
+
+void terminal_save_contents (VteTerminal            *terminal,
+                             GFile                  *file,
+                             TerminalContentsFormat  format,
+                             gboolean                compress,
+                             const GdkRGBA          *foreground,
+                             const GdkRGBA          *background,
+                             GtkWindow              *parent);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_SAVE_CONTENTS_H */
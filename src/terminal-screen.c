@@ -35,11 +35,14 @@
 
 #include "terminal-accels.h"
 #include "terminal-app.h"
+#include "terminal-contents-formatter.h"
 #include "terminal-debug.h"
 #include "terminal-intl.h"
 #include "terminal-marshal.h"
+#include "terminal-output-log.h"
 #include "terminal-profile.h"
 #include "terminal-screen-container.h"
+#include "terminal-search-scan.h"
 #include "terminal-util.h"
 #include "terminal-window.h"
 #include "terminal-info-bar.h"
@@ -52,15 +55,74 @@
 #define URL_MATCH_CURSOR  (GDK_HAND2)
 #define SKEY_MATCH_CURSOR (GDK_HAND2)
 
+/* How often to report the match count while the index is being built */
+#define SEARCH_NOTIFY_INTERVAL_USEC (100 * 1000)
+
+/* How long output waits before it is logged, in milliseconds */
+#define OUTPUT_LOG_FLUSH_INTERVAL (200)
+#define SEARCH_HIGHLIGHT_ALPHA (0.4)
+
+/* Hibernating writes out all but the last HIBERNATE_KEEP_LINES lines of
+ * the scrollback. Shorter scrollbacks aren't worth it.
+ */
+#define HIBERNATE_KEEP_LINES (1000)
+#define HIBERNATE_MIN_LINES (10000)
+#define HIBERNATE_CHUNK_ROWS (1024)
+#define HIBERNATE_READ_SIZE (64 * 1024)
+
+/* A wake whose marker VTE never reports (the child set the current file
+ * URI right after it) ends once VTE has been idle for this many seconds.
+ */
+#define WAKE_TIMEOUT (5)
+
 typedef struct
 {
 	int tag;
 	TerminalURLFlavour flavor;
 } TagData;
 
+/* Things to update in the terminal when profile properties change */
+typedef enum
+{
+	SCREEN_UPDATE_SCROLLBAR           = 1 << 0,
+	SCREEN_UPDATE_TITLE               = 1 << 1,
+	SCREEN_UPDATE_FONT                = 1 << 2,
+	SCREEN_UPDATE_COLORS              = 1 << 3,
+	SCREEN_UPDATE_BELL                = 1 << 4,
+	SCREEN_UPDATE_WORD_CHARS          = 1 << 5,
+	SCREEN_UPDATE_SCROLL_ON_KEYSTROKE = 1 << 6,
+	SCREEN_UPDATE_SCROLL_ON_OUTPUT    = 1 << 7,
+	SCREEN_UPDATE_SCROLLBACK          = 1 << 8,
+	SCREEN_UPDATE_SKEY                = 1 << 9,
+	SCREEN_UPDATE_BACKSPACE_BINDING   = 1 << 10,
+	SCREEN_UPDATE_DELETE_BINDING      = 1 << 11,
+	SCREEN_UPDATE_ALLOW_BOLD          = 1 << 12,
+	SCREEN_UPDATE_CURSOR_BLINK_MODE   = 1 << 13,
+	SCREEN_UPDATE_CURSOR_SHAPE        = 1 << 14,
+	SCREEN_UPDATE_URLS                = 1 << 15,
+	SCREEN_UPDATE_COPY_SELECTION      = 1 << 16,
+	SCREEN_UPDATE_OUTPUT_LOG          = 1 << 17,
+} ScreenProfileUpdate;
+
+#define SCREEN_PROFILE_UPDATE_N_FUNCS (18)
+#define SCREEN_UPDATE_ALL ((1U << SCREEN_PROFILE_UPDATE_N_FUNCS) - 1)
+
+typedef void (* ScreenProfileUpdateFunc) (TerminalScreen  *screen,
+                                          TerminalProfile *profile);
+
+typedef struct
+{
+	const char *prop_name;
+	guint updates;
+} ScreenProfileProperty;
+
+typedef struct _HibernateJob HibernateJob;
+typedef struct _WakeJob WakeJob;
+
 struct _TerminalScreenPrivate
 {
 	TerminalProfile *profile; /* may be NULL at times */
+	TerminalProfileConfig *config; /* snapshot of the profile's appearance */
 	guint profile_changed_id;
 	guint profile_forgotten_id;
 	char *raw_title, *raw_icon_title;
@@ -77,6 +139,52 @@ struct _TerminalScreenPrivate
 	guint launch_child_source_id;
 	gulong bg_image_callback_id;
 	GdkPixbuf *bg_image;
+	guint pending_profile_updates;
+	guint profile_updates_source_id;
+	int pending_columns; /* grid size to apply when shown, 0 if none */
+	int pending_rows;
+	GRegex *search_regex; /* highlighted pattern, NULL if none */
+	GArray *search_matches; /* of TerminalSearchMatch, sorted by row */
+	GArray *search_pending; /* matches found by the running scan */
+	TerminalSearchScan *search_scan;
+	glong search_scan_row; /* where the running scan started */
+	glong search_indexed_row; /* the rows before this are indexed */
+	glong search_columns; /* the width the index was built for */
+	gboolean search_index_stale;
+	gint64 search_notify_time;
+	gulong search_contents_changed_id;
+	gboolean search_has_current; /* whether a match is selected */
+	glong search_current_row;
+	glong search_current_column;
+	TerminalOutputLog *output_log;
+	glong output_log_row; /* the next row to log */
+	guint output_log_flush_id;
+	gulong output_log_contents_changed_id;
+	GdkRGBA foreground; /* the default colours, as set on the terminal */
+	GdkRGBA background;
+	glong scrollback_budget; /* the most lines the app allows us, or -1 */
+	gint64 last_viewed; /* when the screen was last unmapped */
+	gint64 last_output;
+	gint64 last_input;
+	guint64 lines_received;
+	guint64 cells_received;
+	guint64 bytes_sent;
+	glong stats_cursor_row; /* where the cursor was at the last count */
+	glong stats_cursor_column;
+	glong stats_top; /* the first row of the screen then */
+	HibernateJob *hibernate_job;
+	GFile *hibernate_file; /* the start of the scrollback, while hibernating */
+	gulong hibernate_value_changed_id;
+	char *hibernate_checksum; /* of the saved text, with the scrollback debug flag */
+	glong hibernate_rows;
+	gint64 hibernate_rss;
+	WakeJob *wake_job; /* while the saved lines are read back */
+	char *wake_marker; /* while the saved lines are being fed back in */
+	char *wake_file_uri; /* to put back once they are */
+	gboolean wake_input_enabled;
+	gboolean wake_busy; /* VTE processed some of it since the last timeout */
+	guint wake_timeout_id;
+	GList *wake_tasks; /* of GTask */
 };
 
 enum
@@ -85,6 +193,8 @@ enum
     SHOW_POPUP_MENU,
     MATCH_CLICKED,
     CLOSE_SCREEN,
+    SEARCH_MATCHES_CHANGED,
+    WAKE_SCROLLBACK,
     LAST_SIGNAL
 };
 
@@ -123,6 +233,8 @@ static void terminal_screen_system_font_notify_cb (TerminalApp *app,
         TerminalScreen *screen);
 static void terminal_screen_change_font (TerminalScreen *screen);
 static gboolean terminal_screen_popup_menu (GtkWidget *widget);
+static gboolean terminal_screen_draw (GtkWidget *widget,
+                                      cairo_t   *cr);
 static gboolean terminal_screen_button_press (GtkWidget *widget,
         GdkEventButton *event);
 static void terminal_screen_launch_child_on_idle (TerminalScreen *screen);
@@ -135,6 +247,23 @@ static void terminal_screen_icon_title_changed        (VteTerminal *vte_terminal
 
 static void update_color_scheme                      (TerminalScreen *screen);
 
+static void init_profile_update_flags                (void);
+static void terminal_screen_cancel_profile_updates   (TerminalScreen *screen);
+static void terminal_screen_stop_output_log          (TerminalScreen *screen);
+static void terminal_screen_discard_hibernation      (TerminalScreen *screen);
+static void terminal_screen_hibernate_contents_changed_cb (VteTerminal    *terminal,
+        TerminalScreen *screen);
+static void terminal_screen_wake_file_uri_changed_cb (VteTerminal    *terminal,
+        TerminalScreen *screen);
+static void terminal_screen_search_selection_changed_cb (VteTerminal    *terminal,
+        TerminalScreen *screen);
+static void terminal_screen_stats_contents_changed_cb (VteTerminal    *terminal,
+        TerminalScreen *screen);
+static void terminal_screen_stats_commit_cb (VteTerminal    *terminal,
+        const char     *text,
+        guint           size,
+        TerminalScreen *screen);
+
 static gboolean terminal_screen_format_title (TerminalScreen *screen, const char *raw_title, char **old_cooked_title);
 
 static void terminal_screen_cook_title      (TerminalScreen *screen);
@@ -303,13 +432,54 @@ terminal_screen_realize (GtkWidget *widget)
     terminal_screen_set_font (screen);
 }
 
+static void
+terminal_screen_show (GtkWidget *widget)
+{
+	TerminalScreen *screen = TERMINAL_SCREEN (widget);
+	TerminalScreenPrivate *priv = screen->priv;
+
+	/* Apply the size we were given while hidden before we get to draw,
+	 * so the child sees the SIGWINCH first and the scrollback is only
+	 * rewrapped once.
+	 */
+	if (priv->pending_columns > 0 && priv->pending_rows > 0)
+	{
+		_terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
+		                       "[screen %p] applying deferred grid size %d x %d\n",
+		                       screen, priv->pending_columns, priv->pending_rows);
+
+		vte_terminal_set_size (VTE_TERMINAL (screen),
+		                       priv->pending_columns, priv->pending_rows);
+		priv->pending_columns = priv->pending_rows = 0;
+	}
+
+	GTK_WIDGET_CLASS (terminal_screen_parent_class)->show (widget);
+}
+
+static void
+terminal_screen_unmap (GtkWidget *widget)
+{
+	TerminalScreen *screen = TERMINAL_SCREEN (widget);
+
+	/* Switching to another tab unmaps this one */
+	screen->priv->last_viewed = g_get_monotonic_time ();
+
+	GTK_WIDGET_CLASS (terminal_screen_parent_class)->unmap (widget);
+}
+
 static void
 terminal_screen_style_updated (GtkWidget *widget)
 {
     TerminalScreen *screen = TERMINAL_SCREEN (widget);
+    TerminalWindow *window;
 
     GTK_WIDGET_CLASS (terminal_screen_parent_class)->style_updated (widget);
 
+    /* The padding may have changed */
+    window = terminal_screen_get_window (screen);
+    if (window != NULL)
+        terminal_window_invalidate_geometry (window);
+
     update_color_scheme (screen);
 
     if (gtk_widget_get_realized (widget))
@@ -355,6 +525,9 @@ terminal_screen_init (TerminalScreen *screen)
 
 	priv->font_scale = PANGO_SCALE_MEDIUM;
 
+	priv->scrollback_budget = -1;
+	priv->last_viewed = priv->last_output = priv->last_input = g_get_monotonic_time ();
+
 	/* Setup DND */
 	target_list = gtk_target_list_new (NULL, 0);
 	gtk_target_list_add_uri_targets (target_list, 0);
@@ -386,9 +559,23 @@ terminal_screen_init (TerminalScreen *screen)
 	g_signal_connect (terminal_app_get (), "notify::system-font",
 	                  G_CALLBACK (terminal_screen_system_font_notify_cb), screen);
 
+	g_signal_connect (screen, "contents-changed",
+	                  G_CALLBACK (terminal_screen_stats_contents_changed_cb), screen);
+	g_signal_connect (screen, "commit",
+	                  G_CALLBACK (terminal_screen_stats_commit_cb), screen);
+	g_signal_connect (screen, "contents-changed",
+	                  G_CALLBACK (terminal_screen_hibernate_contents_changed_cb), screen);
+	g_signal_connect (screen, "current-file-uri-changed",
+	                  G_CALLBACK (terminal_screen_wake_file_uri_changed_cb), screen);
+	g_signal_connect (screen, "selection-changed",
+	                  G_CALLBACK (terminal_screen_search_selection_changed_cb), screen);
+
 	priv->bg_image_callback_id = 0;
 	priv->bg_image = NULL;
 
+	priv->search_matches = g_array_new (FALSE, FALSE, sizeof (TerminalSearchMatch));
+	priv->search_pending = g_array_new (FALSE, FALSE, sizeof (TerminalSearchMatch));
+
 #ifdef MATE_ENABLE_DEBUG
 	_TERMINAL_DEBUG_IF (TERMINAL_DEBUG_GEOMETRY)
 	{
@@ -481,10 +668,13 @@ terminal_screen_class_init (TerminalScreenClass *klass)
 	object_class->set_property = terminal_screen_set_property;
 
 	widget_class->realize = terminal_screen_realize;
+	widget_class->show = terminal_screen_show;
+	widget_class->unmap = terminal_screen_unmap;
 	widget_class->style_updated = terminal_screen_style_updated;
 	widget_class->drag_data_received = terminal_screen_drag_data_received;
 	widget_class->button_press_event = terminal_screen_button_press;
 	widget_class->popup_menu = terminal_screen_popup_menu;
+	widget_class->draw = terminal_screen_draw;
 
 	terminal_class->child_exited = terminal_screen_child_exited;
 
@@ -529,6 +719,27 @@ terminal_screen_class_init (TerminalScreenClass *klass)
 	                  G_TYPE_NONE,
 	                  0);
 
+	signals[SEARCH_MATCHES_CHANGED] =
+	    g_signal_new (I_("search-matches-changed"),
+	                  G_OBJECT_CLASS_TYPE (object_class),
+	                  G_SIGNAL_RUN_LAST,
+	                  G_STRUCT_OFFSET (TerminalScreenClass, search_matches_changed),
+	                  NULL, NULL,
+	                  g_cclosure_marshal_VOID__VOID,
+	                  G_TYPE_NONE,
+	                  0);
+
+	/* The saved lines are being fed back in, which renumbers the rows */
+	signals[WAKE_SCROLLBACK] =
+	    g_signal_new (I_("wake-scrollback"),
+	                  G_OBJECT_CLASS_TYPE (object_class),
+	                  G_SIGNAL_RUN_LAST,
+	                  G_STRUCT_OFFSET (TerminalScreenClass, wake_scrollback),
+	                  NULL, NULL,
+	                  g_cclosure_marshal_VOID__VOID,
+	                  G_TYPE_NONE,
+	                  0);
+
 	g_object_class_install_property
 	(object_class,
 	 PROP_PROFILE,
@@ -571,6 +782,8 @@ terminal_screen_class_init (TerminalScreenClass *klass)
 	                     G_TYPE_STRV,
 	                     G_PARAM_READWRITE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
 
+	init_profile_update_flags ();
+
 	/* Precompile the regexes */
 	n_url_regexes = G_N_ELEMENTS (url_regex_patterns);
 	url_regexes = g_new0 (VteRegex*, n_url_regexes);
@@ -634,6 +847,19 @@ terminal_screen_dispose (GObject *object)
 		priv->launch_child_source_id = 0;
 	}
 
+	terminal_screen_cancel_profile_updates (screen);
+
+	terminal_screen_stop_output_log (screen);
+
+	terminal_screen_discard_hibernation (screen);
+
+	/* The scan holds a reference on us */
+	if (priv->search_scan != NULL)
+	{
+		terminal_search_scan_cancel (priv->search_scan);
+		priv->search_scan = NULL;
+	}
+
 	G_OBJECT_CLASS (terminal_screen_parent_class)->dispose (object);
 }
 
@@ -649,6 +875,9 @@ terminal_screen_finalize (GObject *object)
 
 	terminal_screen_set_profile (screen, NULL);
 
+	if (priv->config)
+		terminal_profile_config_unref (priv->config);
+
 	g_free (priv->raw_title);
 	g_free (priv->cooked_title);
 	g_free (priv->override_title);
@@ -664,6 +893,11 @@ terminal_screen_finalize (GObject *object)
 	if (priv->bg_image)
 		g_object_unref (priv->bg_image);
 
+	if (priv->search_regex)
+		g_regex_unref (priv->search_regex);
+	g_array_free (priv->search_matches, TRUE);
+	g_array_free (priv->search_pending, TRUE);
+
 	G_OBJECT_CLASS (terminal_screen_parent_class)->finalize (object);
 }
 
@@ -923,286 +1157,682 @@ terminal_screen_cook_icon_title (TerminalScreen *screen)
 }
 
 static void
-terminal_screen_profile_notify_cb (TerminalProfile *profile,
-                                   GParamSpec *pspec,
-                                   TerminalScreen *screen)
+terminal_screen_update_scrollbar (TerminalScreen  *screen,
+                                  TerminalProfile *profile)
 {
-	TerminalScreenPrivate *priv = screen->priv;
-	GObject *object = G_OBJECT (screen);
-	VteTerminal *vte_terminal = VTE_TERMINAL (screen);
-	const char *prop_name;
-	TerminalWindow *window;
+	_terminal_screen_update_scrollbar (screen);
+}
 
-	if (pspec)
-		prop_name = pspec->name;
-	else
-		prop_name = NULL;
+static void
+terminal_screen_update_title (TerminalScreen  *screen,
+                              TerminalProfile *profile)
+{
+	terminal_screen_cook_title (screen);
+	terminal_screen_cook_icon_title (screen);
+}
 
-	g_object_freeze_notify (object);
+static void
+terminal_screen_update_font (TerminalScreen  *screen,
+                             TerminalProfile *profile)
+{
+	if (gtk_widget_get_realized (GTK_WIDGET (screen)))
+		terminal_screen_change_font (screen);
+}
 
-	if ((window = terminal_screen_get_window (screen)))
-	{
-		/* We need these in line for the set_size in
-		 * update_on_realize
-		 */
-		terminal_window_update_geometry (window);
+static void
+terminal_screen_update_colors (TerminalScreen  *screen,
+                               TerminalProfile *profile)
+{
+	update_color_scheme (screen);
+}
 
-		/* madars.vitolins@gmail.com 24/07/2014 -
-		 * update terminal window config
-		 * with the flag of copy selection to clipboard or not. */
-		terminal_window_update_copy_selection(screen, window);
-	}
+static void
+terminal_screen_update_bell (TerminalScreen  *screen,
+                             TerminalProfile *profile)
+{
+	vte_terminal_set_audible_bell (VTE_TERMINAL (screen),
+	                               !terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SILENT_BELL));
+}
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLLBAR_POSITION))
-		_terminal_screen_update_scrollbar (screen);
+static void
+terminal_screen_update_word_chars (TerminalScreen  *screen,
+                                   TerminalProfile *profile)
+{
+	vte_terminal_set_word_char_exceptions (VTE_TERMINAL (screen),
+	                                       terminal_profile_get_property_string (profile, TERMINAL_PROFILE_WORD_CHARS));
+}
 
-	if (!prop_name ||
-	        prop_name == I_(TERMINAL_PROFILE_TITLE_MODE) ||
-	        prop_name == I_(TERMINAL_PROFILE_TITLE))
-	{
-		terminal_screen_cook_title (screen);
-		terminal_screen_cook_icon_title (screen);
-	}
+static void
+terminal_screen_update_scroll_on_keystroke (TerminalScreen  *screen,
+                                            TerminalProfile *profile)
+{
+	vte_terminal_set_scroll_on_keystroke (VTE_TERMINAL (screen),
+	                                      terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE));
+}
 
-	if (gtk_widget_get_realized (GTK_WIDGET (screen)) &&
-	        (!prop_name ||
-	         prop_name == I_(TERMINAL_PROFILE_USE_SYSTEM_FONT) ||
-	         prop_name == I_(TERMINAL_PROFILE_FONT)))
-		terminal_screen_change_font (screen);
+static void
+terminal_screen_update_scroll_on_output (TerminalScreen  *screen,
+                                         TerminalProfile *profile)
+{
+	vte_terminal_set_scroll_on_output (VTE_TERMINAL (screen),
+	                                   terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_OUTPUT));
+}
 
-	if (!prop_name ||
-	        prop_name == I_(TERMINAL_PROFILE_USE_THEME_COLORS) ||
-	        prop_name == I_(TERMINAL_PROFILE_FOREGROUND_COLOR) ||
-	        prop_name == I_(TERMINAL_PROFILE_BACKGROUND_COLOR) ||
-	        prop_name == I_(TERMINAL_PROFILE_BACKGROUND_TYPE) ||
-	        prop_name == I_(TERMINAL_PROFILE_BACKGROUND_DARKNESS) ||
-	        prop_name == I_(TERMINAL_PROFILE_BACKGROUND_IMAGE) ||
-	        prop_name == I_(TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG) ||
-	        prop_name == I_(TERMINAL_PROFILE_BOLD_COLOR) ||
-	        prop_name == I_(TERMINAL_PROFILE_PALETTE))
-		update_color_scheme (screen);
-
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SILENT_BELL))
-		vte_terminal_set_audible_bell (vte_terminal, !terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SILENT_BELL));
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_WORD_CHARS))
-		vte_terminal_set_word_char_exceptions (vte_terminal,
-		                                       terminal_profile_get_property_string (profile, TERMINAL_PROFILE_WORD_CHARS));
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE))
-		vte_terminal_set_scroll_on_keystroke (vte_terminal,
-		                                      terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE));
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLL_ON_OUTPUT))
-		vte_terminal_set_scroll_on_output (vte_terminal,
-		                                   terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_OUTPUT));
-	if (!prop_name ||
-	        prop_name == I_(TERMINAL_PROFILE_SCROLLBACK_LINES) ||
-	        prop_name == I_(TERMINAL_PROFILE_SCROLLBACK_UNLIMITED))
-	{
-		glong lines = terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED) ?
-		              -1 : terminal_profile_get_property_int (profile, TERMINAL_PROFILE_SCROLLBACK_LINES);
-		vte_terminal_set_scrollback_lines (vte_terminal, lines);
-	}
+static void
+terminal_screen_update_scrollback (TerminalScreen  *screen,
+                                   TerminalProfile *profile)
+{
+	glong lines = terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED) ?
+	              -1 : terminal_profile_get_property_int (profile, TERMINAL_PROFILE_SCROLLBACK_LINES);
+	glong budget = screen->priv->scrollback_budget;
+
+	if (budget >= 0 && (lines < 0 || lines > budget))
+		lines = budget;
+
+	vte_terminal_set_scrollback_lines (VTE_TERMINAL (screen), lines);
+}
 
 #ifdef ENABLE_SKEY
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_USE_SKEY))
-	{
-		if (terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_SKEY))
-		{
-			guint i;
+static void
+terminal_screen_update_skey (TerminalScreen  *screen,
+                             TerminalProfile *profile)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	VteTerminal *vte_terminal = VTE_TERMINAL (screen);
+	guint i;
 
-			for (i = 0; i < n_skey_regexes; ++i)
-			{
-				TagData *tag_data;
+	terminal_screen_skey_match_remove (screen);
 
-				tag_data = g_slice_new (TagData);
-				tag_data->flavor = FLAVOR_SKEY;
-				tag_data->tag = vte_terminal_match_add_regex (vte_terminal, skey_regexes[i], 0);
-				vte_terminal_match_set_cursor_type (vte_terminal, tag_data->tag, SKEY_MATCH_CURSOR);
+	if (!terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_SKEY))
+		return;
 
-				priv->match_tags = g_slist_prepend (priv->match_tags, tag_data);
-			}
-		}
-		else
-		{
-			terminal_screen_skey_match_remove (screen);
-		}
+	for (i = 0; i < n_skey_regexes; ++i)
+	{
+		TagData *tag_data;
+
+		tag_data = g_slice_new (TagData);
+		tag_data->flavor = FLAVOR_SKEY;
+		tag_data->tag = vte_terminal_match_add_regex (vte_terminal, skey_regexes[i], 0);
+		vte_terminal_match_set_cursor_type (vte_terminal, tag_data->tag, SKEY_MATCH_CURSOR);
+
+		priv->match_tags = g_slist_prepend (priv->match_tags, tag_data);
 	}
+}
 #endif /* ENABLE_SKEY */
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_BACKSPACE_BINDING))
-		vte_terminal_set_backspace_binding (vte_terminal,
-		                                    terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_BACKSPACE_BINDING));
+static void
+terminal_screen_update_backspace_binding (TerminalScreen  *screen,
+                                          TerminalProfile *profile)
+{
+	vte_terminal_set_backspace_binding (VTE_TERMINAL (screen),
+	                                    terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_BACKSPACE_BINDING));
+}
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_DELETE_BINDING))
-		vte_terminal_set_delete_binding (vte_terminal,
-		                                 terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_DELETE_BINDING));
+static void
+terminal_screen_update_delete_binding (TerminalScreen  *screen,
+                                       TerminalProfile *profile)
+{
+	vte_terminal_set_delete_binding (VTE_TERMINAL (screen),
+	                                 terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_DELETE_BINDING));
+}
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_ALLOW_BOLD))
-		vte_terminal_set_allow_bold (vte_terminal,
-		                             terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_ALLOW_BOLD));
+static void
+terminal_screen_update_allow_bold (TerminalScreen  *screen,
+                                   TerminalProfile *profile)
+{
+	vte_terminal_set_allow_bold (VTE_TERMINAL (screen),
+	                             terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_ALLOW_BOLD));
+}
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CURSOR_BLINK_MODE))
-		vte_terminal_set_cursor_blink_mode (vte_terminal,
-		                                    terminal_profile_get_property_enum (priv->profile, TERMINAL_PROFILE_CURSOR_BLINK_MODE));
+static void
+terminal_screen_update_cursor_blink_mode (TerminalScreen  *screen,
+                                          TerminalProfile *profile)
+{
+	vte_terminal_set_cursor_blink_mode (VTE_TERMINAL (screen),
+	                                    terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_CURSOR_BLINK_MODE));
+}
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CURSOR_SHAPE))
-		vte_terminal_set_cursor_shape (vte_terminal,
-		                               terminal_profile_get_property_enum (priv->profile, TERMINAL_PROFILE_CURSOR_SHAPE));
+static void
+terminal_screen_update_cursor_shape (TerminalScreen  *screen,
+                                     TerminalProfile *profile)
+{
+	vte_terminal_set_cursor_shape (VTE_TERMINAL (screen),
+	                               terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_CURSOR_SHAPE));
+}
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_USE_URLS))
-	{
-		if (terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_URLS))
-		{
-			guint i;
+static void
+terminal_screen_update_urls (TerminalScreen  *screen,
+                             TerminalProfile *profile)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	VteTerminal *vte_terminal = VTE_TERMINAL (screen);
+	guint i;
 
-			for (i = 0; i < n_url_regexes; ++i)
-			{
-				TagData *tag_data;
+	terminal_screen_url_match_remove (screen);
 
-				tag_data = g_slice_new (TagData);
-				tag_data->flavor = url_regex_flavors[i];
-				tag_data->tag = vte_terminal_match_add_regex (vte_terminal, url_regexes[i], 0);
-				vte_terminal_match_set_cursor_type (vte_terminal, tag_data->tag, URL_MATCH_CURSOR);
+	if (!terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_URLS))
+		return;
 
-				priv->match_tags = g_slist_prepend (priv->match_tags, tag_data);
-			}
-		}
-		else
-		{
-			terminal_screen_url_match_remove (screen);
-		}
+	for (i = 0; i < n_url_regexes; ++i)
+	{
+		TagData *tag_data;
+
+		tag_data = g_slice_new (TagData);
+		tag_data->flavor = url_regex_flavors[i];
+		tag_data->tag = vte_terminal_match_add_regex (vte_terminal, url_regexes[i], 0);
+		vte_terminal_match_set_cursor_type (vte_terminal, tag_data->tag, URL_MATCH_CURSOR);
+
+		priv->match_tags = g_slist_prepend (priv->match_tags, tag_data);
 	}
-	g_object_thaw_notify (object);
 }
 
 static void
-update_color_scheme (TerminalScreen *screen)
+terminal_screen_update_copy_selection (TerminalScreen  *screen,
+                                       TerminalProfile *profile)
 {
-	TerminalScreenPrivate *priv = screen->priv;
-	TerminalProfile *profile = priv->profile;
-	GdkRGBA colors[TERMINAL_PALETTE_SIZE];
-	const GdkRGBA *fg_rgba, *bg_rgba, *bold_rgba;
-	TerminalBackgroundType bg_type;
-	const gchar *bg_image_file;
-	double bg_alpha = 1.0;
-	GdkRGBA fg, bg;
-	GdkRGBA *c;
-	guint n_colors;
-	GtkStyleContext *context;
-	GError *error = NULL;
+	TerminalWindow *window;
 
-	context = gtk_widget_get_style_context (GTK_WIDGET (screen));
-	gtk_style_context_save (context);
-	gtk_style_context_set_state (context, GTK_STATE_FLAG_NORMAL);
-	gtk_style_context_get_color (context, GTK_STATE_FLAG_NORMAL, &fg);
+	/* madars.vitolins@gmail.com 24/07/2014 -
+	 * update terminal window config
+	 * with the flag of copy selection to clipboard or not. */
+	if ((window = terminal_screen_get_window (screen)))
+		terminal_window_update_copy_selection (screen, window);
+}
 
-	gtk_style_context_get (context, GTK_STATE_FLAG_NORMAL,
-			       GTK_STYLE_PROPERTY_BACKGROUND_COLOR,
-			       &c, NULL);
-	bg = *c;
-	gdk_rgba_free (c);
+/* Logs the rows [first, end) */
+static void
+terminal_screen_log_rows (TerminalScreen *screen,
+                          glong           first,
+                          glong           end)
+{
+	VteTerminal *terminal = VTE_TERMINAL (screen);
+	char *text;
 
-	gtk_style_context_restore (context);
+	if (first >= end)
+		return;
 
-	bold_rgba = NULL;
+	text = vte_terminal_get_text_range (terminal,
+	                                    first, 0,
+	                                    end - 1, vte_terminal_get_column_count (terminal) - 1,
+	                                    NULL, NULL, NULL);
+	if (text != NULL)
+		terminal_output_log_append (screen->priv->output_log, text, strlen (text));
+}
 
-	if (!terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_THEME_COLORS))
-	{
-		fg_rgba = terminal_profile_get_property_boxed (profile, TERMINAL_PROFILE_FOREGROUND_COLOR);
-		bg_rgba = terminal_profile_get_property_boxed (profile, TERMINAL_PROFILE_BACKGROUND_COLOR);
+static gboolean
+terminal_screen_rows_are_blank (TerminalScreen *screen,
+                                glong           first,
+                                glong           end)
+{
+	VteTerminal *terminal = VTE_TERMINAL (screen);
+	gboolean blank = TRUE;
+	char *text, *p;
 
-		if (!terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG))
-			bold_rgba = terminal_profile_get_property_boxed (profile, TERMINAL_PROFILE_BOLD_COLOR);
+	if (first >= end)
+		return TRUE;
 
-		if (fg_rgba)
-			fg = *fg_rgba;
-		if (bg_rgba)
-			bg = *bg_rgba;
-	}
+	text = vte_terminal_get_text_range (terminal,
+	                                    first, 0,
+	                                    end - 1, vte_terminal_get_column_count (terminal) - 1,
+	                                    NULL, NULL, NULL);
+	for (p = text; p != NULL && *p != '\0' && blank; ++p)
+		blank = g_ascii_isspace (*p);
+	g_free (text);
+
+	return blank;
+}
 
-	n_colors = G_N_ELEMENTS (colors);
-	terminal_profile_get_palette (priv->profile, colors, &n_colors);
+/* Logs the rows from the last logged one up to the cursor. The cursor row
+ * itself may still change, so it is logged once the cursor has left it.
+ */
+static void
+terminal_screen_flush_output_log (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	VteTerminal *terminal = VTE_TERMINAL (screen);
+	GtkAdjustment *adjustment;
+	glong column, row, first, top, rows;
 
-	bg_type = terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_BACKGROUND_TYPE);
-	bg_image_file = terminal_profile_get_property_string (profile, TERMINAL_PROFILE_BACKGROUND_IMAGE_FILE);
+	/* A wake feeds the old scrollback back in; that isn't output */
+	if (priv->output_log == NULL || priv->wake_marker != NULL)
+		return;
 
-	if (bg_type == TERMINAL_BACKGROUND_TRANSPARENT)
-		bg_alpha = terminal_profile_get_property_double (profile, TERMINAL_PROFILE_BACKGROUND_DARKNESS);
-	else if (bg_type == TERMINAL_BACKGROUND_IMAGE)
-	  bg_alpha = 0.0;
-	bg.alpha = bg_alpha;
+	vte_terminal_get_cursor_position (terminal, &column, &row);
 
-	if (bg_type == TERMINAL_BACKGROUND_IMAGE)
+	/* The screen was cleared or the cursor moved up; log what gets
+	 * written there from now on.
+	 */
+	if (row < priv->output_log_row)
 	{
-		if (!priv->bg_image_callback_id)
-			priv->bg_image_callback_id = g_signal_connect (screen, "draw", G_CALLBACK (terminal_screen_image_draw_cb), NULL);
+		priv->output_log_row = row;
+		return;
+	}
 
-		g_clear_object (&priv->bg_image);
-		priv->bg_image = gdk_pixbuf_new_from_file (bg_image_file, &error);
+	/* Rows that scrolled out of the history before we got to them are
+	 * lost; say so in the log.
+	 */
+	adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+	first = (glong) gtk_adjustment_get_lower (adjustment);
+	if (priv->output_log_row < first)
+	{
+		char *note;
 
-		if (error) {
-			g_printerr ("Failed to load background image: %s\n", error->message);
-			g_clear_error (&error);
-		}
+		note = g_strdup_printf ("\n[%ld lines of output not logged]\n",
+		                        first - priv->output_log_row);
+		terminal_output_log_append (priv->output_log, note, strlen (note));
+		priv->output_log_row = first;
+	}
 
-		gtk_widget_queue_draw (GTK_WIDGET (screen));
-	} else {
-		if (priv->bg_image_callback_id)
-		{
-			g_signal_handler_disconnect (screen, priv->bg_image_callback_id);
-			priv->bg_image_callback_id = 0;
-		}
+	first = priv->output_log_row;
+	if (first >= row)
+		return;
+
+	/* A clear pushes the whole screen into the scrollback, blank rows
+	 * below the cursor included, and moves the cursor on to the new
+	 * screen. Normal output only scrolls with the cursor on the bottom
+	 * row, so blank rows between the last logged row and the top of the
+	 * screen with the cursor elsewhere were left by a clear; skip them.
+	 */
+	rows = vte_terminal_get_row_count (terminal);
+	top = (glong) gtk_adjustment_get_upper (adjustment) - rows;
+	if (first < top && row < top + rows - 1 &&
+	        terminal_screen_rows_are_blank (screen, first + 1, top))
+	{
+		terminal_screen_log_rows (screen, first, first + 1);
+		first = top;
 	}
 
-	vte_terminal_set_colors (VTE_TERMINAL (screen),
-	                         &fg, &bg,
-	                         colors, n_colors);
-	if (bold_rgba)
-		vte_terminal_set_color_bold (VTE_TERMINAL (screen),
-		                             bold_rgba);
+	terminal_screen_log_rows (screen, first, row);
+
+	priv->output_log_row = row;
 }
 
-void
-terminal_screen_set_font (TerminalScreen *screen)
+static gboolean
+terminal_screen_output_log_flush_cb (TerminalScreen *screen)
 {
-	TerminalScreenPrivate *priv = screen->priv;
-	TerminalProfile *profile;
-	PangoFontDescription *desc;
-	int size;
-
-	profile = priv->profile;
+	screen->priv->output_log_flush_id = 0;
+	terminal_screen_flush_output_log (screen);
 
-	if (terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_SYSTEM_FONT))
-		g_object_get (terminal_app_get (), "system-font", &desc, NULL);
-	else
-		g_object_get (profile, TERMINAL_PROFILE_FONT, &desc, NULL);
-	g_assert (desc);
-
-	size = pango_font_description_get_size (desc);
-	if (pango_font_description_get_size_is_absolute (desc))
-		pango_font_description_set_absolute_size (desc, priv->font_scale * size);
-	else
-		pango_font_description_set_size (desc, (int)(priv->font_scale * size));
+	return FALSE;
+}
 
-	vte_terminal_set_font (VTE_TERMINAL (screen), desc);
+static void
+terminal_screen_output_log_contents_changed_cb (VteTerminal    *terminal,
+                                                TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
 
-	pango_font_description_free (desc);
+	/* Output comes in many small pieces; log it in batches. A timeout
+	 * rather than an idle, which a busy terminal would never let run
+	 * while the rows scroll out of the history.
+	 */
+	if (priv->output_log_flush_id == 0)
+		priv->output_log_flush_id =
+		    g_timeout_add (OUTPUT_LOG_FLUSH_INTERVAL,
+		                   (GSourceFunc) terminal_screen_output_log_flush_cb,
+		                   screen);
 }
 
 static void
-terminal_screen_system_font_notify_cb (TerminalApp *app,
-                                       GParamSpec *pspec,
-                                       TerminalScreen *screen)
+terminal_screen_stop_output_log (TerminalScreen *screen)
 {
 	TerminalScreenPrivate *priv = screen->priv;
 
-	if (!gtk_widget_get_realized (GTK_WIDGET (screen)))
+	if (priv->output_log == NULL)
 		return;
 
-	if (!terminal_profile_get_property_boolean (priv->profile, TERMINAL_PROFILE_USE_SYSTEM_FONT))
-		return;
+	terminal_screen_flush_output_log (screen);
 
-	terminal_screen_change_font (screen);
-}
+	if (priv->output_log_flush_id != 0)
+	{
+		g_source_remove (priv->output_log_flush_id);
+		priv->output_log_flush_id = 0;
+	}
+
+	g_signal_handler_disconnect (screen, priv->output_log_contents_changed_id);
+	priv->output_log_contents_changed_id = 0;
+
+	terminal_output_log_close (priv->output_log);
+	priv->output_log = NULL;
+}
+
+static void
+terminal_screen_update_output_log (TerminalScreen  *screen,
+                                   TerminalProfile *profile)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	static guint n_logs = 0;
+	const char *directory;
+	char *default_directory = NULL, *basename;
+	glong column;
+	int max_size, rotate_interval;
+
+	/* Any change starts a new file with the new settings */
+	terminal_screen_stop_output_log (screen);
+
+	if (!terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_LOG_OUTPUT))
+		return;
+
+	directory = terminal_profile_get_property_string (profile, TERMINAL_PROFILE_LOG_DIRECTORY);
+	if (directory == NULL || directory[0] == '\0')
+		directory = default_directory = g_build_filename (g_get_user_data_dir (),
+		                                                  "mate-terminal", "logs", NULL);
+
+	max_size = terminal_profile_get_property_int (profile, TERMINAL_PROFILE_LOG_MAX_SIZE);
+	rotate_interval = terminal_profile_get_property_int (profile, TERMINAL_PROFILE_LOG_ROTATE_INTERVAL);
+
+	basename = g_strdup_printf ("terminal-%d-%u", (int) getpid (), ++n_logs);
+	priv->output_log = terminal_output_log_new (directory, basename,
+	                                            (goffset) max_size * 1024 * 1024,
+	                                            (guint) rotate_interval * 60 * 60,
+	                                            terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_LOG_COMPRESS));
+	g_free (basename);
+	g_free (default_directory);
+
+	/* Log the output from now on, not what is in the scrollback already */
+	vte_terminal_get_cursor_position (VTE_TERMINAL (screen), &column, &priv->output_log_row);
+
+	priv->output_log_contents_changed_id =
+	    g_signal_connect (screen, "contents-changed",
+	                      G_CALLBACK (terminal_screen_output_log_contents_changed_cb), screen);
+}
+
+/* Indexed by the bit number of the corresponding ScreenProfileUpdate flag */
+static const ScreenProfileUpdateFunc screen_profile_update_funcs[] =
+{
+	terminal_screen_update_scrollbar,
+	terminal_screen_update_title,
+	terminal_screen_update_font,
+	terminal_screen_update_colors,
+	terminal_screen_update_bell,
+	terminal_screen_update_word_chars,
+	terminal_screen_update_scroll_on_keystroke,
+	terminal_screen_update_scroll_on_output,
+	terminal_screen_update_scrollback,
+#ifdef ENABLE_SKEY
+	terminal_screen_update_skey,
+#else
+	NULL,
+#endif
+	terminal_screen_update_backspace_binding,
+	terminal_screen_update_delete_binding,
+	terminal_screen_update_allow_bold,
+	terminal_screen_update_cursor_blink_mode,
+	terminal_screen_update_cursor_shape,
+	terminal_screen_update_urls,
+	terminal_screen_update_copy_selection,
+	terminal_screen_update_output_log,
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (screen_profile_update_funcs) == SCREEN_PROFILE_UPDATE_N_FUNCS);
+
+static const ScreenProfileProperty screen_profile_properties[] =
+{
+	{ TERMINAL_PROFILE_SCROLLBAR_POSITION,    SCREEN_UPDATE_SCROLLBAR },
+	{ TERMINAL_PROFILE_TITLE_MODE,            SCREEN_UPDATE_TITLE },
+	{ TERMINAL_PROFILE_TITLE,                 SCREEN_UPDATE_TITLE },
+	{ TERMINAL_PROFILE_USE_SYSTEM_FONT,       SCREEN_UPDATE_FONT },
+	{ TERMINAL_PROFILE_FONT,                  SCREEN_UPDATE_FONT },
+	{ TERMINAL_PROFILE_USE_THEME_COLORS,      SCREEN_UPDATE_COLORS },
+	{ TERMINAL_PROFILE_FOREGROUND_COLOR,      SCREEN_UPDATE_COLORS },
+	{ TERMINAL_PROFILE_BACKGROUND_COLOR,      SCREEN_UPDATE_COLORS },
+	{ TERMINAL_PROFILE_BACKGROUND_TYPE,       SCREEN_UPDATE_COLORS },
+	{ TERMINAL_PROFILE_BACKGROUND_DARKNESS,   SCREEN_UPDATE_COLORS },
+	{ TERMINAL_PROFILE_BACKGROUND_IMAGE,      SCREEN_UPDATE_COLORS },
+	{ TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG, SCREEN_UPDATE_COLORS },
+	{ TERMINAL_PROFILE_BOLD_COLOR,            SCREEN_UPDATE_COLORS },
+	{ TERMINAL_PROFILE_PALETTE,               SCREEN_UPDATE_COLORS },
+	{ TERMINAL_PROFILE_SILENT_BELL,           SCREEN_UPDATE_BELL },
+	{ TERMINAL_PROFILE_WORD_CHARS,            SCREEN_UPDATE_WORD_CHARS },
+	{ TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE,   SCREEN_UPDATE_SCROLL_ON_KEYSTROKE },
+	{ TERMINAL_PROFILE_SCROLL_ON_OUTPUT,      SCREEN_UPDATE_SCROLL_ON_OUTPUT },
+	{ TERMINAL_PROFILE_SCROLLBACK_LINES,      SCREEN_UPDATE_SCROLLBACK },
+	{ TERMINAL_PROFILE_SCROLLBACK_UNLIMITED,  SCREEN_UPDATE_SCROLLBACK },
+	{ TERMINAL_PROFILE_USE_SKEY,              SCREEN_UPDATE_SKEY },
+	{ TERMINAL_PROFILE_BACKSPACE_BINDING,     SCREEN_UPDATE_BACKSPACE_BINDING },
+	{ TERMINAL_PROFILE_DELETE_BINDING,        SCREEN_UPDATE_DELETE_BINDING },
+	{ TERMINAL_PROFILE_ALLOW_BOLD,            SCREEN_UPDATE_ALLOW_BOLD },
+	{ TERMINAL_PROFILE_CURSOR_BLINK_MODE,     SCREEN_UPDATE_CURSOR_BLINK_MODE },
+	{ TERMINAL_PROFILE_CURSOR_SHAPE,          SCREEN_UPDATE_CURSOR_SHAPE },
+	{ TERMINAL_PROFILE_USE_URLS,              SCREEN_UPDATE_URLS },
+	{ TERMINAL_PROFILE_COPY_SELECTION,        SCREEN_UPDATE_COPY_SELECTION },
+	{ TERMINAL_PROFILE_LOG_OUTPUT,            SCREEN_UPDATE_OUTPUT_LOG },
+	{ TERMINAL_PROFILE_LOG_DIRECTORY,         SCREEN_UPDATE_OUTPUT_LOG },
+	{ TERMINAL_PROFILE_LOG_MAX_SIZE,          SCREEN_UPDATE_OUTPUT_LOG },
+	{ TERMINAL_PROFILE_LOG_ROTATE_INTERVAL,   SCREEN_UPDATE_OUTPUT_LOG },
+	{ TERMINAL_PROFILE_LOG_COMPRESS,          SCREEN_UPDATE_OUTPUT_LOG },
+};
+
+/* interned property name -> ScreenProfileUpdate flags */
+static GHashTable *screen_profile_update_flags;
+
+static void
+init_profile_update_flags (void)
+{
+	guint i;
+
+	screen_profile_update_flags = g_hash_table_new (NULL, NULL);
+	for (i = 0; i < G_N_ELEMENTS (screen_profile_properties); ++i)
+	{
+		const char *prop_name = I_(screen_profile_properties[i].prop_name);
+		guint updates;
+
+		updates = GPOINTER_TO_UINT (g_hash_table_lookup (screen_profile_update_flags, prop_name));
+		updates |= screen_profile_properties[i].updates;
+		g_hash_table_insert (screen_profile_update_flags, (gpointer) prop_name, GUINT_TO_POINTER (updates));
+	}
+}
+
+static void
+terminal_screen_apply_profile_updates (TerminalScreen *screen,
+                                       guint           updates)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	TerminalProfile *profile = priv->profile;
+	GObject *object = G_OBJECT (screen);
+	TerminalWindow *window;
+	guint i;
+
+	if (profile == NULL || updates == 0)
+		return;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+	                       "[screen %p] applying profile updates 0x%x\n",
+	                       screen, updates);
+
+	g_object_freeze_notify (object);
+
+	if (updates & (SCREEN_UPDATE_FONT | SCREEN_UPDATE_COLORS))
+	{
+		/* Shared with all other screens using this profile */
+		if (priv->config)
+			terminal_profile_config_unref (priv->config);
+		priv->config = terminal_profile_ref_config (profile);
+	}
+
+	/* We need this in line for the set_size in update_on_realize. Only
+	 * the font and the scrollbar can change the window geometry, so skip
+	 * the size negotiation for everything else.
+	 */
+	window = terminal_screen_get_window (screen);
+	if (window != NULL && (updates & (SCREEN_UPDATE_FONT | SCREEN_UPDATE_SCROLLBAR)))
+		terminal_window_update_geometry (window);
+
+	for (i = 0; i < SCREEN_PROFILE_UPDATE_N_FUNCS; ++i)
+		if ((updates & (1U << i)) && screen_profile_update_funcs[i] != NULL)
+			screen_profile_update_funcs[i] (screen, profile);
+
+	/* The scrollbar is part of the chrome */
+	if (window != NULL && (updates & SCREEN_UPDATE_SCROLLBAR))
+		terminal_window_invalidate_geometry (window);
+
+	g_object_thaw_notify (object);
+}
+
+static gboolean
+terminal_screen_profile_updates_idle_cb (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	guint updates;
+
+	updates = priv->pending_profile_updates;
+	priv->pending_profile_updates = 0;
+	priv->profile_updates_source_id = 0;
+
+	terminal_screen_apply_profile_updates (screen, updates);
+
+	return FALSE; /* don't run again */
+}
+
+static void
+terminal_screen_cancel_profile_updates (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	priv->pending_profile_updates = 0;
+
+	if (priv->profile_updates_source_id != 0)
+	{
+		g_source_remove (priv->profile_updates_source_id);
+		priv->profile_updates_source_id = 0;
+	}
+}
+
+static void
+terminal_screen_profile_notify_cb (TerminalProfile *profile,
+                                   GParamSpec *pspec,
+                                   TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	guint updates;
+
+	updates = GPOINTER_TO_UINT (g_hash_table_lookup (screen_profile_update_flags, pspec->name));
+	if (updates == 0)
+		return;
+
+	priv->pending_profile_updates |= updates;
+
+	/* Collect all changes made during this main loop iteration and apply
+	 * them once, before the next relayout and redraw.
+	 */
+	if (priv->profile_updates_source_id == 0)
+		priv->profile_updates_source_id =
+		    g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+		                     (GSourceFunc) terminal_screen_profile_updates_idle_cb,
+		                     screen, NULL);
+}
+
+static void
+update_color_scheme (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	TerminalProfileConfig *config = priv->config;
+	GdkRGBA fg, bg;
+
+	if (!config)
+		return;
+
+	if (config->use_theme_colors)
+	{
+		GtkStyleContext *context;
+		GdkRGBA *c;
+
+		context = gtk_widget_get_style_context (GTK_WIDGET (screen));
+		gtk_style_context_save (context);
+		gtk_style_context_set_state (context, GTK_STATE_FLAG_NORMAL);
+		gtk_style_context_get_color (context, GTK_STATE_FLAG_NORMAL, &fg);
+
+		gtk_style_context_get (context, GTK_STATE_FLAG_NORMAL,
+				       GTK_STYLE_PROPERTY_BACKGROUND_COLOR,
+				       &c, NULL);
+		bg = *c;
+		gdk_rgba_free (c);
+
+		gtk_style_context_restore (context);
+	}
+	else
+	{
+		fg = config->foreground;
+		bg = config->background;
+	}
+
+	bg.alpha = config->background_alpha;
+
+	priv->foreground = fg;
+	priv->background = bg;
+
+	if (config->background_type == TERMINAL_BACKGROUND_IMAGE)
+	{
+		if (!priv->bg_image_callback_id)
+			priv->bg_image_callback_id = g_signal_connect (screen, "draw", G_CALLBACK (terminal_screen_image_draw_cb), NULL);
+
+		if (priv->bg_image != config->background_image)
+		{
+			g_clear_object (&priv->bg_image);
+			if (config->background_image)
+				priv->bg_image = g_object_ref (config->background_image);
+		}
+
+		gtk_widget_queue_draw (GTK_WIDGET (screen));
+	} else {
+		if (priv->bg_image_callback_id)
+		{
+			g_signal_handler_disconnect (screen, priv->bg_image_callback_id);
+			priv->bg_image_callback_id = 0;
+		}
+	}
+
+	vte_terminal_set_colors (VTE_TERMINAL (screen),
+	                         &fg, &bg,
+	                         config->palette, config->n_palette);
+	if (!config->use_theme_colors && config->use_bold_color)
+		vte_terminal_set_color_bold (VTE_TERMINAL (screen),
+		                             &config->bold);
+}
+
+void
+terminal_screen_set_font (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	TerminalProfileConfig *config = priv->config;
+	PangoFontDescription *desc;
+	int size;
+
+	if (!config)
+		return;
+
+	if (config->use_system_font)
+		g_object_get (terminal_app_get (), "system-font", &desc, NULL);
+	else
+		desc = pango_font_description_copy (config->font);
+	g_assert (desc);
+
+	size = pango_font_description_get_size (desc);
+	if (pango_font_description_get_size_is_absolute (desc))
+		pango_font_description_set_absolute_size (desc, priv->font_scale * size);
+	else
+		pango_font_description_set_size (desc, (int)(priv->font_scale * size));
+
+	vte_terminal_set_font (VTE_TERMINAL (screen), desc);
+
+	pango_font_description_free (desc);
+}
+
+static void
+terminal_screen_system_font_notify_cb (TerminalApp *app,
+                                       GParamSpec *pspec,
+                                       TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (!gtk_widget_get_realized (GTK_WIDGET (screen)))
+		return;
+
+	if (!terminal_profile_get_property_boolean (priv->profile, TERMINAL_PROFILE_USE_SYSTEM_FONT))
+		return;
+
+	terminal_screen_change_font (screen);
+}
 
 static void
 terminal_screen_change_font (TerminalScreen *screen)
@@ -1237,6 +1867,8 @@ terminal_screen_set_profile (TerminalScreen *screen,
 	if (profile == old_profile)
 		return;
 
+	terminal_screen_cancel_profile_updates (screen);
+
 	if (priv->profile_changed_id)
 	{
 		g_signal_handler_disconnect (G_OBJECT (priv->profile),
@@ -1265,7 +1897,7 @@ terminal_screen_set_profile (TerminalScreen *screen,
 		                      G_CALLBACK (profile_forgotten_callback),
 		                      screen);
 
-		terminal_screen_profile_notify_cb (profile, NULL, screen);
+		terminal_screen_apply_profile_updates (screen, SCREEN_UPDATE_ALL);
 
 		g_signal_emit (G_OBJECT (screen), signals[PROFILE_SET], 0, old_profile);
 	}
@@ -2285,12 +2917,49 @@ terminal_screen_get_size (TerminalScreen *screen,
                           int       *width_chars,
                           int       *height_chars)
 {
+	TerminalScreenPrivate *priv = screen->priv;
 	VteTerminal *terminal = VTE_TERMINAL (screen);
 
+	if (priv->pending_columns > 0 && priv->pending_rows > 0)
+	{
+		*width_chars = priv->pending_columns;
+		*height_chars = priv->pending_rows;
+		return;
+	}
+
 	*width_chars = vte_terminal_get_column_count (terminal);
 	*height_chars = vte_terminal_get_row_count (terminal);
 }
 
+/**
+ * terminal_screen_set_size:
+ * @screen:
+ * @width_chars:
+ * @height_chars:
+ *
+ * Sets the grid size of @screen. Resizing rewraps the whole scrollback,
+ * so while the screen is hidden (i.e. it is not the current tab) only the
+ * size is recorded; it is applied once, right before the screen is shown
+ * again.
+ */
+void
+terminal_screen_set_size (TerminalScreen *screen,
+                          int             width_chars,
+                          int             height_chars)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (!gtk_widget_get_visible (GTK_WIDGET (screen)))
+	{
+		priv->pending_columns = width_chars;
+		priv->pending_rows = height_chars;
+		return;
+	}
+
+	priv->pending_columns = priv->pending_rows = 0;
+	vte_terminal_set_size (VTE_TERMINAL (screen), width_chars, height_chars);
+}
+
 void
 terminal_screen_get_cell_size (TerminalScreen *screen,
                                int                  *cell_width_pixels,
@@ -2302,6 +2971,1437 @@ terminal_screen_get_cell_size (TerminalScreen *screen,
 	*cell_height_pixels = vte_terminal_get_char_height (terminal);
 }
 
+/**
+ * terminal_screen_get_colors:
+ * @screen:
+ * @foreground: (out): the default foreground colour
+ * @background: (out): the default background colour
+ *
+ * Gets the default colours of @screen, after resolving the theme colours
+ * if the profile uses those.
+ */
+void
+terminal_screen_get_colors (TerminalScreen *screen,
+                            GdkRGBA        *foreground,
+                            GdkRGBA        *background)
+{
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	*foreground = screen->priv->foreground;
+	*background = screen->priv->background;
+}
+
+/**
+ * terminal_screen_set_scrollback_budget:
+ * @screen:
+ * @lines: the most scrollback lines @screen may keep, or -1 for no limit
+ *
+ * Limits the scrollback of @screen below what its profile asks for. This
+ * drops the oldest lines if there are more than @lines already; raising
+ * the limit again doesn't bring them back.
+ */
+void
+terminal_screen_set_scrollback_budget (TerminalScreen *screen,
+                                       glong           lines)
+{
+	TerminalScreenPrivate *priv;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	priv = screen->priv;
+
+	if (lines == priv->scrollback_budget)
+		return;
+
+	priv->scrollback_budget = lines;
+
+	if (priv->profile != NULL)
+		terminal_screen_update_scrollback (screen, priv->profile);
+}
+
+/**
+ * terminal_screen_get_scrollback_usage:
+ * @screen:
+ *
+ * Returns: the number of lines in the scrollback of @screen, not counting
+ *   the rows on screen
+ */
+glong
+terminal_screen_get_scrollback_usage (TerminalScreen *screen)
+{
+	GtkAdjustment *adjustment;
+	glong lines;
+
+	g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), 0);
+
+	adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+	lines = (glong) (gtk_adjustment_get_upper (adjustment) - gtk_adjustment_get_lower (adjustment)) -
+	        vte_terminal_get_row_count (VTE_TERMINAL (screen));
+
+	return MAX (lines, 0);
+}
+
+/**
+ * terminal_screen_get_last_viewed:
+ * @screen:
+ *
+ * Returns: the monotonic time @screen was last on screen, which is now
+ *   while it is mapped
+ */
+gint64
+terminal_screen_get_last_viewed (TerminalScreen *screen)
+{
+	g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), 0);
+
+	if (gtk_widget_get_mapped (GTK_WIDGET (screen)))
+		return g_get_monotonic_time ();
+
+	return screen->priv->last_viewed;
+}
+
+/* Activity accounting
+ *
+ * VTE doesn't say how much output it read, so it is estimated from how
+ * far the cursor moved on since the last contents-changed: whole rows
+ * count as lines, and the cells in between as characters. Output that
+ * moves the cursor back up, like full-screen programs redrawing, isn't
+ * counted.
+ */
+
+static void
+terminal_screen_stats_contents_changed_cb (VteTerminal    *terminal,
+                                           TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	glong column, row, rows, top;
+
+	vte_terminal_get_cursor_position (terminal, &column, &row);
+	rows = vte_terminal_get_row_count (terminal);
+	top = (glong) gtk_adjustment_get_upper (gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen))) - rows;
+
+	/* The scrollback fed back in by a wake isn't new output */
+	if (priv->wake_marker != NULL)
+	{
+		priv->stats_cursor_row = row;
+		priv->stats_cursor_column = column;
+		priv->stats_top = top;
+		return;
+	}
+
+	priv->last_output = g_get_monotonic_time ();
+
+	/* Normal output only scrolls with the cursor on the bottom row. The
+	 * screen moving down with the cursor elsewhere was a clear, which
+	 * pushes a screenful of rows into the scrollback; only count what
+	 * was written on the new screen.
+	 */
+	if (top > priv->stats_top && row < top + rows - 1 && priv->stats_cursor_row < top)
+	{
+		priv->stats_cursor_row = top;
+		priv->stats_cursor_column = 0;
+	}
+
+	if (row > priv->stats_cursor_row)
+	{
+		priv->lines_received += row - priv->stats_cursor_row;
+		priv->cells_received += (row - priv->stats_cursor_row) * vte_terminal_get_column_count (terminal) +
+		                        column - priv->stats_cursor_column;
+	}
+	else if (row == priv->stats_cursor_row && column > priv->stats_cursor_column)
+		priv->cells_received += column - priv->stats_cursor_column;
+
+	priv->stats_cursor_row = row;
+	priv->stats_cursor_column = column;
+	priv->stats_top = top;
+}
+
+static void
+terminal_screen_stats_commit_cb (VteTerminal    *terminal,
+                                 const char     *text,
+                                 guint           size,
+                                 TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	priv->bytes_sent += size;
+	priv->last_input = g_get_monotonic_time ();
+}
+
+/**
+ * terminal_screen_get_stats:
+ * @screen:
+ * @stats: (out): the statistics of @screen
+ *
+ * Gets estimates of the memory use and activity of @screen. This is
+ * cheap enough to call for every tab.
+ */
+void
+terminal_screen_get_stats (TerminalScreen      *screen,
+                           TerminalScreenStats *stats)
+{
+	TerminalScreenPrivate *priv;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	priv = screen->priv;
+
+	stats->scrollback_lines = terminal_screen_get_scrollback_usage (screen);
+	stats->scrollback_size = (gint64) stats->scrollback_lines *
+	                         vte_terminal_get_column_count (VTE_TERMINAL (screen)) *
+	                         TERMINAL_SCREEN_SCROLLBACK_BYTES_PER_CELL;
+	stats->lines_received = priv->lines_received;
+	stats->cells_received = priv->cells_received;
+	stats->bytes_sent = priv->bytes_sent;
+	stats->last_activity = MAX (priv->last_output, priv->last_input);
+	stats->hibernating = priv->hibernate_file != NULL;
+}
+
+/* Scrollback hibernation
+ *
+ * A tab that has been hidden and quiet for a while writes the start of its
+ * scrollback, with the colours as ANSI sequences, to a compressed temporary
+ * file and keeps only the last HIBERNATE_KEEP_LINES lines. VTE can't insert
+ * lines above the ones it has, so waking up drops the scrollback and feeds
+ * everything back in: the saved lines, then what the terminal held, and
+ * finally the cursor position.
+ *
+ * Feeding text back doesn't restore the terminal modes, so only tabs whose
+ * shell waits at its prompt hibernate. Nor is it lossless: VTE only tells
+ * us the colours, underline and strikethrough of each cell, so bold,
+ * italic, reverse and blinking text and hyperlinks come back plain, and
+ * the background colour past the end of a line is lost.
+ * MATE_TERMINAL_DEBUG=scrollback checks that the text comes back the same
+ * and shows what hibernating does to the resident set size.
+ */
+
+struct _HibernateJob
+{
+	TerminalScreen *screen; /* NULL once abandoned */
+	GFile *file;
+	GFileIOStream *io_stream;
+	GOutputStream *stream;
+	GCancellable *cancellable;
+	TerminalContentsFormatter *formatter;
+	GArray *attributes;
+	char *chunk; /* the text being written */
+	glong row;
+	glong end_row;
+	gboolean footer_written;
+};
+
+struct _WakeJob
+{
+	TerminalScreen *screen; /* NULL once abandoned */
+	GFile *file;
+	GInputStream *stream;
+	GCancellable *cancellable;
+	GString *contents; /* what the terminal held, fed after the saved lines */
+	char *cursor;
+};
+
+static void hibernate_job_write_next_chunk (HibernateJob *job);
+
+/* In kB, for the scrollback debug output */
+static gint64
+hibernate_get_rss (void)
+{
+	char *contents, *end;
+	gint64 resident = 0;
+
+	if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+		return 0;
+
+	/* The total size, then the resident pages */
+	g_ascii_strtoll (contents, &end, 10);
+	resident = g_ascii_strtoll (end, NULL, 10);
+	g_free (contents);
+
+	return resident * sysconf (_SC_PAGESIZE) / 1024;
+}
+
+static char *
+hibernate_checksum_rows (TerminalScreen *screen,
+                         glong           first,
+                         glong           end)
+{
+	VteTerminal *terminal = VTE_TERMINAL (screen);
+	char *text, *checksum;
+
+	text = vte_terminal_get_text_range (terminal,
+	                                    first, 0,
+	                                    end - 1, vte_terminal_get_column_count (terminal) - 1,
+	                                    NULL, NULL, NULL);
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, text ? text : "", -1);
+	g_free (text);
+
+	return checksum;
+}
+
+static void
+hibernate_value_changed_cb (GtkAdjustment  *adjustment,
+                            TerminalScreen *screen)
+{
+	/* Scrolled up to where the saved lines would be */
+	if (gtk_adjustment_get_value (adjustment) <= gtk_adjustment_get_lower (adjustment))
+		terminal_screen_wake_scrollback_async (screen, NULL, NULL, NULL);
+}
+
+static void
+hibernate_job_finish (HibernateJob *job,
+                      gboolean      success)
+{
+	TerminalScreen *screen = job->screen;
+
+	if (!g_output_stream_is_closed (job->stream))
+		g_output_stream_close (job->stream, NULL, NULL);
+
+	if (success && screen != NULL)
+	{
+		TerminalScreenPrivate *priv = screen->priv;
+
+		priv->hibernate_job = NULL;
+		priv->hibernate_file = g_object_ref (job->file);
+
+		/* VTE drops the lines as soon as the limit is lowered, so it can
+		 * go back up right away and leave room for any amount of output.
+		 */
+		vte_terminal_set_scrollback_lines (VTE_TERMINAL (screen), HIBERNATE_KEEP_LINES);
+		if (priv->profile != NULL)
+			terminal_screen_update_scrollback (screen, priv->profile);
+
+		_terminal_debug_print (TERMINAL_DEBUG_SCROLLBACK,
+		                       "Screen %p saved %ld lines, RSS %" G_GINT64_FORMAT " kB -> %" G_GINT64_FORMAT " kB\n",
+		                       screen, priv->hibernate_rows, priv->hibernate_rss, hibernate_get_rss ());
+
+		priv->hibernate_value_changed_id =
+		    g_signal_connect (gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen)),
+		                      "value-changed",
+		                      G_CALLBACK (hibernate_value_changed_cb), screen);
+	}
+	else
+	{
+		if (screen != NULL)
+			screen->priv->hibernate_job = NULL;
+
+		g_file_delete (job->file, NULL, NULL);
+	}
+
+	g_object_unref (job->stream);
+	g_object_unref (job->io_stream);
+	g_object_unref (job->file);
+	g_object_unref (job->cancellable);
+	terminal_contents_formatter_free (job->formatter);
+	g_array_free (job->attributes, TRUE);
+	g_free (job->chunk);
+	g_slice_free (HibernateJob, job);
+}
+
+static void
+hibernate_job_close_cb (GObject      *source,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+	HibernateJob *job = user_data;
+	gboolean success;
+
+	success = g_output_stream_close_finish (G_OUTPUT_STREAM (source), result, NULL);
+	hibernate_job_finish (job, success && job->screen != NULL);
+}
+
+static void
+hibernate_job_write_cb (GObject      *source,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+	HibernateJob *job = user_data;
+
+	g_clear_pointer (&job->chunk, g_free);
+
+	if (!g_output_stream_write_all_finish (G_OUTPUT_STREAM (source), result, NULL, NULL) ||
+	        job->screen == NULL)
+	{
+		hibernate_job_finish (job, FALSE);
+		return;
+	}
+
+	hibernate_job_write_next_chunk (job);
+}
+
+static void
+hibernate_job_write_next_chunk (HibernateJob *job)
+{
+	VteTerminal *terminal = VTE_TERMINAL (job->screen);
+	GtkAdjustment *adjustment;
+	glong last;
+	char *text;
+
+	/* Rows that scrolled out of the history meanwhile would leave a gap */
+	adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (terminal));
+	if ((glong) gtk_adjustment_get_lower (adjustment) > job->row)
+	{
+		hibernate_job_finish (job, FALSE);
+		return;
+	}
+
+	if (job->row >= job->end_row)
+	{
+		if (!job->footer_written)
+		{
+			job->footer_written = TRUE;
+			job->chunk = terminal_contents_formatter_get_footer (job->formatter);
+		}
+
+		if (job->chunk == NULL)
+		{
+			g_output_stream_close_async (job->stream, G_PRIORITY_LOW,
+			                             job->cancellable,
+			                             hibernate_job_close_cb, job);
+			return;
+		}
+	}
+	else
+	{
+		last = MIN (job->row + HIBERNATE_CHUNK_ROWS, job->end_row);
+		text = vte_terminal_get_text_range (terminal,
+		                                    job->row, 0,
+		                                    last - 1, vte_terminal_get_column_count (terminal) - 1,
+		                                    NULL, NULL, job->attributes);
+		if (text == NULL)
+		{
+			hibernate_job_finish (job, FALSE);
+			return;
+		}
+
+		job->chunk = terminal_contents_formatter_format (job->formatter, text, job->attributes);
+		job->row = last;
+	}
+
+	g_output_stream_write_all_async (job->stream,
+	                                 job->chunk, strlen (job->chunk),
+	                                 G_PRIORITY_LOW,
+	                                 job->cancellable,
+	                                 hibernate_job_write_cb, job);
+}
+
+static void
+terminal_screen_cancel_hibernation (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (priv->hibernate_job == NULL)
+		return;
+
+	/* The pending operation fails and frees the job */
+	priv->hibernate_job->screen = NULL;
+	g_cancellable_cancel (priv->hibernate_job->cancellable);
+	priv->hibernate_job = NULL;
+}
+
+/* Reports the end of a wake to everyone waiting for it */
+static void
+terminal_screen_complete_wake (TerminalScreen *screen,
+                               gboolean        success)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	GList *tasks, *l;
+
+	tasks = priv->wake_tasks;
+	priv->wake_tasks = NULL;
+
+	for (l = tasks; l != NULL; l = l->next)
+	{
+		GTask *task = l->data;
+
+		if (success)
+			g_task_return_boolean (task, TRUE);
+		else
+			g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+			                         "The terminal was closed");
+		g_object_unref (task);
+	}
+	g_list_free (tasks);
+}
+
+static void
+terminal_screen_discard_hibernation (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	terminal_screen_cancel_hibernation (screen);
+
+	if (priv->wake_job != NULL)
+	{
+		/* The pending read fails and frees the job */
+		priv->wake_job->screen = NULL;
+		g_cancellable_cancel (priv->wake_job->cancellable);
+		priv->wake_job = NULL;
+	}
+
+	if (priv->wake_timeout_id != 0)
+	{
+		g_source_remove (priv->wake_timeout_id);
+		priv->wake_timeout_id = 0;
+	}
+
+	g_clear_pointer (&priv->wake_marker, g_free);
+	g_clear_pointer (&priv->wake_file_uri, g_free);
+	g_clear_pointer (&priv->hibernate_checksum, g_free);
+	terminal_screen_complete_wake (screen, FALSE);
+
+	if (priv->hibernate_file == NULL)
+		return;
+
+	g_signal_handler_disconnect (gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen)),
+	                             priv->hibernate_value_changed_id);
+	priv->hibernate_value_changed_id = 0;
+
+	g_file_delete (priv->hibernate_file, NULL, NULL);
+	g_clear_object (&priv->hibernate_file);
+}
+
+static void
+terminal_screen_hibernate_contents_changed_cb (VteTerminal    *terminal,
+                                               TerminalScreen *screen)
+{
+	/* The output could push out rows before they are saved */
+	terminal_screen_cancel_hibernation (screen);
+
+	if (screen->priv->wake_marker != NULL)
+		screen->priv->wake_busy = TRUE;
+}
+
+/**
+ * terminal_screen_maybe_hibernate:
+ * @screen:
+ * @idle_usec: how long @screen has to be hidden and without output
+ *
+ * Starts writing most of the scrollback of @screen to a temporary file
+ * in the background if @screen has been hidden and quiet for @idle_usec,
+ * and the scrollback is long enough to be worth it. Once written, the
+ * lines are dropped until terminal_screen_wake_scrollback_async() brings
+ * them back.
+ */
+void
+terminal_screen_maybe_hibernate (TerminalScreen *screen,
+                                 gint64          idle_usec)
+{
+	TerminalScreenPrivate *priv;
+	VteTerminal *terminal;
+	GtkAdjustment *adjustment;
+	GZlibCompressor *compressor;
+	GFileIOStream *io_stream;
+	HibernateJob *job;
+	GFile *file;
+	gint64 now;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	priv = screen->priv;
+	terminal = VTE_TERMINAL (screen);
+	now = g_get_monotonic_time ();
+
+	if (priv->hibernate_job != NULL ||
+	        priv->hibernate_file != NULL ||
+	        priv->wake_marker != NULL ||
+	        priv->child_pid == -1 ||
+	        gtk_widget_get_mapped (GTK_WIDGET (screen)) ||
+	        now - priv->last_output < idle_usec ||
+	        now - priv->last_viewed < idle_usec ||
+	        terminal_screen_get_scrollback_usage (screen) < HIBERNATE_MIN_LINES ||
+	        terminal_screen_has_foreground_process (screen))
+		return;
+
+	file = g_file_new_tmp ("mate-terminal-scrollback-XXXXXX.gz", &io_stream, NULL);
+	if (file == NULL)
+		return;
+
+	job = g_slice_new0 (HibernateJob);
+	job->screen = screen;
+	job->file = file;
+	job->io_stream = io_stream;
+	job->cancellable = g_cancellable_new ();
+
+	compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+	job->stream = g_converter_output_stream_new (g_io_stream_get_output_stream (G_IO_STREAM (io_stream)),
+	                                             G_CONVERTER (compressor));
+	g_object_unref (compressor);
+
+	job->formatter = terminal_contents_formatter_new (TERMINAL_CONTENTS_FORMAT_ANSI,
+	                                                  &priv->foreground, &priv->background);
+	job->attributes = g_array_new (FALSE, FALSE, sizeof (VteCharAttributes));
+
+	adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+	job->row = (glong) gtk_adjustment_get_lower (adjustment);
+	job->end_row = (glong) gtk_adjustment_get_upper (adjustment) -
+	               vte_terminal_get_row_count (terminal) - HIBERNATE_KEEP_LINES;
+
+	_TERMINAL_DEBUG_IF (TERMINAL_DEBUG_SCROLLBACK)
+	{
+		g_free (priv->hibernate_checksum);
+		priv->hibernate_checksum = hibernate_checksum_rows (screen, job->row, job->end_row);
+		priv->hibernate_rows = job->end_row - job->row;
+		priv->hibernate_rss = hibernate_get_rss ();
+	}
+
+	priv->hibernate_job = job;
+	hibernate_job_write_next_chunk (job);
+}
+
+/* Feeds @text with its newlines turned into line breaks */
+static void
+hibernate_feed_rows (VteTerminal *terminal,
+                     const char  *text,
+                     gsize        len)
+{
+	const char *end = text + len, *eol;
+	GString *string;
+
+	string = g_string_sized_new (len + len / 16);
+
+	while ((eol = memchr (text, '\n', end - text)) != NULL)
+	{
+		g_string_append_len (string, text, eol - text);
+		g_string_append (string, "\r\n");
+		text = eol + 1;
+	}
+	g_string_append_len (string, text, end - text);
+
+	vte_terminal_feed (terminal, string->str, string->len);
+	g_string_free (string, TRUE);
+}
+
+/* Everything fed in by the wake has been processed */
+static void
+terminal_screen_end_wake (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	VteTerminal *terminal = VTE_TERMINAL (screen);
+
+	if (priv->wake_timeout_id != 0)
+	{
+		g_source_remove (priv->wake_timeout_id);
+		priv->wake_timeout_id = 0;
+	}
+
+	g_clear_pointer (&priv->wake_marker, g_free);
+	g_clear_pointer (&priv->wake_file_uri, g_free);
+
+	vte_terminal_set_input_enabled (terminal, priv->wake_input_enabled);
+
+	/* Count and log output from where the replay left the cursor */
+	vte_terminal_get_cursor_position (terminal, &priv->stats_cursor_column, &priv->stats_cursor_row);
+	priv->stats_top = (glong) gtk_adjustment_get_upper (gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen))) -
+	                  vte_terminal_get_row_count (terminal);
+	priv->output_log_row = priv->stats_cursor_row;
+
+	if (priv->hibernate_checksum != NULL)
+	{
+		glong lower;
+		char *checksum;
+
+		lower = (glong) gtk_adjustment_get_lower (gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen)));
+		checksum = hibernate_checksum_rows (screen, lower, lower + priv->hibernate_rows);
+		_terminal_debug_print (TERMINAL_DEBUG_SCROLLBACK,
+		                       "Screen %p restored %ld lines, text %s, RSS %" G_GINT64_FORMAT " kB\n",
+		                       screen, priv->hibernate_rows,
+		                       strcmp (checksum, priv->hibernate_checksum) == 0 ? "unchanged" : "CHANGED",
+		                       hibernate_get_rss ());
+		g_free (checksum);
+		g_clear_pointer (&priv->hibernate_checksum, g_free);
+	}
+
+	/* The rows are numbered anew; index them again */
+	if (priv->search_regex != NULL)
+	{
+		GRegex *regex = g_regex_ref (priv->search_regex);
+
+		terminal_screen_set_search_highlight (screen, NULL);
+		terminal_screen_set_search_highlight (screen, regex);
+		g_regex_unref (regex);
+	}
+
+	terminal_screen_complete_wake (screen, TRUE);
+}
+
+static void
+terminal_screen_wake_file_uri_changed_cb (VteTerminal    *terminal,
+                                          TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	const char *uri;
+	char *reset;
+
+	if (priv->wake_marker == NULL)
+		return;
+
+	uri = vte_terminal_get_current_file_uri (terminal);
+	if (g_strcmp0 (uri, priv->wake_marker) != 0)
+	{
+		/* The child set it during the wake; that is the one to keep */
+		g_free (priv->wake_file_uri);
+		priv->wake_file_uri = g_strdup (uri);
+		return;
+	}
+
+	if (priv->wake_job != NULL)
+		return;
+
+	/* Only put the URI back while the marker is still showing */
+	reset = g_strdup_printf ("\033]6;%s\007", priv->wake_file_uri ? priv->wake_file_uri : "");
+	vte_terminal_feed (terminal, reset, -1);
+	g_free (reset);
+
+	terminal_screen_end_wake (screen);
+}
+
+static gboolean
+terminal_screen_wake_timeout_cb (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (priv->wake_busy)
+	{
+		priv->wake_busy = FALSE;
+		return G_SOURCE_CONTINUE;
+	}
+
+	/* Something replaced the marker before VTE reported it. All that was
+	 * fed in has been processed by now, and the URI is the child's.
+	 */
+	priv->wake_timeout_id = 0;
+	terminal_screen_end_wake (screen);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void wake_job_read_next (WakeJob *job);
+
+static void
+wake_job_finish (WakeJob *job)
+{
+	TerminalScreen *screen = job->screen;
+
+	if (screen != NULL)
+	{
+		TerminalScreenPrivate *priv = screen->priv;
+		VteTerminal *terminal = VTE_TERMINAL (screen);
+		char *marker;
+
+		priv->wake_job = NULL;
+
+		hibernate_feed_rows (terminal, job->contents->str, job->contents->len);
+		vte_terminal_feed (terminal, job->cursor, -1);
+
+		/* The wake is complete when VTE gets here */
+		marker = g_strdup_printf ("\033]6;%s\007", priv->wake_marker);
+		vte_terminal_feed (terminal, marker, -1);
+		g_free (marker);
+
+		priv->wake_busy = TRUE;
+		priv->wake_timeout_id = g_timeout_add_seconds (WAKE_TIMEOUT,
+		                        (GSourceFunc) terminal_screen_wake_timeout_cb,
+		                        screen);
+	}
+
+	g_file_delete (job->file, NULL, NULL);
+
+	if (job->stream != NULL)
+		g_object_unref (job->stream);
+	g_object_unref (job->file);
+	g_object_unref (job->cancellable);
+	g_string_free (job->contents, TRUE);
+	g_free (job->cursor);
+	g_slice_free (WakeJob, job);
+}
+
+static void
+wake_job_read_cb (GObject      *source,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+	WakeJob *job = user_data;
+	GError *error = NULL;
+	GBytes *bytes;
+	gconstpointer data;
+	gsize size;
+
+	bytes = g_input_stream_read_bytes_finish (G_INPUT_STREAM (source), result, &error);
+
+	if (bytes == NULL || g_bytes_get_size (bytes) == 0 || job->screen == NULL)
+	{
+		if (error != NULL && job->screen != NULL)
+			g_warning ("Could not restore the scrollback: %s", error->message);
+		g_clear_error (&error);
+		if (bytes != NULL)
+			g_bytes_unref (bytes);
+
+		wake_job_finish (job);
+		return;
+	}
+
+	/* One buffer at a time, so the main loop keeps running */
+	data = g_bytes_get_data (bytes, &size);
+	hibernate_feed_rows (VTE_TERMINAL (job->screen), data, size);
+	g_bytes_unref (bytes);
+
+	wake_job_read_next (job);
+}
+
+static void
+wake_job_read_next (WakeJob *job)
+{
+	g_input_stream_read_bytes_async (job->stream, HIBERNATE_READ_SIZE,
+	                                 G_PRIORITY_DEFAULT, job->cancellable,
+	                                 wake_job_read_cb, job);
+}
+
+static void
+wake_job_open_cb (GObject      *source,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+	WakeJob *job = user_data;
+	GFileInputStream *file_stream;
+	GZlibDecompressor *decompressor;
+	GError *error = NULL;
+
+	file_stream = g_file_read_finish (G_FILE (source), result, &error);
+	if (file_stream == NULL)
+	{
+		if (job->screen != NULL)
+			g_warning ("Could not restore the scrollback: %s", error->message);
+		g_error_free (error);
+
+		wake_job_finish (job);
+		return;
+	}
+
+	decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+	job->stream = g_converter_input_stream_new (G_INPUT_STREAM (file_stream),
+	                                            G_CONVERTER (decompressor));
+	g_object_unref (decompressor);
+	g_object_unref (file_stream);
+
+	wake_job_read_next (job);
+}
+
+/**
+ * terminal_screen_wake_scrollback_async:
+ * @screen:
+ * @cancellable: (allow-none):
+ * @callback: (allow-none): called once the whole scrollback is back
+ * @user_data: data for @callback
+ *
+ * Brings back the scrollback of a hibernating @screen, and stops it from
+ * hibernating if it is about to. Wait for this before looking at the
+ * whole scrollback.
+ *
+ * The saved lines are read back and fed in one buffer at a time, with
+ * keyboard input held off so that nothing ends up between them. VTE
+ * processes fed text later on, so the last buffer is followed by a marker
+ * setting the current file URI; the wake is complete when VTE reports the
+ * marker, or stops processing without reporting it. If @screen isn't
+ * hibernating, @callback is called from an idle handler.
+ */
+void
+terminal_screen_wake_scrollback_async (TerminalScreen      *screen,
+                                       GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data)
+{
+	static guint wake_serial = 0;
+	TerminalScreenPrivate *priv;
+	VteTerminal *terminal;
+	GTask *task;
+	TerminalContentsFormatter *formatter;
+	GtkAdjustment *adjustment;
+	GArray *attributes;
+	GString *contents;
+	WakeJob *job;
+	glong lower, upper, rows, column, row;
+	char *text, *footer;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	priv = screen->priv;
+	terminal = VTE_TERMINAL (screen);
+
+	task = g_task_new (screen, cancellable, callback, user_data);
+	g_task_set_source_tag (task, terminal_screen_wake_scrollback_async);
+
+	terminal_screen_cancel_hibernation (screen);
+
+	if (priv->wake_marker != NULL)
+	{
+		priv->wake_tasks = g_list_append (priv->wake_tasks, task);
+		return;
+	}
+
+	if (priv->hibernate_file == NULL)
+	{
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return;
+	}
+
+	/* Log what came before; nothing is logged until the wake is over */
+	terminal_screen_flush_output_log (screen);
+
+	job = g_slice_new0 (WakeJob);
+	job->screen = screen;
+	job->file = priv->hibernate_file; /* adopts the reference */
+	job->cancellable = g_cancellable_new ();
+	priv->hibernate_file = NULL;
+
+	adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+	g_signal_handler_disconnect (adjustment, priv->hibernate_value_changed_id);
+	priv->hibernate_value_changed_id = 0;
+
+	/* Take what the terminal holds now, without the final line break */
+	lower = (glong) gtk_adjustment_get_lower (adjustment);
+	upper = (glong) gtk_adjustment_get_upper (adjustment);
+	rows = vte_terminal_get_row_count (terminal);
+	vte_terminal_get_cursor_position (terminal, &column, &row);
+
+	formatter = terminal_contents_formatter_new (TERMINAL_CONTENTS_FORMAT_ANSI,
+	                                             &priv->foreground, &priv->background);
+	attributes = g_array_new (FALSE, FALSE, sizeof (VteCharAttributes));
+	contents = job->contents = g_string_new (NULL);
+
+	text = vte_terminal_get_text_range (terminal,
+	                                    lower, 0,
+	                                    upper - 1, vte_terminal_get_column_count (terminal) - 1,
+	                                    NULL, NULL, attributes);
+	if (text != NULL)
+	{
+		gsize len = strlen (text);
+
+		if (len > 0 && text[len - 1] == '\n')
+			text[len - 1] = '\0';
+
+		text = terminal_contents_formatter_format (formatter, text, attributes);
+		g_string_append (contents, text);
+		g_free (text);
+	}
+
+	footer = terminal_contents_formatter_get_footer (formatter);
+	if (footer != NULL)
+		g_string_append (contents, footer);
+	g_free (footer);
+
+	terminal_contents_formatter_free (formatter);
+	g_array_free (attributes, TRUE);
+
+	/* Drop the scrollback and start over from the top of a clear screen */
+	vte_terminal_set_scrollback_lines (terminal, 0);
+	if (priv->profile != NULL)
+		terminal_screen_update_scrollback (screen, priv->profile);
+
+	vte_terminal_feed (terminal, "\033[0m\033[H\033[J", -1);
+
+	job->cursor = g_strdup_printf ("\033[%ld;%ldH", row - (upper - rows) + 1, column + 1);
+
+	priv->wake_file_uri = g_strdup (vte_terminal_get_current_file_uri (terminal));
+	priv->wake_marker = g_strdup_printf ("file:///mate-terminal-scrollback-restored-%u", ++wake_serial);
+
+	priv->wake_input_enabled = vte_terminal_get_input_enabled (terminal);
+	vte_terminal_set_input_enabled (terminal, FALSE);
+
+	priv->wake_job = job;
+	g_file_read_async (job->file, G_PRIORITY_DEFAULT, job->cancellable,
+	                   wake_job_open_cb, job);
+
+	priv->wake_tasks = g_list_append (priv->wake_tasks, task);
+
+	g_signal_emit (screen, signals[WAKE_SCROLLBACK], 0);
+}
+
+/**
+ * terminal_screen_wake_scrollback_finish:
+ * @screen:
+ * @result:
+ * @error: (allow-none):
+ *
+ * Returns: %TRUE if the scrollback is back, or %FALSE if @screen was
+ *   closed or the wake cancelled
+ */
+gboolean
+terminal_screen_wake_scrollback_finish (TerminalScreen  *screen,
+                                        GAsyncResult    *result,
+                                        GError         **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, screen), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* Returns the index of the first match at or after @row */
+static guint
+search_matches_lower_bound (GArray *matches,
+                            glong   row)
+{
+	guint low = 0, high = matches->len;
+
+	while (low < high)
+	{
+		guint mid = low + (high - low) / 2;
+
+		if (g_array_index (matches, TerminalSearchMatch, mid).row < row)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static void
+search_index_flush (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	guint i;
+
+	/* What the scan found replaces the matches from where it started */
+	i = search_matches_lower_bound (priv->search_matches, priv->search_scan_row);
+	g_array_set_size (priv->search_matches, i);
+	g_array_append_vals (priv->search_matches,
+	                     priv->search_pending->data, priv->search_pending->len);
+
+	priv->search_notify_time = g_get_monotonic_time ();
+
+	gtk_widget_queue_draw (GTK_WIDGET (screen));
+	g_signal_emit (screen, signals[SEARCH_MATCHES_CHANGED], 0);
+}
+
+static void search_index_update (TerminalScreen *screen);
+
+static gboolean
+search_scan_match_cb (TerminalSearchScan        *scan,
+                      const TerminalSearchMatch *match,
+                      gpointer                   user_data)
+{
+	TerminalScreen *screen = TERMINAL_SCREEN (user_data);
+	TerminalScreenPrivate *priv = screen->priv;
+
+	g_array_append_val (priv->search_pending, *match);
+
+	/* Let the count grow while a long scrollback is indexed */
+	if (g_get_monotonic_time () - priv->search_notify_time >= SEARCH_NOTIFY_INTERVAL_USEC)
+		search_index_flush (screen);
+
+	return TRUE;
+}
+
+static void
+search_scan_done_cb (TerminalSearchScan *scan,
+                     gpointer            user_data)
+{
+	TerminalScreen *screen = TERMINAL_SCREEN (user_data);
+	TerminalScreenPrivate *priv = screen->priv;
+
+	priv->search_scan = NULL;
+	priv->search_indexed_row = terminal_search_scan_get_row (scan);
+
+	search_index_flush (screen);
+	g_array_set_size (priv->search_pending, 0);
+
+	if (priv->search_index_stale)
+		search_index_update (screen);
+}
+
+/* Brings the index up to date by rescanning what may have changed since
+ * the last scan: the new output and the screen area, which is the only
+ * part of the scrollback the child can write to. Everything is rescanned
+ * if the text was rewrapped.
+ */
+static void
+search_index_update (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	VteTerminal *terminal = VTE_TERMINAL (screen);
+	GtkAdjustment *adjustment;
+	glong lower, upper, columns, row;
+	guint i;
+
+	priv->search_index_stale = FALSE;
+
+	adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+	lower = (glong) gtk_adjustment_get_lower (adjustment);
+	upper = (glong) gtk_adjustment_get_upper (adjustment);
+	columns = vte_terminal_get_column_count (terminal);
+
+	if (columns != priv->search_columns)
+	{
+		priv->search_columns = columns;
+		priv->search_indexed_row = lower;
+	}
+
+	/* Drop the matches that scrolled out of the history */
+	i = search_matches_lower_bound (priv->search_matches, lower);
+	if (i > 0)
+		g_array_remove_range (priv->search_matches, 0, i);
+
+	row = MIN (priv->search_indexed_row, upper - vte_terminal_get_row_count (terminal));
+	row = MAX (row, lower);
+
+	priv->search_scan_row = row;
+	g_array_set_size (priv->search_pending, 0);
+	priv->search_scan = terminal_search_scan_new (terminal, priv->search_regex,
+	                                              row, FALSE, FALSE,
+	                                              search_scan_match_cb,
+	                                              search_scan_done_cb,
+	                                              screen);
+}
+
+static void
+search_contents_changed_cb (VteTerminal    *terminal,
+                            TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	/* Output usually comes in bursts; rescan once the scan is done */
+	if (priv->search_scan != NULL)
+	{
+		priv->search_index_stale = TRUE;
+		return;
+	}
+
+	search_index_update (screen);
+}
+
+/**
+ * terminal_screen_set_search_highlight:
+ * @screen:
+ * @regex: (allow-none): the regex to highlight, or %NULL
+ *
+ * Highlights all matches of @regex in the scrollback of @screen, or
+ * removes the highlighting if @regex is %NULL. The matches are indexed
+ * in the background, and the index is kept up to date as output arrives;
+ * #TerminalScreen::search-matches-changed is emitted as it changes.
+ */
+void
+terminal_screen_set_search_highlight (TerminalScreen *screen,
+                                      GRegex         *regex)
+{
+	TerminalScreenPrivate *priv;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	priv = screen->priv;
+
+	/* The matches are indexed again once the lines are back */
+	if (regex != NULL)
+		terminal_screen_wake_scrollback_async (screen, NULL, NULL, NULL);
+
+	if (regex == priv->search_regex)
+		return;
+
+	priv->search_has_current = FALSE;
+
+	if (priv->search_scan != NULL)
+	{
+		terminal_search_scan_cancel (priv->search_scan);
+		priv->search_scan = NULL;
+	}
+
+	if (priv->search_regex)
+		g_regex_unref (priv->search_regex);
+	priv->search_regex = regex ? g_regex_ref (regex) : NULL;
+
+	g_array_set_size (priv->search_matches, 0);
+	g_array_set_size (priv->search_pending, 0);
+	priv->search_indexed_row = 0;
+	priv->search_columns = 0;
+	priv->search_index_stale = FALSE;
+	priv->search_notify_time = g_get_monotonic_time ();
+
+	if (regex == NULL)
+	{
+		if (priv->search_contents_changed_id != 0)
+		{
+			g_signal_handler_disconnect (screen, priv->search_contents_changed_id);
+			priv->search_contents_changed_id = 0;
+		}
+	}
+	else
+	{
+		if (priv->search_contents_changed_id == 0)
+			priv->search_contents_changed_id =
+			    g_signal_connect (screen, "contents-changed",
+			                      G_CALLBACK (search_contents_changed_cb), screen);
+
+		search_index_update (screen);
+	}
+
+	gtk_widget_queue_draw (GTK_WIDGET (screen));
+	g_signal_emit (screen, signals[SEARCH_MATCHES_CHANGED], 0);
+}
+
+/**
+ * terminal_screen_get_search_match_count:
+ * @screen:
+ * @position: (out) (allow-none): the 1-based index of the selected match,
+ *   or 0 if none is selected or it isn't indexed yet
+ * @count: (out) (allow-none): the number of matches found so far
+ * @complete: (out) (allow-none): whether the index is up to date
+ *
+ * Returns: %FALSE if no search is highlighted on @screen
+ */
+gboolean
+terminal_screen_get_search_match_count (TerminalScreen *screen,
+                                        guint          *position,
+                                        guint          *count,
+                                        gboolean       *complete)
+{
+	TerminalScreenPrivate *priv;
+	GArray *matches;
+
+	g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
+
+	priv = screen->priv;
+	matches = priv->search_matches;
+
+	if (position)
+	{
+		guint i;
+
+		*position = 0;
+		if (priv->search_has_current)
+		{
+			for (i = search_matches_lower_bound (matches, priv->search_current_row);
+			        i < matches->len &&
+			        g_array_index (matches, TerminalSearchMatch, i).row == priv->search_current_row;
+			        ++i)
+			{
+				if (g_array_index (matches, TerminalSearchMatch, i).column == priv->search_current_column)
+				{
+					*position = i + 1;
+					break;
+				}
+			}
+		}
+	}
+	if (count)
+		*count = matches->len;
+	if (complete)
+		*complete = priv->search_scan == NULL && !priv->search_index_stale;
+
+	return priv->search_regex != NULL;
+}
+
+static void
+terminal_screen_search_selection_changed_cb (VteTerminal    *terminal,
+                                             TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	/* With the selection gone, no match is the current one any more */
+	if (priv->search_has_current && !vte_terminal_get_has_selection (terminal))
+	{
+		priv->search_has_current = FALSE;
+		g_signal_emit (screen, signals[SEARCH_MATCHES_CHANGED], 0);
+	}
+}
+
+/**
+ * terminal_screen_set_search_current:
+ * @screen:
+ * @row: the row of the match VTE selected
+ * @column: its column
+ *
+ * Makes the match at @row and @column the one whose position
+ * terminal_screen_get_search_match_count() reports.
+ */
+void
+terminal_screen_set_search_current (TerminalScreen *screen,
+                                    glong           row,
+                                    glong           column)
+{
+	TerminalScreenPrivate *priv;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	priv = screen->priv;
+
+	priv->search_has_current = TRUE;
+	priv->search_current_row = row;
+	priv->search_current_column = column;
+	g_signal_emit (screen, signals[SEARCH_MATCHES_CHANGED], 0);
+}
+
+/* Compares the start of @match with @row and @column */
+static int
+search_match_compare (const TerminalSearchMatch *match,
+                      glong                      row,
+                      glong                      column)
+{
+	if (match->row != row)
+		return match->row < row ? -1 : 1;
+	if (match->column != column)
+		return match->column < column ? -1 : 1;
+	return 0;
+}
+
+/**
+ * terminal_screen_search_find:
+ * @screen:
+ * @backwards: whether to find the previous match
+ *
+ * Selects the next or previous match of the VTE search regex, like
+ * vte_terminal_search_find_next() and vte_terminal_search_find_previous(),
+ * and tracks which match of the highlight index is now the current one.
+ *
+ * VTE doesn't say where its match is. It searches on from the selected
+ * match, or without one from the top of the view forwards and from its
+ * bottom backwards, so the same step is taken in the index.
+ */
+void
+terminal_screen_search_find (TerminalScreen *screen,
+                             gboolean        backwards)
+{
+	TerminalScreenPrivate *priv;
+	VteTerminal *terminal;
+	GArray *matches;
+	glong row, column;
+	gboolean found;
+	guint i;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	priv = screen->priv;
+	terminal = VTE_TERMINAL (screen);
+	matches = priv->search_matches;
+
+	if (priv->search_has_current && vte_terminal_get_has_selection (terminal))
+	{
+		row = priv->search_current_row;
+		column = priv->search_current_column;
+	}
+	else
+	{
+		row = (glong) gtk_adjustment_get_value (gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen)));
+		if (backwards)
+			row += vte_terminal_get_row_count (terminal);
+		column = -1;
+	}
+
+	if (backwards)
+		found = vte_terminal_search_find_previous (terminal);
+	else
+		found = vte_terminal_search_find_next (terminal);
+
+	priv->search_has_current = FALSE;
+
+	if (found && matches->len > 0)
+	{
+		if (backwards)
+		{
+			/* The last match before the start */
+			i = search_matches_lower_bound (matches, row);
+			while (i < matches->len &&
+			        search_match_compare (&g_array_index (matches, TerminalSearchMatch, i), row, column) < 0)
+				++i;
+
+			if (i > 0)
+				i--;
+			else if (vte_terminal_search_get_wrap_around (terminal))
+				i = matches->len - 1;
+			else
+				i = matches->len;
+		}
+		else
+		{
+			/* The first match after the start */
+			i = search_matches_lower_bound (matches, row);
+			while (i < matches->len &&
+			        search_match_compare (&g_array_index (matches, TerminalSearchMatch, i), row, column) <= 0)
+				++i;
+
+			if (i == matches->len && vte_terminal_search_get_wrap_around (terminal))
+				i = 0;
+		}
+
+		if (i < matches->len)
+		{
+			priv->search_has_current = TRUE;
+			priv->search_current_row = g_array_index (matches, TerminalSearchMatch, i).row;
+			priv->search_current_column = g_array_index (matches, TerminalSearchMatch, i).column;
+		}
+	}
+
+	g_signal_emit (screen, signals[SEARCH_MATCHES_CHANGED], 0);
+}
+
+static gboolean
+terminal_screen_draw (GtkWidget *widget,
+                      cairo_t   *cr)
+{
+	TerminalScreen *screen = TERMINAL_SCREEN (widget);
+	TerminalScreenPrivate *priv = screen->priv;
+	VteTerminal *terminal = VTE_TERMINAL (widget);
+	GArray *matches = priv->search_matches;
+	GtkStyleContext *context;
+	GtkBorder padding;
+	GdkRGBA color;
+	glong top, bottom, columns;
+	int char_width, char_height;
+	guint i;
+
+	GTK_WIDGET_CLASS (terminal_screen_parent_class)->draw (widget, cr);
+
+	if (priv->search_regex == NULL || matches->len == 0)
+		return FALSE;
+
+	/* VteTerminal can't highlight text by itself, so the matches in view
+	 * are painted over it.
+	 */
+	context = gtk_widget_get_style_context (widget);
+	gtk_style_context_get_padding (context, gtk_widget_get_state_flags (widget), &padding);
+	if (!gtk_style_context_lookup_color (context, "theme_selected_bg_color", &color))
+		gdk_rgba_parse (&color, "#f5c211");
+	color.alpha = SEARCH_HIGHLIGHT_ALPHA;
+
+	top = (glong) gtk_adjustment_get_value (gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (widget)));
+	bottom = top + vte_terminal_get_row_count (terminal);
+	columns = vte_terminal_get_column_count (terminal);
+	char_width = vte_terminal_get_char_width (terminal);
+	char_height = vte_terminal_get_char_height (terminal);
+
+	/* A match that starts above the view may end in it */
+	i = search_matches_lower_bound (matches, top);
+	if (i > 0 && g_array_index (matches, TerminalSearchMatch, i - 1).end_row >= top)
+		--i;
+
+	cairo_save (cr);
+	gdk_cairo_set_source_rgba (cr, &color);
+
+	for (; i < matches->len; ++i)
+	{
+		const TerminalSearchMatch *match = &g_array_index (matches, TerminalSearchMatch, i);
+		glong row;
+
+		if (match->row >= bottom)
+			break;
+
+		for (row = MAX (match->row, top); row <= match->end_row && row < bottom; ++row)
+		{
+			glong first = row == match->row ? match->column : 0;
+			glong last = row == match->end_row ? match->end_column : columns - 1;
+
+			cairo_rectangle (cr,
+			                 padding.left + first * char_width,
+			                 padding.top + (row - top) * char_height,
+			                 (last - first + 1) * char_width,
+			                 char_height);
+		}
+	}
+
+	cairo_fill (cr);
+	cairo_restore (cr);
+
+	return FALSE;
+}
+
 #ifdef ENABLE_SKEY
 static void
 terminal_screen_skey_match_remove (TerminalScreen *screen)
@@ -37,6 +37,22 @@ typedef enum
     FLAVOR_SKEY
 } TerminalURLFlavour;
 
+/* A rough estimate of what one cell of scrollback costs VTE, text and
+ * attributes included; VTE doesn't report its memory use.
+ */
+#define TERMINAL_SCREEN_SCROLLBACK_BYTES_PER_CELL (4)
+
+typedef struct
+{
+    glong scrollback_lines;
+    gint64 scrollback_size; /* estimated, in bytes */
+    guint64 lines_received;
+    guint64 cells_received; /* how far the cursor moved, not bytes */
+    guint64 bytes_sent;
+    gint64 last_activity; /* monotonic time of the last output or input */
+    gboolean hibernating;
+} TerminalScreenStats;
+
 /* Forward decls */
 typedef struct _TerminalScreenPopupInfo TerminalScreenPopupInfo;
 typedef struct _TerminalWindow        TerminalWindow;
@@ -72,6 +88,8 @@ struct _TerminalScreenClass
 	                             int flavour,
 	                             guint state);
 	void (* close_screen)       (TerminalScreen *screen);
+	void (* search_matches_changed) (TerminalScreen *screen);
+	void (* wake_scrollback)    (TerminalScreen *screen);
 };
 
 GType terminal_screen_get_type (void) G_GNUC_CONST;
@@ -120,12 +138,49 @@ double      terminal_screen_get_font_scale    (TerminalScreen *screen);
 void       terminal_screen_get_size (TerminalScreen *screen,
                                      int *width_chars,
                                      int *height_chars);
+void       terminal_screen_set_size (TerminalScreen *screen,
+                                     int width_chars,
+                                     int height_chars);
 void       terminal_screen_get_cell_size (TerminalScreen *screen,
         int *width_chars,
         int *height_chars);
 
+void       terminal_screen_get_colors (TerminalScreen *screen,
+                                       GdkRGBA        *foreground,
+                                       GdkRGBA        *background);
+
+void       terminal_screen_set_scrollback_budget (TerminalScreen *screen,
+                                                  glong           lines);
+glong      terminal_screen_get_scrollback_usage  (TerminalScreen *screen);
+gint64     terminal_screen_get_last_viewed       (TerminalScreen *screen);
+
+void       terminal_screen_maybe_hibernate (TerminalScreen *screen,
+                                            gint64          idle_usec);
+void       terminal_screen_wake_scrollback_async  (TerminalScreen      *screen,
+                                                   GCancellable        *cancellable,
+                                                   GAsyncReadyCallback  callback,
+                                                   gpointer             user_data);
+gboolean   terminal_screen_wake_scrollback_finish (TerminalScreen      *screen,
+                                                   GAsyncResult        *result,
+                                                   GError             **error);
+
+void       terminal_screen_get_stats (TerminalScreen      *screen,
+                                      TerminalScreenStats *stats);
+
 void _terminal_screen_update_scrollbar (TerminalScreen *screen);
 
+void     terminal_screen_set_search_highlight (TerminalScreen *screen,
+        GRegex         *regex);
+gboolean terminal_screen_get_search_match_count (TerminalScreen *screen,
+        guint          *position,
+        guint          *count,
+        gboolean       *complete);
+void     terminal_screen_set_search_current (TerminalScreen *screen,
+        glong           row,
+        glong           column);
+void     terminal_screen_search_find (TerminalScreen *screen,
+                                      gboolean        backwards);
+
 void terminal_screen_save_config (TerminalScreen *screen,
                                   GKeyFile *key_file,
                                   const char *group);
@@ -23,6 +23,7 @@
 
 #include <string.h>
 
+#include "terminal-intl.h"
 #include "terminal-search-dialog.h"
 #include "terminal-util.h"
 
@@ -32,6 +33,20 @@
 #define HISTORY_MIN_ITEM_LEN 3
 #define HISTORY_LENGTH 10
 
+#define REGEX_CACHE_SIZE 8
+
+/* How long to wait after the last keystroke before searching */
+#define SEARCH_AS_YOU_TYPE_DELAY 150
+
+enum
+{
+    RESULT_COLUMN_SCREEN,
+    RESULT_COLUMN_ROW,
+    RESULT_COLUMN_TAB,
+    RESULT_COLUMN_TEXT,
+    RESULT_N_COLUMNS
+};
+
 static GQuark
 get_quark (void)
 {
@@ -58,15 +73,30 @@ typedef struct _TerminalSearchDialogPrivate
 	GtkWidget *regex_checkbutton;
 	GtkWidget *backwards_checkbutton;
 	GtkWidget *wrap_around_checkbutton;
+	GtkWidget *all_tabs_checkbutton;
+	GtkWidget *match_count_label;
+	GtkWidget *results_scrolled_window;
+	GtkWidget *results_view;
+
+	GtkListStore *results_store;
 
 	GtkListStore *store;
 	GtkEntryCompletion *completion;
 
-	/* Cached regex */
-	VteRegex *regex;
-	guint32 regex_compile_flags;
+	/* Compiled regexes, most recently used first */
+	GQueue regex_cache;
+
+	guint search_as_you_type_id;
 } TerminalSearchDialogPrivate;
 
+typedef struct
+{
+	char *pattern;
+	guint32 compile_flags;
+	VteRegex *regex;
+	GRegex *scan_regex; /* the same for searching text ourselves, created on demand */
+} RegexCacheEntry;
+
 static void update_sensitivity (void *unused,
                                 GtkWidget *dialog);
 static void response_handler (GtkWidget *dialog,
@@ -74,6 +104,94 @@ static void response_handler (GtkWidget *dialog,
                               gpointer   data);
 static void terminal_search_dialog_private_destroy (TerminalSearchDialogPrivate *priv);
 
+static void
+results_row_activated_cb (GtkTreeView       *view,
+                          GtkTreePath       *path,
+                          GtkTreeViewColumn *column,
+                          GtkWidget         *dialog)
+{
+	gtk_dialog_response (GTK_DIALOG (dialog), TERMINAL_SEARCH_DIALOG_RESPONSE_ACTIVATE_RESULT);
+}
+
+static void
+all_tabs_toggled_cb (GtkToggleButton *button,
+                     GtkWidget       *dialog)
+{
+	TerminalSearchDialogPrivate *priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	gboolean all_tabs;
+
+	all_tabs = gtk_toggle_button_get_active (button);
+
+	/* All tabs are always searched top to bottom */
+	gtk_widget_set_sensitive (priv->backwards_checkbutton, !all_tabs);
+	gtk_widget_set_sensitive (priv->wrap_around_checkbutton, !all_tabs);
+
+	gtk_widget_set_visible (priv->results_scrolled_window, all_tabs);
+	gtk_window_set_resizable (GTK_WINDOW (dialog), all_tabs);
+
+	terminal_search_dialog_clear_match_count (dialog);
+	update_sensitivity (NULL, dialog);
+}
+
+static void
+regex_cache_entry_free (RegexCacheEntry *entry)
+{
+	g_free (entry->pattern);
+	vte_regex_unref (entry->regex);
+	if (entry->scan_regex)
+		g_regex_unref (entry->scan_regex);
+	g_slice_free (RegexCacheEntry, entry);
+}
+
+static RegexCacheEntry *
+regex_cache_lookup (TerminalSearchDialogPrivate *priv,
+                    const char                  *pattern,
+                    guint32                      compile_flags)
+{
+	RegexCacheEntry *entry;
+	GList *l;
+	GError *error = NULL;
+	VteRegex *regex;
+
+	for (l = priv->regex_cache.head; l != NULL; l = l->next)
+	{
+		entry = l->data;
+
+		if (entry->compile_flags != compile_flags ||
+		        strcmp (entry->pattern, pattern) != 0)
+			continue;
+
+		/* Move it to the front */
+		g_queue_unlink (&priv->regex_cache, l);
+		g_queue_push_head_link (&priv->regex_cache, l);
+
+		return entry;
+	}
+
+	/* TODO Error handling */
+	regex = vte_regex_new_for_search (pattern, -1, compile_flags, NULL);
+	if (regex == NULL)
+		return NULL;
+
+	/* Not all architectures have a JIT; the regex works without it */
+	if (!vte_regex_jit (regex, PCRE2_JIT_COMPLETE, &error))
+	{
+		g_debug ("Failed to JIT the search regex: %s", error->message);
+		g_error_free (error);
+	}
+
+	entry = g_slice_new0 (RegexCacheEntry);
+	entry->pattern = g_strdup (pattern);
+	entry->compile_flags = compile_flags;
+	entry->regex = regex;
+	g_queue_push_head (&priv->regex_cache, entry);
+
+	if (priv->regex_cache.length > REGEX_CACHE_SIZE)
+		regex_cache_entry_free (g_queue_pop_tail (&priv->regex_cache));
+
+	return entry;
+}
+
 GtkWidget *
 terminal_search_dialog_new (GtkWindow   *parent)
 {
@@ -81,8 +199,11 @@ terminal_search_dialog_new (GtkWindow   *parent)
 	TerminalSearchDialogPrivate *priv;
 	GtkListStore *store;
 	GtkEntryCompletion *completion;
+	GtkCellRenderer *renderer;
+	GtkTreeViewColumn *column;
 
 	priv = g_new0 (TerminalSearchDialogPrivate, 1);
+	g_queue_init (&priv->regex_cache);
 
 	if (!terminal_util_load_builder_resource (TERMINAL_RESOURCES_PATH_PREFIX G_DIR_SEPARATOR_S "ui/find-dialog.ui",
 	                                      "find-dialog", &dialog,
@@ -93,6 +214,10 @@ terminal_search_dialog_new (GtkWindow   *parent)
 	                                      "regex-checkbutton", &priv->regex_checkbutton,
 	                                      "search-backwards-checkbutton", &priv->backwards_checkbutton,
 	                                      "wrap-around-checkbutton", &priv->wrap_around_checkbutton,
+	                                      "all-tabs-checkbutton", &priv->all_tabs_checkbutton,
+	                                      "match-count-label", &priv->match_count_label,
+	                                      "results-scrolled-window", &priv->results_scrolled_window,
+	                                      "results-view", &priv->results_view,
 	                                      NULL))
 	{
 		g_free (priv);
@@ -119,12 +244,38 @@ terminal_search_dialog_new (GtkWindow   *parent)
 	gtk_entry_completion_set_inline_completion (completion, TRUE);
 	gtk_entry_set_completion (GTK_ENTRY (priv->search_text_entry), completion);
 
+	priv->results_store = gtk_list_store_new (RESULT_N_COLUMNS,
+	                                          G_TYPE_POINTER,
+	                                          G_TYPE_LONG,
+	                                          G_TYPE_STRING,
+	                                          G_TYPE_STRING);
+	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->results_view), GTK_TREE_MODEL (priv->results_store));
+
+	renderer = gtk_cell_renderer_text_new ();
+	column = gtk_tree_view_column_new_with_attributes (NULL, renderer,
+	                                                   "text", RESULT_COLUMN_TAB,
+	                                                   NULL);
+	gtk_tree_view_append_column (GTK_TREE_VIEW (priv->results_view), column);
+
+	renderer = gtk_cell_renderer_text_new ();
+	g_object_set (renderer, "ellipsize", PANGO_ELLIPSIZE_END, "family", "Monospace", NULL);
+	column = gtk_tree_view_column_new_with_attributes (NULL, renderer,
+	                                                   "text", RESULT_COLUMN_TEXT,
+	                                                   NULL);
+	gtk_tree_view_column_set_expand (column, TRUE);
+	gtk_tree_view_append_column (GTK_TREE_VIEW (priv->results_view), column);
+
+	g_signal_connect (priv->results_view, "row-activated", G_CALLBACK (results_row_activated_cb), dialog);
+	g_signal_connect (priv->all_tabs_checkbutton, "toggled", G_CALLBACK (all_tabs_toggled_cb), dialog);
+
 	gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_ACCEPT);
 	gtk_dialog_set_response_sensitive (GTK_DIALOG (dialog), GTK_RESPONSE_ACCEPT, FALSE);
 
 	gtk_entry_set_activates_default (GTK_ENTRY (priv->search_text_entry), TRUE);
 	g_signal_connect (priv->search_text_entry, "changed", G_CALLBACK (update_sensitivity), dialog);
 	g_signal_connect (priv->regex_checkbutton, "toggled", G_CALLBACK (update_sensitivity), dialog);
+	g_signal_connect (priv->match_case_checkbutton, "toggled", G_CALLBACK (update_sensitivity), dialog);
+	g_signal_connect (priv->entire_word_checkbutton, "toggled", G_CALLBACK (update_sensitivity), dialog);
 
 	g_signal_connect (dialog, "response", G_CALLBACK (response_handler), NULL);
 
@@ -151,16 +302,32 @@ terminal_search_dialog_present (GtkWidget *dialog)
 static void
 terminal_search_dialog_private_destroy (TerminalSearchDialogPrivate *priv)
 {
+	if (priv->search_as_you_type_id != 0)
+		g_source_remove (priv->search_as_you_type_id);
 
-	if (priv->regex)
-		vte_regex_unref (priv->regex);
+	g_queue_foreach (&priv->regex_cache, (GFunc) regex_cache_entry_free, NULL);
+	g_queue_clear (&priv->regex_cache);
 
 	g_object_unref (priv->store);
 	g_object_unref (priv->completion);
+	g_object_unref (priv->results_store);
 
 	g_free (priv);
 }
 
+static gboolean
+search_as_you_type_timeout_cb (GtkWidget *dialog)
+{
+	TerminalSearchDialogPrivate *priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+
+	priv->search_as_you_type_id = 0;
+
+	if (gtk_widget_get_visible (dialog))
+		gtk_dialog_response (GTK_DIALOG (dialog), TERMINAL_SEARCH_DIALOG_RESPONSE_INCREMENTAL);
+
+	return FALSE;
+}
+
 static void
 update_sensitivity (void *unused, GtkWidget *dialog)
 {
@@ -168,12 +335,6 @@ update_sensitivity (void *unused, GtkWidget *dialog)
 	const gchar *search_string;
 	gboolean valid;
 
-	if (priv->regex)
-	{
-		vte_regex_unref (priv->regex);
-		priv->regex = NULL;
-	}
-
 	search_string = gtk_entry_get_text (GTK_ENTRY (priv->search_text_entry));
 	g_return_if_fail (search_string != NULL);
 
@@ -187,6 +348,21 @@ update_sensitivity (void *unused, GtkWidget *dialog)
 	}
 
 	gtk_dialog_set_response_sensitive (GTK_DIALOG (dialog), GTK_RESPONSE_ACCEPT, valid);
+
+	/* Search as you type, once the typing pauses */
+	if (priv->search_as_you_type_id != 0)
+	{
+		g_source_remove (priv->search_as_you_type_id);
+		priv->search_as_you_type_id = 0;
+	}
+
+	/* Searching every tab on each keystroke would be too much */
+	if (valid && !GET_FLAG (all_tabs_checkbutton))
+		priv->search_as_you_type_id = g_timeout_add (SEARCH_AS_YOU_TYPE_DELAY,
+		                                             (GSourceFunc) search_as_you_type_timeout_cb,
+		                                             dialog);
+	else
+		terminal_search_dialog_clear_match_count (dialog);
 }
 
 static gboolean
@@ -269,14 +445,24 @@ response_handler (GtkWidget *dialog,
 	TerminalSearchDialogPrivate *priv;
 	const gchar *str;
 
+	if (response_id == TERMINAL_SEARCH_DIALOG_RESPONSE_INCREMENTAL ||
+	        response_id == TERMINAL_SEARCH_DIALOG_RESPONSE_ACTIVATE_RESULT)
+		return;
+
+	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+
+	if (priv->search_as_you_type_id != 0)
+	{
+		g_source_remove (priv->search_as_you_type_id);
+		priv->search_as_you_type_id = 0;
+	}
+
 	if (response_id != GTK_RESPONSE_ACCEPT)
 	{
 		gtk_widget_hide (dialog);
 		return;
 	}
 
-	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
-
 	str = gtk_entry_get_text (GTK_ENTRY (priv->search_text_entry));
 	if (*str != '\0')
 		history_entry_insert (priv->store, str);
@@ -331,17 +517,19 @@ terminal_search_dialog_get_search_flags (GtkWidget *dialog)
 	if (GET_FLAG (wrap_around_checkbutton))
 		flags |= TERMINAL_SEARCH_FLAG_WRAP_AROUND;
 
+	if (GET_FLAG (all_tabs_checkbutton))
+		flags |= TERMINAL_SEARCH_FLAG_ALL_TABS;
+
 	return flags;
 }
 
-VteRegex *
-terminal_search_dialog_get_regex (GtkWidget *dialog)
+static RegexCacheEntry *
+get_regex_entry (GtkWidget *dialog)
 {
 	TerminalSearchDialogPrivate *priv;
 	guint32 compile_flags;
 	const char *text, *pattern;
-
-	g_return_val_if_fail (GTK_IS_DIALOG (dialog), NULL);
+	RegexCacheEntry *entry;
 
 	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
 	g_return_val_if_fail (priv, NULL);
@@ -366,21 +554,219 @@ terminal_search_dialog_get_regex (GtkWidget *dialog)
 			g_free ((char *) old_pattern);
 	}
 
-	if (!priv->regex || priv->regex_compile_flags != compile_flags)
-	{
-		priv->regex_compile_flags = compile_flags;
-		if (priv->regex)
-			vte_regex_unref (priv->regex);
+	entry = regex_cache_lookup (priv, pattern, compile_flags);
+
+	if (pattern != text)
+		g_free ((char *) pattern);
+
+	return entry;
+}
+
+VteRegex *
+terminal_search_dialog_get_regex (GtkWidget *dialog)
+{
+	RegexCacheEntry *entry;
+
+	g_return_val_if_fail (GTK_IS_DIALOG (dialog), NULL);
+
+	entry = get_regex_entry (dialog);
 
-		/* TODO Error handling */
-		priv->regex = vte_regex_new_for_search(pattern, -1,
-						       compile_flags, NULL);
+	return entry ? entry->regex : NULL;
+}
+
+/**
+ * terminal_search_dialog_get_scan_regex:
+ * @dialog:
+ *
+ * Returns: a #GRegex matching the same text as the regex returned by
+ *   terminal_search_dialog_get_regex(), for searching text that isn't
+ *   in a #VteTerminal's own search, or %NULL if the pattern is invalid
+ */
+GRegex *
+terminal_search_dialog_get_scan_regex (GtkWidget *dialog)
+{
+	RegexCacheEntry *entry;
+	GRegexCompileFlags flags;
+
+	g_return_val_if_fail (GTK_IS_DIALOG (dialog), NULL);
+
+	entry = get_regex_entry (dialog);
+	if (entry == NULL)
+		return NULL;
 
+	if (entry->scan_regex == NULL)
+	{
+		flags = G_REGEX_MULTILINE | G_REGEX_OPTIMIZE;
+		if (entry->compile_flags & PCRE2_CASELESS)
+			flags |= G_REGEX_CASELESS;
+
+		entry->scan_regex = g_regex_new (entry->pattern, flags, 0, NULL);
 	}
 
-	if (pattern != text)
-		g_free ((char *) pattern);
+	return entry->scan_regex;
+}
+
+/**
+ * terminal_search_dialog_set_match_count:
+ * @dialog:
+ * @position: the 1-based index of the current match, or 0 if unknown
+ * @count: the number of matches
+ * @complete: whether @count is final, or a lower bound while the
+ *   search is still running
+ */
+void
+terminal_search_dialog_set_match_count (GtkWidget *dialog,
+                                        guint      position,
+                                        guint      count,
+                                        gboolean   complete)
+{
+	TerminalSearchDialogPrivate *priv;
+	char *text;
+
+	g_return_if_fail (GTK_IS_DIALOG (dialog));
+
+	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	g_return_if_fail (priv);
+
+	if (count == 0)
+		text = g_strdup (complete ? _("No matches") : _("Searching…"));
+	else if (position > 0 && complete)
+		text = g_strdup_printf (ngettext ("%u of %u match", "%u of %u matches", count),
+		                        position, count);
+	else if (position > 0)
+		text = g_strdup_printf (ngettext ("%u of at least %u match", "%u of at least %u matches", count),
+		                        position, count);
+	else if (complete)
+		text = g_strdup_printf (ngettext ("%u match", "%u matches", count), count);
+	else
+		text = g_strdup_printf (ngettext ("At least %u match", "At least %u matches", count), count);
 
-	return priv->regex;
+	gtk_label_set_text (GTK_LABEL (priv->match_count_label), text);
+	g_free (text);
 }
 
+void
+terminal_search_dialog_clear_match_count (GtkWidget *dialog)
+{
+	TerminalSearchDialogPrivate *priv;
+
+	g_return_if_fail (GTK_IS_DIALOG (dialog));
+
+	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	g_return_if_fail (priv);
+
+	gtk_label_set_text (GTK_LABEL (priv->match_count_label), "");
+}
+
+void
+terminal_search_dialog_clear_results (GtkWidget *dialog)
+{
+	TerminalSearchDialogPrivate *priv;
+
+	g_return_if_fail (GTK_IS_DIALOG (dialog));
+
+	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	g_return_if_fail (priv);
+
+	gtk_list_store_clear (priv->results_store);
+}
+
+/**
+ * terminal_search_dialog_add_result:
+ * @dialog:
+ * @screen: the screen the match is in
+ * @row: the row of the match
+ * @tab_title: the title of the tab the match is in
+ * @text: the text of the row
+ *
+ * Appends a match to the list of results of a search of all tabs.
+ */
+void
+terminal_search_dialog_add_result (GtkWidget  *dialog,
+                                   gpointer    screen,
+                                   glong       row,
+                                   const char *tab_title,
+                                   const char *text)
+{
+	TerminalSearchDialogPrivate *priv;
+
+	g_return_if_fail (GTK_IS_DIALOG (dialog));
+
+	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	g_return_if_fail (priv);
+
+	gtk_list_store_insert_with_values (priv->results_store, NULL, -1,
+	                                   RESULT_COLUMN_SCREEN, screen,
+	                                   RESULT_COLUMN_ROW, row,
+	                                   RESULT_COLUMN_TAB, tab_title,
+	                                   RESULT_COLUMN_TEXT, text,
+	                                   -1);
+}
+
+/**
+ * terminal_search_dialog_remove_results:
+ * @dialog:
+ * @screen:
+ *
+ * Removes the results in @screen, e.g. because its tab was closed.
+ */
+void
+terminal_search_dialog_remove_results (GtkWidget *dialog,
+                                       gpointer   screen)
+{
+	TerminalSearchDialogPrivate *priv;
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+	gboolean valid;
+
+	g_return_if_fail (GTK_IS_DIALOG (dialog));
+
+	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	g_return_if_fail (priv);
+
+	model = GTK_TREE_MODEL (priv->results_store);
+	valid = gtk_tree_model_get_iter_first (model, &iter);
+	while (valid)
+	{
+		gpointer result_screen;
+
+		gtk_tree_model_get (model, &iter, RESULT_COLUMN_SCREEN, &result_screen, -1);
+		if (result_screen == screen)
+			valid = gtk_list_store_remove (priv->results_store, &iter);
+		else
+			valid = gtk_tree_model_iter_next (model, &iter);
+	}
+}
+
+/**
+ * terminal_search_dialog_get_selected_result:
+ * @dialog:
+ * @screen: (out): the screen of the selected result
+ * @row: (out): the row of the selected result
+ *
+ * Returns: %TRUE if a result is selected
+ */
+gboolean
+terminal_search_dialog_get_selected_result (GtkWidget *dialog,
+                                            gpointer  *screen,
+                                            glong     *row)
+{
+	TerminalSearchDialogPrivate *priv;
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+
+	g_return_val_if_fail (GTK_IS_DIALOG (dialog), FALSE);
+
+	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	g_return_val_if_fail (priv, FALSE);
+
+	if (!gtk_tree_selection_get_selected (gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->results_view)),
+	                                      &model, &iter))
+		return FALSE;
+
+	gtk_tree_model_get (model, &iter,
+	                    RESULT_COLUMN_SCREEN, screen,
+	                    RESULT_COLUMN_ROW, row,
+	                    -1);
+	return TRUE;
+}
@@ -27,10 +27,16 @@
 
 G_BEGIN_DECLS
 
+/* Response emitted while the search text is being typed */
+#define TERMINAL_SEARCH_DIALOG_RESPONSE_INCREMENTAL (1)
+/* Response emitted when a result of a search of all tabs is activated */
+#define TERMINAL_SEARCH_DIALOG_RESPONSE_ACTIVATE_RESULT (2)
+
 typedef enum _TerminalSearchFlags
 {
     TERMINAL_SEARCH_FLAG_BACKWARDS	= 1 << 0,
-    TERMINAL_SEARCH_FLAG_WRAP_AROUND	= 1 << 1
+    TERMINAL_SEARCH_FLAG_WRAP_AROUND	= 1 << 1,
+    TERMINAL_SEARCH_FLAG_ALL_TABS	= 1 << 2
 } TerminalSearchFlags;
 
 GtkWidget	*terminal_search_dialog_new		(GtkWindow   *parent);
@@ -45,6 +51,25 @@ const gchar 	*terminal_search_dialog_get_search_text	(GtkWidget   *dialog);
 TerminalSearchFlags
 terminal_search_dialog_get_search_flags(GtkWidget   *dialog);
 VteRegex	*terminal_search_dialog_get_regex	(GtkWidget   *dialog);
+GRegex		*terminal_search_dialog_get_scan_regex	(GtkWidget   *dialog);
+
+void		 terminal_search_dialog_set_match_count	(GtkWidget   *dialog,
+        guint        position,
+        guint        count,
+        gboolean     complete);
+void		 terminal_search_dialog_clear_match_count (GtkWidget *dialog);
+
+void		 terminal_search_dialog_clear_results	(GtkWidget   *dialog);
+void		 terminal_search_dialog_add_result	(GtkWidget   *dialog,
+        gpointer     screen,
+        glong        row,
+        const char  *tab_title,
+        const char  *text);
+void		 terminal_search_dialog_remove_results	(GtkWidget   *dialog,
+        gpointer     screen);
+gboolean	 terminal_search_dialog_get_selected_result (GtkWidget *dialog,
+        gpointer    *screen,
+        glong       *row);
 
 G_END_DECLS
 
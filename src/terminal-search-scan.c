@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include "terminal-debug.h"
+#include "terminal-search-scan.h"
+
+/* VteTerminal can only search synchronously, which blocks the UI for as
+ * long as it takes to get through the scrollback. A scan instead fetches
+ * the text a few rows at a time from an idle handler and gives the main
+ * loop back after SCAN_SLICE_USEC, so input and drawing go on while it
+ * runs.
+ *
+ * Matches can't span chunks; CHUNK_ROWS is large enough that this only
+ * matters for multi-line patterns.
+ */
+#define CHUNK_ROWS (256)
+#define SCAN_SLICE_USEC (4000)
+
+struct _TerminalSearchScan
+{
+	VteTerminal *terminal;
+	GRegex *regex;
+
+	glong start_row;
+	gboolean backwards;
+	gboolean wrap_around;
+	gboolean wrapped;
+
+	/* Forwards: the next row to scan. Backwards: one past it. */
+	glong row;
+
+	guint idle_id;
+
+	TerminalSearchScanMatchFunc match_func;
+	TerminalSearchScanDoneFunc done_func;
+	gpointer user_data;
+};
+
+static void
+terminal_search_scan_free (TerminalSearchScan *scan)
+{
+	if (scan->idle_id != 0)
+		g_source_remove (scan->idle_id);
+
+	g_object_unref (scan->terminal);
+	g_regex_unref (scan->regex);
+	g_slice_free (TerminalSearchScan, scan);
+}
+
+static void
+get_row_bounds (TerminalSearchScan *scan,
+                glong              *lower,
+                glong              *upper)
+{
+	GtkAdjustment *adjustment;
+
+	adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (scan->terminal));
+	*lower = (glong) gtk_adjustment_get_lower (adjustment);
+	*upper = (glong) gtk_adjustment_get_upper (adjustment);
+}
+
+/* Scans the rows [first, last) and appends the matches to @matches.
+ * Returns FALSE if the text couldn't be fetched.
+ */
+static gboolean
+scan_chunk (TerminalSearchScan *scan,
+            glong               first,
+            glong               last,
+            GArray             *matches)
+{
+	GArray *attributes;
+	GMatchInfo *match_info;
+	char *text;
+
+	attributes = g_array_new (FALSE, FALSE, sizeof (VteCharAttributes));
+	text = vte_terminal_get_text_range (scan->terminal,
+	                                    first, 0,
+	                                    last - 1, vte_terminal_get_column_count (scan->terminal) - 1,
+	                                    NULL, NULL, attributes);
+	if (text == NULL)
+	{
+		g_array_free (attributes, TRUE);
+		return FALSE;
+	}
+
+	/* The attributes have one entry per byte of text */
+	g_regex_match (scan->regex, text, 0, &match_info);
+	while (g_match_info_matches (match_info))
+	{
+		int start, end;
+
+		if (g_match_info_fetch_pos (match_info, 0, &start, &end) &&
+		        end > start &&
+		        (guint) end <= attributes->len)
+		{
+			VteCharAttributes *attr;
+			TerminalSearchMatch match;
+
+			attr = &g_array_index (attributes, VteCharAttributes, start);
+			match.row = attr->row;
+			match.column = attr->column;
+
+			/* The attribute gives the first cell of the last character */
+			attr = &g_array_index (attributes, VteCharAttributes, end - 1);
+			match.end_row = attr->row;
+			match.end_column = attr->column;
+			if (g_unichar_iswide (g_utf8_get_char (g_utf8_find_prev_char (text, text + end))))
+				match.end_column++;
+
+			g_array_append_val (matches, match);
+		}
+
+		g_match_info_next (match_info, NULL);
+	}
+	g_match_info_free (match_info);
+
+	g_free (text);
+	g_array_free (attributes, TRUE);
+
+	return TRUE;
+}
+
+/* Returns FALSE when the scan is complete */
+static gboolean
+scan_next_chunk (TerminalSearchScan *scan,
+                 GArray             *matches)
+{
+	glong lower, upper, first, last, stop;
+
+	get_row_bounds (scan, &lower, &upper);
+
+	if (!scan->backwards)
+	{
+		/* Rows scrolled out of the history meanwhile are gone */
+		scan->row = MAX (scan->row, lower);
+		stop = scan->wrapped ? MIN (scan->start_row, upper) : upper;
+
+		if (scan->row >= stop)
+		{
+			if (scan->wrapped || !scan->wrap_around)
+				return FALSE;
+
+			scan->wrapped = TRUE;
+			scan->row = lower;
+			return TRUE;
+		}
+
+		first = scan->row;
+		last = MIN (first + CHUNK_ROWS, stop);
+		scan->row = last;
+	}
+	else
+	{
+		scan->row = MIN (scan->row, upper);
+		stop = scan->wrapped ? MAX (scan->start_row + 1, lower) : lower;
+
+		if (scan->row <= stop)
+		{
+			if (scan->wrapped || !scan->wrap_around)
+				return FALSE;
+
+			scan->wrapped = TRUE;
+			scan->row = upper;
+			return TRUE;
+		}
+
+		last = scan->row;
+		first = MAX (last - CHUNK_ROWS, stop);
+		scan->row = first;
+	}
+
+	return scan_chunk (scan, first, last, matches);
+}
+
+static gboolean
+terminal_search_scan_idle_cb (TerminalSearchScan *scan)
+{
+	GArray *matches;
+	gint64 deadline;
+	gboolean running = TRUE;
+
+	matches = g_array_new (FALSE, FALSE, sizeof (TerminalSearchMatch));
+	deadline = g_get_monotonic_time () + SCAN_SLICE_USEC;
+
+	do
+	{
+		guint i;
+
+		if (gtk_widget_in_destruction (GTK_WIDGET (scan->terminal)))
+		{
+			running = FALSE;
+			break;
+		}
+
+		g_array_set_size (matches, 0);
+		running = scan_next_chunk (scan, matches);
+
+		for (i = 0; running && i < matches->len; ++i)
+		{
+			TerminalSearchMatch *match;
+
+			/* Report the matches in the direction of the scan */
+			match = &g_array_index (matches, TerminalSearchMatch,
+			                        scan->backwards ? matches->len - 1 - i : i);
+
+			running = scan->match_func (scan, match, scan->user_data);
+		}
+	}
+	while (running && g_get_monotonic_time () < deadline);
+
+	g_array_free (matches, TRUE);
+
+	if (running)
+		return G_SOURCE_CONTINUE;
+
+	_terminal_debug_print (TERMINAL_DEBUG_SEARCH,
+	                       "[terminal %p] search scan %p done at row %ld\n",
+	                       scan->terminal, scan, scan->row);
+
+	scan->idle_id = 0;
+	if (scan->done_func)
+		scan->done_func (scan, scan->user_data);
+	terminal_search_scan_free (scan);
+
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * terminal_search_scan_new:
+ * @terminal: the terminal to search
+ * @regex: the regex to search for
+ * @start_row: the row to start at
+ * @backwards: whether to scan towards the top
+ * @wrap_around: whether to continue at the other end and scan up to
+ *   @start_row once the end of the scrollback is reached
+ * @match_func: called for each match
+ * @done_func: (allow-none): called when the scan is complete
+ * @user_data: data for the callbacks
+ *
+ * Starts scanning the scrollback of @terminal for @regex in time-sliced
+ * idle chunks. A forward scan without @wrap_around also covers any
+ * output that arrives while it runs.
+ *
+ * Returns: the scan, which stays valid until it is done or cancelled
+ */
+TerminalSearchScan *
+terminal_search_scan_new (VteTerminal                 *terminal,
+                          GRegex                      *regex,
+                          glong                        start_row,
+                          gboolean                     backwards,
+                          gboolean                     wrap_around,
+                          TerminalSearchScanMatchFunc  match_func,
+                          TerminalSearchScanDoneFunc   done_func,
+                          gpointer                     user_data)
+{
+	TerminalSearchScan *scan;
+
+	g_return_val_if_fail (VTE_IS_TERMINAL (terminal), NULL);
+	g_return_val_if_fail (regex != NULL, NULL);
+	g_return_val_if_fail (match_func != NULL, NULL);
+
+	scan = g_slice_new0 (TerminalSearchScan);
+	scan->terminal = g_object_ref (terminal);
+	scan->regex = g_regex_ref (regex);
+	scan->start_row = start_row;
+	scan->backwards = backwards != FALSE;
+	scan->wrap_around = wrap_around != FALSE;
+	scan->row = backwards ? start_row + 1 : start_row;
+	scan->match_func = match_func;
+	scan->done_func = done_func;
+	scan->user_data = user_data;
+
+	/* Below redrawing, so a long scan can't hold up the frame */
+	scan->idle_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+	                                 (GSourceFunc) terminal_search_scan_idle_cb,
+	                                 scan, NULL);
+
+	_terminal_debug_print (TERMINAL_DEBUG_SEARCH,
+	                       "[terminal %p] search scan %p started at row %ld%s\n",
+	                       terminal, scan, start_row, backwards ? " backwards" : "");
+
+	return scan;
+}
+
+/**
+ * terminal_search_scan_cancel:
+ * @scan:
+ *
+ * Stops @scan and frees it, without calling its done function.
+ */
+void
+terminal_search_scan_cancel (TerminalSearchScan *scan)
+{
+	g_return_if_fail (scan != NULL);
+
+	terminal_search_scan_free (scan);
+}
+
+VteTerminal *
+terminal_search_scan_get_terminal (TerminalSearchScan *scan)
+{
+	return scan->terminal;
+}
+
+/**
+ * terminal_search_scan_get_row:
+ * @scan:
+ *
+ * Returns: the next row @scan will look at. In the done function of a
+ *   forward scan, this is where a later scan of new output can resume.
+ */
+glong
+terminal_search_scan_get_row (TerminalSearchScan *scan)
+{
+	return scan->row;
+}
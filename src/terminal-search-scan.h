@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TERMINAL_SEARCH_SCAN_H
+#define TERMINAL_SEARCH_SCAN_H
+
+#include <gtk/gtk.h>
+#include <vte/vte.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalSearchScan TerminalSearchScan;
+
+typedef struct
+{
+	glong row;
+	glong column;
+	glong end_row;
+	glong end_column; /* inclusive, the last cell of a wide character */
+} TerminalSearchMatch;
+
+/* Return FALSE to stop the scan; the done function is still called.
+ * A scan must not be cancelled from its own callbacks.
+ */
+typedef gboolean (* TerminalSearchScanMatchFunc) (TerminalSearchScan *scan,
+        const TerminalSearchMatch *match,
+        gpointer            user_data);
+
+/* Called once the scan finished or was stopped, but not when cancelled.
+ * The scan is freed right after this returns.
+ */
+typedef void (* TerminalSearchScanDoneFunc) (TerminalSearchScan *scan,
+        gpointer            user_data);
+
+TerminalSearchScan *terminal_search_scan_new (VteTerminal                 *terminal,
+        GRegex                      *regex,
+        glong                        start_row,
+        gboolean                     backwards,
+        gboolean                     wrap_around,
+        TerminalSearchScanMatchFunc  match_func,
+        TerminalSearchScanDoneFunc   done_func,
+        gpointer                     user_data);
+
+void terminal_search_scan_cancel (TerminalSearchScan *scan);
+
+VteTerminal *terminal_search_scan_get_terminal (TerminalSearchScan *scan);
+
+glong terminal_search_scan_get_row (TerminalSearchScan *scan);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_SEARCH_SCAN_H */
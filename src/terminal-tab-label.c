@@ -74,7 +74,83 @@ sync_tab_label (TerminalScreen *screen,
 
 	gtk_label_set_text (GTK_LABEL (label), title);
 
-	gtk_widget_set_tooltip_text (hbox, title);
+	/* Makes a tooltip that is already shown pick up the new title */
+	gtk_widget_trigger_tooltip_query (hbox);
+}
+
+static char *
+format_last_activity (gint64 last_activity)
+{
+	gint64 minutes;
+
+	minutes = (g_get_monotonic_time () - last_activity) / (60 * G_USEC_PER_SEC);
+
+	if (minutes < 1)
+		return g_strdup (_("Last activity: just now"));
+	if (minutes < 60)
+		return g_strdup_printf (ngettext ("Last activity: %d minute ago",
+		                                  "Last activity: %d minutes ago",
+		                                  (int) minutes),
+		                        (int) minutes);
+
+	return g_strdup_printf (ngettext ("Last activity: %d hour ago",
+	                                  "Last activity: %d hours ago",
+	                                  (int) (minutes / 60)),
+	                        (int) (minutes / 60));
+}
+
+/* The statistics change all the time, so they are only gathered when the
+ * tooltip is about to be shown.
+ */
+static gboolean
+query_tooltip_cb (GtkWidget        *widget,
+                  int               x,
+                  int               y,
+                  gboolean          keyboard_mode,
+                  GtkTooltip       *tooltip,
+                  TerminalTabLabel *tab_label)
+{
+	TerminalTabLabelPrivate *priv = tab_label->priv;
+	TerminalScreenStats stats;
+	GString *text;
+	char *size, *line;
+
+	if (priv->screen == NULL)
+		return FALSE;
+
+	terminal_screen_get_stats (priv->screen, &stats);
+
+	text = g_string_new (terminal_screen_get_title (priv->screen));
+
+	size = g_format_size (stats.scrollback_size);
+	g_string_append_c (text, '\n');
+	if (stats.hibernating)
+		g_string_append_printf (text, ngettext ("Scrollback: %ld line (about %s), more saved to disk",
+		                                        "Scrollback: %ld lines (about %s), more saved to disk",
+		                                        stats.scrollback_lines),
+		                        stats.scrollback_lines, size);
+	else
+		g_string_append_printf (text, ngettext ("Scrollback: %ld line (about %s)",
+		                                        "Scrollback: %ld lines (about %s)",
+		                                        stats.scrollback_lines),
+		                        stats.scrollback_lines, size);
+	g_free (size);
+
+	g_string_append_c (text, '\n');
+	g_string_append_printf (text, ngettext ("Received: %lu line",
+	                                        "Received: %lu lines",
+	                                        stats.lines_received),
+	                        (gulong) stats.lines_received);
+
+	line = format_last_activity (stats.last_activity);
+	g_string_append_c (text, '\n');
+	g_string_append (text, line);
+	g_free (line);
+
+	gtk_tooltip_set_text (tooltip, text->str);
+	g_string_free (text, TRUE);
+
+	return TRUE;
 }
 
 /* public functions */
@@ -132,6 +208,10 @@ terminal_tab_label_constructor (GType type,
 
 	gtk_box_pack_end (GTK_BOX (hbox), close_button, FALSE, FALSE, 0);
 
+	gtk_widget_set_has_tooltip (hbox, TRUE);
+	g_signal_connect (hbox, "query-tooltip",
+	                  G_CALLBACK (query_tooltip_cb), tab_label);
+
 	sync_tab_label (priv->screen, NULL, label);
 	g_signal_connect (priv->screen, "notify::title",
 	                  G_CALLBACK (sync_tab_label), label);
@@ -27,6 +27,7 @@
 #include <gtk/gtk.h>
 
 #include "terminal-tabs-menu.h"
+#include "terminal-debug.h"
 #include "terminal-screen.h"
 #include "terminal-screen-container.h"
 #include "terminal-intl.h"
@@ -45,12 +46,26 @@
 
 #define UI_PATH                         "/menubar/Tabs"
 
+/* Adding or removing a tab only touches its own menu item and the
+ * accelerators after it, so it should take about as long with 500 tabs
+ * as with 5. With MATE_TERMINAL_DEBUG=mdi each change prints how long it
+ * took; to check, open many tabs at once, e.g.
+ *
+ *   MATE_TERMINAL_DEBUG=mdi mate-terminal $(printf -- '--tab %.0s' $(seq 500))
+ *
+ * and compare the times of the first and the last tabs.
+ */
+
 struct _TerminalTabsMenuPrivate
 {
 	TerminalWindow *window;
 	GtkActionGroup *action_group;
 	GtkAction *anchor_action;
-	guint ui_id;
+	/* The tab actions, in notebook order */
+	GPtrArray *actions;
+	/* The Tabs menu and the number of items merged from the UI file */
+	GtkMenuShell *menu;
+	guint n_static_items;
 };
 
 enum
@@ -59,10 +74,15 @@ enum
     PROP_WINDOW
 };
 
-static void	terminal_tabs_menu_update		(TerminalTabsMenu *menu);
+static void	terminal_tabs_menu_insert_proxy	(TerminalTabsMenu *menu,
+							 GtkAction *action,
+							 guint position);
+static void	terminal_tabs_menu_update_accels	(TerminalTabsMenu *menu,
+							 guint first);
 
-/* FIXME: this can be severely optimised */
-static GByteArray *tabs_id_array = NULL;
+/* IDs freed by closed tabs, reused before new ones are handed out */
+static GArray *free_tab_ids = NULL;
+static guint next_tab_id = 0;
 static guint n_tabs = 0;
 
 G_DEFINE_TYPE_WITH_PRIVATE (TerminalTabsMenu, terminal_tabs_menu, G_TYPE_OBJECT)
@@ -70,50 +90,29 @@ G_DEFINE_TYPE_WITH_PRIVATE (TerminalTabsMenu, terminal_tabs_menu, G_TYPE_OBJECT)
 /* We need to assign unique IDs to tabs, otherwise accels get confused in the
  * tabs menu (bug #339548). We could use a serial #, but the ID is used in the
  * action name which is stored in a GQuark and so we should allocate them
- * efficiently.
+ * efficiently. Freed IDs are kept on a stack, so both allocating and freeing
+ * are O(1) and IDs never exceed the peak number of open tabs.
  */
 static guint
 allocate_tab_id (void)
 {
-	int bit;
-	guint b, len;
-	guint8 *data;
-	guint8 byte, mask;
+	guint id;
 
 	if (n_tabs++ == 0)
 	{
-		g_assert (tabs_id_array == NULL);
-		tabs_id_array = g_byte_array_sized_new (16);
-	}
-
-	/* Find a free ID */
-	len = tabs_id_array->len;
-	data = tabs_id_array->data;
-	for (b = 0; b < len; ++b)
-	{
-		if (data[b] != 0xff)
-			break;
+		g_assert (free_tab_ids == NULL);
+		free_tab_ids = g_array_sized_new (FALSE, FALSE, sizeof (guint), 16);
+		next_tab_id = 0;
 	}
 
-	/* Need to append a new byte */
-	if (b == len)
+	if (free_tab_ids->len > 0)
 	{
-		guint8 bytes[] = { 0 };
-		g_byte_array_append (tabs_id_array, bytes, G_N_ELEMENTS (bytes));
-		g_assert (tabs_id_array->len > b);
+		id = g_array_index (free_tab_ids, guint, free_tab_ids->len - 1);
+		g_array_set_size (free_tab_ids, free_tab_ids->len - 1);
+		return id;
 	}
 
-	data = tabs_id_array->data + b;
-	byte = 0xff ^ *data;
-	/* Now find the first free bit */
-	bit = g_bit_nth_lsf (byte, -1);
-	mask = 1 << bit;
-	g_assert (bit >= 0 && bit <= 7);
-	g_assert ((*data & mask) == 0);
-	/* And mark it as allocated */
-	*data |= mask;
-
-	return b * 8 + bit;
+	return next_tab_id++;
 }
 
 static void
@@ -121,28 +120,24 @@ free_tab_id (GtkAction *action)
 {
 	const char *name;
 	guint id;
-	guint8 *data;
-	guint b, bit;
 
 	G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
 	name = gtk_action_get_name (action);
 	G_GNUC_END_IGNORE_DEPRECATIONS;
 	id = g_ascii_strtoull (name + ACTION_VERB_FORMAT_PREFIX_LEN, NULL,
 	                       ACTION_VERB_FORMAT_BASE);
-	g_assert (id < tabs_id_array->len * 8);
-
-	b = id >> 3;
-	bit = id & 0x7;
-	data = tabs_id_array->data + b;
-	*data &= ~(1 << bit);
+	g_assert (id < next_tab_id);
 
 	g_assert (n_tabs > 0);
 	if (--n_tabs == 0)
 	{
-		g_assert (tabs_id_array != NULL);
-		g_byte_array_free (tabs_id_array, TRUE);
-		tabs_id_array = NULL;
+		g_assert (free_tab_ids != NULL);
+		g_array_free (free_tab_ids, TRUE);
+		free_tab_ids = NULL;
+		return;
 	}
+
+	g_array_append_val (free_tab_ids, id);
 }
 
 static void
@@ -180,6 +175,28 @@ sync_tab_title (TerminalScreen *screen,
 	g_object_set (action, "label", title, NULL);
 }
 
+/* Returns the index of @action in @actions, or @actions->len if it isn't
+ * there. @hint is checked first; it's usually right.
+ */
+static guint
+find_action_index (GPtrArray *actions,
+                   GtkAction *action,
+                   guint hint)
+{
+	guint i;
+
+	if (hint < actions->len && g_ptr_array_index (actions, hint) == action)
+		return hint;
+
+	for (i = 0; i < actions->len; ++i)
+	{
+		if (g_ptr_array_index (actions, i) == action)
+			return i;
+	}
+
+	return actions->len;
+}
+
 static void
 notebook_page_added_cb (GtkNotebook *notebook,
                         TerminalScreenContainer *container,
@@ -191,6 +208,10 @@ notebook_page_added_cb (GtkNotebook *notebook,
 	char verb[ACTION_VERB_FORMAT_LENGTH];
 	GSList *group;
 	TerminalScreen *screen;
+	gint64 start = 0;
+
+	_TERMINAL_DEBUG_IF (TERMINAL_DEBUG_MDI)
+		start = g_get_monotonic_time ();
 
 	screen = terminal_screen_container_get_screen (container);
 
@@ -229,9 +250,20 @@ notebook_page_added_cb (GtkNotebook *notebook,
 	g_signal_connect (action, "activate",
 	                  G_CALLBACK (tab_action_activate_cb), menu);
 
+	g_ptr_array_insert (priv->actions, position, action);
+	terminal_tabs_menu_insert_proxy (menu, action, position);
+
 	g_object_unref (action);
 
-	terminal_tabs_menu_update (menu);
+	/* Only the tabs from @position on change their number, unless we
+	 * just left single tab mode, which the first tab's accel depends on.
+	 */
+	terminal_tabs_menu_update_accels (menu, priv->actions->len == 2 ? 0 : position);
+
+	_terminal_debug_print (TERMINAL_DEBUG_MDI,
+	                       "Tabs menu: added tab %u of %u in %" G_GINT64_FORMAT " us\n",
+	                       position + 1, priv->actions->len,
+	                       g_get_monotonic_time () - start);
 }
 
 static void
@@ -243,6 +275,12 @@ notebook_page_removed_cb (GtkNotebook *notebook,
 	TerminalTabsMenuPrivate *priv = menu->priv;
 	GtkAction *action;
 	TerminalScreen *screen;
+	GSList *proxies, *l;
+	guint index;
+	gint64 start = 0;
+
+	_TERMINAL_DEBUG_IF (TERMINAL_DEBUG_MDI)
+		start = g_get_monotonic_time ();
 
 	screen = terminal_screen_container_get_screen (container);
 
@@ -251,6 +289,13 @@ notebook_page_removed_cb (GtkNotebook *notebook,
 
 	free_tab_id (action);
 
+	G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
+	proxies = g_slist_copy (gtk_action_get_proxies (action));
+	G_GNUC_END_IGNORE_DEPRECATIONS;
+	for (l = proxies; l != NULL; l = l->next)
+		gtk_widget_destroy (GTK_WIDGET (l->data));
+	g_slist_free (proxies);
+
 	g_signal_handlers_disconnect_by_func
 	(screen, G_CALLBACK (sync_tab_title), action);
 
@@ -262,7 +307,16 @@ notebook_page_removed_cb (GtkNotebook *notebook,
 	gtk_action_group_remove_action (priv->action_group, action);
 	G_GNUC_END_IGNORE_DEPRECATIONS;
 
-	terminal_tabs_menu_update (menu);
+	index = find_action_index (priv->actions, action, position);
+	g_return_if_fail (index < priv->actions->len);
+	g_ptr_array_remove_index (priv->actions, index);
+
+	terminal_tabs_menu_update_accels (menu, priv->actions->len == 1 ? 0 : index);
+
+	_terminal_debug_print (TERMINAL_DEBUG_MDI,
+	                       "Tabs menu: removed tab %u, %u left, in %" G_GINT64_FORMAT " us\n",
+	                       index + 1, priv->actions->len,
+	                       g_get_monotonic_time () - start);
 }
 
 static void
@@ -271,7 +325,36 @@ notebook_page_reordered_cb (GtkNotebook *notebook,
                             guint position,
                             TerminalTabsMenu *menu)
 {
-	terminal_tabs_menu_update (menu);
+	TerminalTabsMenuPrivate *priv = menu->priv;
+	TerminalScreen *screen;
+	GtkAction *action;
+	GSList *l;
+	guint old_position;
+
+	screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (bin));
+	action = g_object_get_data (G_OBJECT (screen), DATA_KEY);
+	g_return_if_fail (action != NULL);
+
+	old_position = find_action_index (priv->actions, action, position);
+	g_return_if_fail (old_position < priv->actions->len);
+	if (old_position == position)
+		return;
+
+	g_ptr_array_remove_index (priv->actions, old_position);
+	g_ptr_array_insert (priv->actions, position, action);
+
+	G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
+	for (l = gtk_action_get_proxies (action); l != NULL; l = l->next)
+	{
+		GtkWidget *parent = gtk_widget_get_parent (GTK_WIDGET (l->data));
+
+		if (parent != NULL && parent == GTK_WIDGET (priv->menu))
+			gtk_menu_reorder_child (GTK_MENU (parent), GTK_WIDGET (l->data),
+			                        priv->n_static_items + position);
+	}
+	G_GNUC_END_IGNORE_DEPRECATIONS;
+
+	terminal_tabs_menu_update_accels (menu, MIN (old_position, position));
 }
 
 static void
@@ -381,11 +464,26 @@ terminal_tabs_menu_get_property (GObject *object,
 	g_return_if_reached ();
 }
 
+static void
+terminal_tabs_menu_finalize (GObject *object)
+{
+	TerminalTabsMenu *menu = TERMINAL_TABS_MENU (object);
+	TerminalTabsMenuPrivate *priv = menu->priv;
+
+	if (priv->menu != NULL)
+		g_object_remove_weak_pointer (G_OBJECT (priv->menu), (gpointer *) &priv->menu);
+
+	g_ptr_array_free (priv->actions, TRUE);
+
+	G_OBJECT_CLASS (terminal_tabs_menu_parent_class)->finalize (object);
+}
+
 static void
 terminal_tabs_menu_class_init (TerminalTabsMenuClass *klass)
 {
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+	object_class->finalize = terminal_tabs_menu_finalize;
 	object_class->set_property = terminal_tabs_menu_set_property;
 	object_class->get_property = terminal_tabs_menu_get_property;
 
@@ -404,20 +502,7 @@ static void
 terminal_tabs_menu_init (TerminalTabsMenu *menu)
 {
 	menu->priv = terminal_tabs_menu_get_instance_private (menu);
-}
-
-static void
-terminal_tabs_menu_clean (TerminalTabsMenu *menu)
-{
-	TerminalTabsMenuPrivate *p = menu->priv;
-	GtkUIManager *manager = GTK_UI_MANAGER (terminal_window_get_ui_manager (p->window));
-
-	if (p->ui_id != 0)
-	{
-		gtk_ui_manager_remove_ui (manager, p->ui_id);
-		gtk_ui_manager_ensure_update (manager);
-		p->ui_id = 0;
-	}
+	menu->priv->actions = g_ptr_array_new ();
 }
 
 TerminalTabsMenu *
@@ -429,70 +514,104 @@ terminal_tabs_menu_new (TerminalWindow *window)
 }
 
 static void
-tab_set_action_accelerator (GtkActionGroup *action_group,
-                            GtkAction *action,
+tab_set_action_accelerator (GtkAction *action,
                             guint tab_number,
                             gboolean is_single_tab)
 {
+	char accel_path[ACCEL_PATH_FORMAT_LENGTH];
+	const char *path = NULL;
+	GSList *l;
+
 	if (!is_single_tab &&
 	        tab_number < TERMINAL_ACCELS_N_TABS_SWITCH)
 	{
-		char accel_path[ACCEL_PATH_FORMAT_LENGTH];
-
 		g_snprintf (accel_path, sizeof (accel_path), ACCEL_PATH_FORMAT, tab_number + 1);
-		G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
-		gtk_action_set_accel_path (action, accel_path);
+		path = accel_path;
 	}
-	else
+
+	G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
+	gtk_action_set_accel_path (action, path);
+
+	/* Existing proxies don't pick up the new path by themselves */
+	for (l = gtk_action_get_proxies (action); l != NULL; l = l->next)
 	{
-		gtk_action_set_accel_path (action, NULL);
-		return;
-		G_GNUC_END_IGNORE_DEPRECATIONS;
+		if (GTK_IS_MENU_ITEM (l->data))
+			gtk_menu_item_set_accel_path (GTK_MENU_ITEM (l->data), path);
 	}
+	G_GNUC_END_IGNORE_DEPRECATIONS;
 }
 
+/* Renumbers the tabs from @first on. Only the first
+ * TERMINAL_ACCELS_N_TABS_SWITCH tabs have an accel, plus the one just
+ * past them which may have to lose the one it had.
+ */
 static void
-terminal_tabs_menu_update (TerminalTabsMenu *menu)
+terminal_tabs_menu_update_accels (TerminalTabsMenu *menu,
+                                  guint first)
 {
-	TerminalTabsMenuPrivate *p = menu->priv;
-	GtkUIManager *manager;
-	GtkAction *action;
-	GList *tabs = NULL, *l;
-	guint i = 0, n;
-	gboolean is_single_tab;
-	const char *verb;
+	TerminalTabsMenuPrivate *priv = menu->priv;
+	guint i, n;
 
-	terminal_tabs_menu_clean (menu);
+	n = MIN (priv->actions->len, TERMINAL_ACCELS_N_TABS_SWITCH + 1);
+	for (i = first; i < n; ++i)
+		tab_set_action_accelerator (g_ptr_array_index (priv->actions, i),
+		                            i, priv->actions->len == 1);
+}
 
-	tabs = terminal_window_list_screen_containers (p->window);
+static GtkMenuShell *
+terminal_tabs_menu_get_menu (TerminalTabsMenu *menu)
+{
+	TerminalTabsMenuPrivate *priv = menu->priv;
+	GtkUIManager *manager;
+	GtkWidget *item, *submenu;
+	GList *children;
+	guint i;
 
-	n = g_list_length (tabs);
-	if (n == 0) return;
+	if (priv->menu != NULL)
+		return priv->menu;
 
-	is_single_tab = (n == 1);
+	manager = GTK_UI_MANAGER (terminal_window_get_ui_manager (priv->window));
+	item = gtk_ui_manager_get_widget (manager, UI_PATH);
+	if (item == NULL)
+		return NULL;
 
-	manager =  GTK_UI_MANAGER (terminal_window_get_ui_manager (p->window));
-	p->ui_id = gtk_ui_manager_new_merge_id (manager);
+	submenu = gtk_menu_item_get_submenu (GTK_MENU_ITEM (item));
+	if (submenu == NULL)
+		return NULL;
 
-	for (l = tabs; l != NULL; l = l->next)
-	{
-		TerminalScreenContainer *container = TERMINAL_SCREEN_CONTAINER (l->data);
-		GObject *screen = G_OBJECT (terminal_screen_container_get_screen (container));
+	children = gtk_container_get_children (GTK_CONTAINER (submenu));
+	priv->n_static_items = g_list_length (children);
+	g_list_free (children);
 
-		action = g_object_get_data (screen, DATA_KEY);
-		g_return_if_fail (action != NULL);
+	priv->menu = GTK_MENU_SHELL (submenu);
+	g_object_add_weak_pointer (G_OBJECT (priv->menu), (gpointer *) &priv->menu);
 
-		G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
-		verb = gtk_action_get_name (action);
-		G_GNUC_END_IGNORE_DEPRECATIONS;
+	/* The menu was (re)built without our items; add any we already have */
+	for (i = 0; i < priv->actions->len; ++i)
+		terminal_tabs_menu_insert_proxy (menu, g_ptr_array_index (priv->actions, i), i);
 
-		tab_set_action_accelerator (p->action_group, action, i++, is_single_tab);
+	return priv->menu;
+}
 
-		gtk_ui_manager_add_ui (manager, p->ui_id,
-		                       UI_PATH,
-		                       verb, verb,
-		                       GTK_UI_MANAGER_MENUITEM, FALSE);
+static void
+terminal_tabs_menu_insert_proxy (TerminalTabsMenu *menu,
+                                 GtkAction *action,
+                                 guint position)
+{
+	TerminalTabsMenuPrivate *priv = menu->priv;
+	GtkMenuShell *shell;
+	GtkWidget *proxy;
+
+	shell = priv->menu;
+	if (shell == NULL)
+	{
+		/* Fetching the menu adds proxies for all known actions */
+		terminal_tabs_menu_get_menu (menu);
+		return;
 	}
 
-	g_list_free (tabs);
+	G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
+	proxy = gtk_action_create_menu_item (action);
+	G_GNUC_END_IGNORE_DEPRECATIONS;
+	gtk_menu_shell_insert (shell, proxy, priv->n_static_items + position);
 }
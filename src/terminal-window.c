@@ -34,8 +34,10 @@
 #include "terminal-debug.h"
 #include "terminal-encoding.h"
 #include "terminal-intl.h"
+#include "terminal-save-contents.h"
 #include "terminal-screen-container.h"
 #include "terminal-search-dialog.h"
+#include "terminal-search-scan.h"
 #include "terminal-tab-label.h"
 #include "terminal-tabs-menu.h"
 #include "terminal-util.h"
@@ -47,6 +49,20 @@
 
 static gboolean detach_tab = FALSE;
 
+/* Window chrome that depends on the active tab and is brought up to date
+ * at most once per frame; see terminal_window_queue_update().
+ */
+typedef enum
+{
+    WINDOW_UPDATE_SIZE             = 1 << 0,
+    WINDOW_UPDATE_TABS_MENU        = 1 << 1,
+    WINDOW_UPDATE_ACTIVE_ENCODING  = 1 << 2,
+    WINDOW_UPDATE_ACTIVE_PROFILE   = 1 << 3,
+    WINDOW_UPDATE_COPY             = 1 << 4,
+    WINDOW_UPDATE_ZOOM             = 1 << 5,
+    WINDOW_UPDATE_SEARCH           = 1 << 6
+} TerminalWindowUpdate;
+
 struct _TerminalWindowPrivate
 {
     GtkActionGroup *action_group;
@@ -64,9 +80,17 @@ struct _TerminalWindowPrivate
     TerminalScreenPopupInfo *popup_info;
     guint remove_popup_info_idle;
 
+    /* TerminalWindowUpdate flags waiting for update_idle_id */
+    guint pending_updates;
+    guint update_idle_id;
+
     GtkActionGroup *new_terminal_action_group;
     guint new_terminal_ui_id;
 
+    /* Serials of the app's menu models the menus above were built from */
+    guint profile_menu_serial;
+    guint encoding_menu_serial;
+
     GtkWidget *menubar;
     GtkWidget *notebook;
     GtkWidget *main_vbox;
@@ -89,8 +113,20 @@ struct _TerminalWindowPrivate
 
     void *old_geometry_widget; /* only used for pointer value as it may be freed */
 
+    /* The chrome and padding above are still accurate; cleared by
+     * terminal_window_invalidate_geometry() */
+    guint geometry_valid : 1;
+
     GtkWidget *confirm_close_dialog;
     GtkWidget *search_find_dialog;
+    TerminalSearchScan *incremental_search;
+    guint incremental_search_backwards : 1;
+    TerminalSearchScan *all_tabs_search;
+    GRegex *all_tabs_search_regex;
+    GList *all_tabs_search_pending; /* screens still to be searched */
+    TerminalScreen *all_tabs_search_waking; /* the screen whose scan waits for its scrollback */
+    GCancellable *all_tabs_search_wake;
+    guint all_tabs_search_results;
 
     guint menubar_visible : 1;
     guint use_default_menubar_visibility : 1;
@@ -113,10 +149,21 @@ struct _TerminalWindowPrivate
 
     /* should we copy selection to clibpoard */
     int copy_selection;
+    /* pending copy of the selection of this screen to the clipboard */
+    TerminalScreen *copy_selection_screen;
+    guint copy_selection_timeout_id;
 };
 
 #define PROFILE_DATA_KEY "GT::Profile"
 
+/* How long the selection has to stay unchanged before it's copied to the
+ * clipboard, if the gesture creating it doesn't end first (ms) */
+#define COPY_SELECTION_DELAY (200)
+
+/* Enough to be useful, few enough to not bury the results list */
+#define ALL_TABS_SEARCH_MAX_RESULTS (1000)
+#define ALL_TABS_SEARCH_CONTEXT_ROWS (3)
+
 #define FILE_NEW_TERMINAL_TAB_UI_PATH     "/menubar/File/FileNewTabProfiles"
 #define FILE_NEW_TERMINAL_WINDOW_UI_PATH  "/menubar/File/FileNewWindowProfiles"
 #define SET_ENCODING_UI_PATH              "/menubar/Terminal/TerminalSetEncoding/EncodingsPH"
@@ -132,22 +179,17 @@ struct _TerminalWindowPrivate
 
 #define ENCODING_DATA_KEY "encoding"
 
-#if 1
-/*
- * We don't want to enable content saving until vte supports it async.
- * So we disable this code for stable versions.
- */
-#include "terminal-version.h"
-
-#if (TERMINAL_MINOR_VERSION & 1) != 0
-#define ENABLE_SAVE
-#else
-#undef ENABLE_SAVE
-#endif
-#endif
-
 static void terminal_window_dispose     (GObject             *object);
 static void terminal_window_finalize    (GObject             *object);
+static void terminal_window_cancel_incremental_search (TerminalWindow *window);
+static void terminal_window_cancel_all_tabs_search (TerminalWindow *window);
+static void terminal_window_forget_all_tabs_search_screen (TerminalWindow *window,
+        TerminalScreen *screen);
+static void terminal_window_update_match_count (TerminalWindow *window);
+static void screen_search_matches_changed_cb (TerminalScreen *screen,
+        TerminalWindow *window);
+static void screen_wake_scrollback_cb (TerminalScreen *screen,
+        TerminalWindow *window);
 static gboolean terminal_window_state_event (GtkWidget            *widget,
         GdkEventWindowState  *event);
 
@@ -496,28 +538,6 @@ terminal_window_XParseGeometry (const char *string,
 	return (mask);
 }
 
-static char *
-escape_underscores (const char *name)
-{
-    GString *escaped_name;
-
-    g_assert (name != NULL);
-
-    /* Who'd use more that 4 underscores in a profile name... */
-    escaped_name = g_string_sized_new (strlen (name) + 4 + 1);
-
-    while (*name)
-    {
-        if (*name == '_')
-            g_string_append (escaped_name, "__");
-        else
-            g_string_append_c (escaped_name, *name);
-        name++;
-    }
-
-    return g_string_free (escaped_name, FALSE);
-}
-
 static int
 find_tab_num_at_pos (GtkNotebook *notebook,
                      int screen_x,
@@ -589,72 +609,6 @@ terminal_set_profile_toggled_callback (GtkToggleAction *action,
     g_signal_handlers_unblock_by_func (priv->active_screen, G_CALLBACK (profile_set_callback), window);
 }
 
-static void
-profile_visible_name_notify_cb (TerminalProfile *profile,
-                                GParamSpec *pspec,
-                                GtkAction *action)
-{
-    const char *visible_name;
-    char *dot, *display_name;
-    guint num;
-
-    visible_name = terminal_profile_get_property_string (profile, TERMINAL_PROFILE_VISIBLE_NAME);
-    display_name = escape_underscores (visible_name);
-
-    G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
-    dot = strchr (gtk_action_get_name (action), '.');
-    G_GNUC_END_IGNORE_DEPRECATIONS;
-    if (dot != NULL)
-    {
-        char *free_me;
-
-        num = g_ascii_strtoll (dot + 1, NULL, 10);
-
-        free_me = display_name;
-        if (num < 10)
-            /* Translators: This is the label of a menu item to choose a profile.
-             * _%d is used as the accelerator (with d between 1 and 9), and
-             * the %s is the name of the terminal profile.
-             */
-            display_name = g_strdup_printf (_("_%d. %s"), num, display_name);
-        else if (num < 36)
-            /* Translators: This is the label of a menu item to choose a profile.
-             * _%c is used as the accelerator (it will be a character between A and Z),
-             * and the %s is the name of the terminal profile.
-             */
-            display_name = g_strdup_printf (_("_%c. %s"), ('A' + num - 10), display_name);
-        else
-            free_me = NULL;
-
-        g_free (free_me);
-    }
-
-    g_object_set (action, "label", display_name, NULL);
-    g_free (display_name);
-}
-
-static void
-disconnect_profiles_from_actions_in_group (GtkActionGroup *action_group)
-{
-    GList *actions, *l;
-
-    G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
-    actions = gtk_action_group_list_actions (action_group);
-    G_GNUC_END_IGNORE_DEPRECATIONS;
-    for (l = actions; l != NULL; l = l->next)
-    {
-        GObject *action = G_OBJECT (l->data);
-        TerminalProfile *profile;
-
-        profile = g_object_get_data (action, PROFILE_DATA_KEY);
-        if (!profile)
-            continue;
-
-        g_signal_handlers_disconnect_by_func (profile, G_CALLBACK (profile_visible_name_notify_cb), action);
-    }
-    g_list_free (actions);
-}
-
 static void
 terminal_window_update_set_profile_menu_active_profile (TerminalWindow *window)
 {
@@ -700,7 +654,7 @@ terminal_window_update_set_profile_menu (TerminalWindow *window)
     TerminalProfile *active_profile;
     GtkActionGroup *action_group;
     GtkAction *action;
-    GList *profiles, *p;
+    GArray *items;
     GSList *group;
     guint n;
     gboolean single_profile;
@@ -714,20 +668,19 @@ terminal_window_update_set_profile_menu (TerminalWindow *window)
 
     if (priv->profiles_action_group != NULL)
     {
-        disconnect_profiles_from_actions_in_group (priv->profiles_action_group);
         gtk_ui_manager_remove_action_group (priv->ui_manager,
                                             priv->profiles_action_group);
         priv->profiles_action_group = NULL;
     }
 
-    profiles = terminal_app_get_profile_list (terminal_app_get ());
+    items = terminal_app_get_profile_menu (terminal_app_get ());
 
     G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
     action = gtk_action_group_get_action (priv->action_group, "TerminalProfiles");
-    single_profile = !profiles || profiles->next == NULL; /* list length <= 1 */
+    single_profile = items->len <= 1;
     gtk_action_set_sensitive (action, !single_profile);
     G_GNUC_END_IGNORE_DEPRECATIONS;
-    if (profiles == NULL)
+    if (items->len == 0)
         return;
 
     if (priv->active_screen)
@@ -744,10 +697,10 @@ terminal_window_update_set_profile_menu (TerminalWindow *window)
     priv->profiles_ui_id = gtk_ui_manager_new_merge_id (priv->ui_manager);
 
     group = NULL;
-    n = 0;
-    for (p = profiles; p != NULL; p = p->next)
+    for (n = 0; n < items->len; )
     {
-        TerminalProfile *profile = (TerminalProfile *) p->data;
+        TerminalProfileMenuItem *item = &g_array_index (items, TerminalProfileMenuItem, n);
+        TerminalProfile *profile = item->profile;
         GtkRadioAction *profile_action;
         char name[32];
 
@@ -755,7 +708,7 @@ terminal_window_update_set_profile_menu (TerminalWindow *window)
 
         G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
         profile_action = gtk_radio_action_new (name,
-                                               NULL,
+                                               item->label,
                                                NULL,
                                                NULL,
                                                n);
@@ -771,9 +724,6 @@ terminal_window_update_set_profile_menu (TerminalWindow *window)
                                 PROFILE_DATA_KEY,
                                 g_object_ref (profile),
                                 (GDestroyNotify) g_object_unref);
-        profile_visible_name_notify_cb (profile, NULL, GTK_ACTION (profile_action));
-        g_signal_connect (profile, "notify::" TERMINAL_PROFILE_VISIBLE_NAME,
-                          G_CALLBACK (profile_visible_name_notify_cb), profile_action);
         g_signal_connect (profile_action, "toggled",
                           G_CALLBACK (terminal_set_profile_toggled_callback), window);
 
@@ -791,31 +741,25 @@ terminal_window_update_set_profile_menu (TerminalWindow *window)
                                name, name,
                                GTK_UI_MANAGER_MENUITEM, FALSE);
     }
-
-    g_list_free (profiles);
 }
 
 static void
 terminal_window_create_new_terminal_action (TerminalWindow *window,
-        TerminalProfile *profile,
+        TerminalProfileMenuItem *item,
         const char *name,
-        guint num,
         GCallback callback)
 {
     TerminalWindowPrivate *priv = window->priv;
     GtkAction *action;
 
     G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
-    action = gtk_action_new (name, NULL, NULL, NULL);
+    action = gtk_action_new (name, item->mnemonic_label, NULL, NULL);
     G_GNUC_END_IGNORE_DEPRECATIONS;
 
     g_object_set_data_full (G_OBJECT (action),
                             PROFILE_DATA_KEY,
-                            g_object_ref (profile),
+                            g_object_ref (item->profile),
                             (GDestroyNotify) g_object_unref);
-    profile_visible_name_notify_cb (profile, NULL, action);
-    g_signal_connect (profile, "notify::" TERMINAL_PROFILE_VISIBLE_NAME,
-                      G_CALLBACK (profile_visible_name_notify_cb), action);
     g_signal_connect (action, "activate", callback, window);
 
     G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
@@ -830,7 +774,7 @@ terminal_window_update_new_terminal_menus (TerminalWindow *window)
     TerminalWindowPrivate *priv = window->priv;
     GtkActionGroup *action_group;
     GtkAction *action;
-    GList *profiles, *p;
+    GArray *items;
     guint n;
     gboolean have_single_profile;
 
@@ -843,14 +787,13 @@ terminal_window_update_new_terminal_menus (TerminalWindow *window)
 
     if (priv->new_terminal_action_group != NULL)
     {
-        disconnect_profiles_from_actions_in_group (priv->new_terminal_action_group);
         gtk_ui_manager_remove_action_group (priv->ui_manager,
                                             priv->new_terminal_action_group);
         priv->new_terminal_action_group = NULL;
     }
 
-    profiles = terminal_app_get_profile_list (terminal_app_get ());
-    have_single_profile = !profiles || !profiles->next;
+    items = terminal_app_get_profile_menu (terminal_app_get ());
+    have_single_profile = items->len <= 1;
 
     G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
     action = gtk_action_group_get_action (priv->action_group, "FileNewTab");
@@ -860,10 +803,7 @@ terminal_window_update_new_terminal_menus (TerminalWindow *window)
     G_GNUC_END_IGNORE_DEPRECATIONS;
 
     if (have_single_profile)
-    {
-        g_list_free (profiles);
         return;
-    }
 
     /* Now build the submenus */
 
@@ -875,17 +815,15 @@ terminal_window_update_new_terminal_menus (TerminalWindow *window)
 
     priv->new_terminal_ui_id = gtk_ui_manager_new_merge_id (priv->ui_manager);
 
-    n = 0;
-    for (p = profiles; p != NULL; p = p->next)
+    for (n = 0; n < items->len; ++n)
     {
-        TerminalProfile *profile = (TerminalProfile *) p->data;
+        TerminalProfileMenuItem *item = &g_array_index (items, TerminalProfileMenuItem, n);
         char name[32];
 
         g_snprintf (name, sizeof (name), "FileNewTab.%u", n);
         terminal_window_create_new_terminal_action (window,
-                profile,
+                item,
                 name,
-                n,
                 G_CALLBACK (file_new_tab_callback));
 
         gtk_ui_manager_add_ui (priv->ui_manager, priv->new_terminal_ui_id,
@@ -895,20 +833,15 @@ terminal_window_update_new_terminal_menus (TerminalWindow *window)
 
         g_snprintf (name, sizeof (name), "FileNewWindow.%u", n);
         terminal_window_create_new_terminal_action (window,
-                profile,
+                item,
                 name,
-                n,
                 G_CALLBACK (file_new_window_callback));
 
         gtk_ui_manager_add_ui (priv->ui_manager, priv->new_terminal_ui_id,
                                FILE_NEW_TERMINAL_WINDOW_UI_PATH,
                                name, name,
                                GTK_UI_MANAGER_MENUITEM, FALSE);
-
-        ++n;
     }
-
-    g_list_free (profiles);
 }
 
 static void
@@ -1157,15 +1090,95 @@ terminal_window_update_copy_sensitivity (TerminalScreen *screen,
     action = gtk_action_group_get_action (priv->action_group, "EditCopy");
     gtk_action_set_sensitive (action, can_copy);
     G_GNUC_END_IGNORE_DEPRECATIONS;
+}
+
+static void
+terminal_window_cancel_copy_selection (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+
+    if (priv->copy_selection_timeout_id != 0)
+    {
+        g_source_remove (priv->copy_selection_timeout_id);
+        priv->copy_selection_timeout_id = 0;
+    }
+    priv->copy_selection_screen = NULL;
+}
+
+static void
+terminal_window_flush_copy_selection (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+    TerminalScreen *screen = priv->copy_selection_screen;
+
+    terminal_window_cancel_copy_selection (window);
+
+    if (screen == NULL ||
+        screen != priv->active_screen ||
+        !priv->copy_selection ||
+        !vte_terminal_get_has_selection (VTE_TERMINAL (screen)))
+        return;
 
-    if (can_copy && priv->copy_selection)
 #if VTE_CHECK_VERSION (0, 50, 0)
-        vte_terminal_copy_clipboard_format (VTE_TERMINAL(screen), VTE_FORMAT_TEXT);
+    vte_terminal_copy_clipboard_format (VTE_TERMINAL(screen), VTE_FORMAT_TEXT);
 #else
-        vte_terminal_copy_clipboard(VTE_TERMINAL(screen));
+    vte_terminal_copy_clipboard(VTE_TERMINAL(screen));
 #endif
 }
 
+static gboolean
+copy_selection_timeout_cb (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+
+    priv->copy_selection_timeout_id = 0;
+    terminal_window_flush_copy_selection (window);
+
+    return FALSE;
+}
+
+/* Copying extracts the whole selected text, so while the selection is
+ * being dragged out we only remember that it changed; the clipboard is
+ * set once the button is released or the selection has settled. Nothing
+ * is copied unless the selection changed since the last time.
+ */
+static void
+screen_selection_changed_cb (TerminalScreen *screen,
+                             TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+
+    if (screen != priv->active_screen)
+        return;
+
+    terminal_window_update_copy_sensitivity (screen, window);
+
+    if (!priv->copy_selection)
+        return;
+
+    if (priv->copy_selection_timeout_id != 0)
+        g_source_remove (priv->copy_selection_timeout_id);
+
+    priv->copy_selection_screen = screen;
+    priv->copy_selection_timeout_id =
+        g_timeout_add (COPY_SELECTION_DELAY,
+                       (GSourceFunc) copy_selection_timeout_cb,
+                       window);
+}
+
+static gboolean
+screen_button_release_cb (TerminalScreen *screen,
+                          GdkEventButton *event,
+                          TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+
+    if (priv->copy_selection_screen == screen)
+        terminal_window_flush_copy_selection (window);
+
+    return FALSE;
+}
+
 static void
 terminal_window_update_zoom_sensitivity (TerminalWindow *window)
 {
@@ -1178,6 +1191,9 @@ terminal_window_update_zoom_sensitivity (TerminalWindow *window)
     if (screen == NULL)
         return;
 
+    /* Called whenever the zoom may have changed */
+    terminal_app_mark_session_dirty (terminal_app_get (), window);
+
     current = terminal_screen_get_font_scale (screen);
 
     G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
@@ -1254,7 +1270,6 @@ screen_resize_window_cb (TerminalScreen *screen,
                          TerminalWindow* window)
 {
     TerminalWindowPrivate *priv = window->priv;
-    VteTerminal *terminal = VTE_TERMINAL (screen);
     GtkWidget *widget = GTK_WIDGET (screen);
 
     /* Don't do anything if we're maximised or fullscreened */
@@ -1263,7 +1278,8 @@ screen_resize_window_cb (TerminalScreen *screen,
             (gdk_window_get_state (gtk_widget_get_window (widget)) & (GDK_WINDOW_STATE_MAXIMIZED | GDK_WINDOW_STATE_FULLSCREEN)) != 0)
         return;
 
-    vte_terminal_set_size (terminal, width, height);
+    /* Deferred until shown if this is a background tab */
+    terminal_screen_set_size (screen, width, height);
 
     if (screen != priv->active_screen)
         return;
@@ -1324,6 +1340,88 @@ terminal_window_update_tabs_menu_sensitivity (TerminalWindow *window)
     G_GNUC_END_IGNORE_DEPRECATIONS;
 }
 
+static void
+terminal_window_flush_updates (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+    TerminalScreen *screen = priv->active_screen;
+    guint updates;
+
+    updates = priv->pending_updates;
+    priv->pending_updates = 0;
+
+    if (priv->update_idle_id != 0)
+    {
+        g_source_remove (priv->update_idle_id);
+        priv->update_idle_id = 0;
+    }
+
+    if (updates == 0 || priv->disposed)
+        return;
+
+    _terminal_debug_print (TERMINAL_DEBUG_MDI,
+                           "[window %p] MDI: flushing updates 0x%x\n",
+                           window, updates);
+
+    if ((updates & WINDOW_UPDATE_SIZE) && screen != NULL)
+        terminal_window_update_size (window, screen, TRUE);
+    if (updates & WINDOW_UPDATE_TABS_MENU)
+        terminal_window_update_tabs_menu_sensitivity (window);
+    if (updates & WINDOW_UPDATE_ACTIVE_ENCODING)
+        terminal_window_update_encoding_menu_active_encoding (window);
+    if (updates & WINDOW_UPDATE_ACTIVE_PROFILE)
+        terminal_window_update_set_profile_menu_active_profile (window);
+
+    if (screen == NULL)
+        return;
+
+    if (updates & WINDOW_UPDATE_COPY)
+        terminal_window_update_copy_sensitivity (screen, window);
+    if (updates & WINDOW_UPDATE_ZOOM)
+        terminal_window_update_zoom_sensitivity (window);
+    if (updates & WINDOW_UPDATE_SEARCH)
+        terminal_window_update_search_sensitivity (screen, window);
+}
+
+static gboolean
+terminal_window_update_idle_cb (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+
+    priv->update_idle_id = 0;
+    terminal_window_flush_updates (window);
+
+    return FALSE;
+}
+
+/* Switching through many tabs quickly, or adding and removing several at
+ * once, would otherwise redo all of this for every intermediate tab. The
+ * idle runs before GTK's relayout and redraw, so nothing stale is shown.
+ */
+static void
+terminal_window_queue_update (TerminalWindow *window,
+                              TerminalWindowUpdate updates)
+{
+    TerminalWindowPrivate *priv = window->priv;
+
+    if (priv->disposed)
+        return;
+
+    priv->pending_updates |= updates;
+
+    if (priv->update_idle_id == 0)
+        priv->update_idle_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+                                                (GSourceFunc) terminal_window_update_idle_cb,
+                                                window, NULL);
+}
+
+static void
+notebook_page_reordered_callback (TerminalWindow *window)
+{
+    terminal_window_queue_update (window, WINDOW_UPDATE_TABS_MENU);
+    terminal_app_mark_session_dirty (terminal_app_get (), window);
+}
+
 static void
 update_tab_visibility (TerminalWindow *window,
                        int             change)
@@ -1335,7 +1433,11 @@ update_tab_visibility (TerminalWindow *window,
     num = gtk_notebook_get_n_pages (GTK_NOTEBOOK (priv->notebook));
 
     show_tabs = (num + change) > 1;
+    if (show_tabs == gtk_notebook_get_show_tabs (GTK_NOTEBOOK (priv->notebook)))
+        return;
+
     gtk_notebook_set_show_tabs (GTK_NOTEBOOK (priv->notebook), show_tabs);
+    terminal_window_invalidate_geometry (window);
 }
 
 static GtkNotebook *
@@ -1749,6 +1851,9 @@ terminal_window_state_event (GtkWidget            *widget,
     gboolean (* window_state_event) (GtkWidget *, GdkEventWindowState *event) =
         GTK_WIDGET_CLASS (terminal_window_parent_class)->window_state_event;
 
+    if (event->changed_mask & (GDK_WINDOW_STATE_FULLSCREEN | GDK_WINDOW_STATE_MAXIMIZED))
+        terminal_app_mark_session_dirty (terminal_app_get (), TERMINAL_WINDOW (widget));
+
     if (event->changed_mask & GDK_WINDOW_STATE_FULLSCREEN)
     {
         TerminalWindow *window = TERMINAL_WINDOW (widget);
@@ -1852,19 +1957,78 @@ terminal_window_screen_changed (GtkWidget *widget,
     terminal_window_screen_update (window, screen);
 }
 
+static gboolean
+terminal_window_configure_event (GtkWidget         *widget,
+                                 GdkEventConfigure *event)
+{
+    /* The saved geometry includes the position */
+    terminal_app_mark_session_dirty (terminal_app_get (), TERMINAL_WINDOW (widget));
+
+    return GTK_WIDGET_CLASS (terminal_window_parent_class)->configure_event (widget, event);
+}
+
 static void
-terminal_window_profile_list_changed_cb (TerminalApp *app,
-        TerminalWindow *window)
+terminal_window_style_updated (GtkWidget *widget)
 {
-    terminal_window_update_set_profile_menu (window);
-    terminal_window_update_new_terminal_menus (window);
+    GTK_WIDGET_CLASS (terminal_window_parent_class)->style_updated (widget);
+
+    terminal_window_invalidate_geometry (TERMINAL_WINDOW (widget));
 }
 
+/* The profile and encoding menus are only brought up to date with the
+ * app's models when one of the menus containing them is about to be shown,
+ * so a change to the profile or encoding list costs nothing in windows
+ * whose menus stay closed.
+ */
 static void
-terminal_window_encoding_list_changed_cb (TerminalApp *app,
-        TerminalWindow *window)
+terminal_window_sync_menus (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+    TerminalApp *app;
+    guint serial;
+    gboolean changed = FALSE;
+
+    /* The menu is about to show what's pending */
+    terminal_window_flush_updates (window);
+
+    app = terminal_app_get ();
+
+    serial = terminal_app_get_profile_menu_serial (app);
+    if (priv->profile_menu_serial != serial)
+    {
+        terminal_window_update_set_profile_menu (window);
+        terminal_window_update_new_terminal_menus (window);
+        priv->profile_menu_serial = serial;
+        changed = TRUE;
+    }
+
+    serial = terminal_app_get_encoding_menu_serial (app);
+    if (priv->encoding_menu_serial != serial)
+    {
+        terminal_window_update_encoding_menu (window);
+        priv->encoding_menu_serial = serial;
+        changed = TRUE;
+    }
+
+    if (changed)
+        gtk_ui_manager_ensure_update (priv->ui_manager);
+}
+
+static void
+terminal_window_sync_menus_on_show (TerminalWindow *window,
+                                    const char *path)
 {
-    terminal_window_update_encoding_menu (window);
+    TerminalWindowPrivate *priv = window->priv;
+    GtkWidget *widget;
+
+    widget = gtk_ui_manager_get_widget (priv->ui_manager, path);
+    if (GTK_IS_MENU_ITEM (widget))
+        widget = gtk_menu_item_get_submenu (GTK_MENU_ITEM (widget));
+    g_return_if_fail (GTK_IS_MENU (widget));
+
+    g_signal_connect_object (widget, "show",
+                             G_CALLBACK (terminal_window_sync_menus), window,
+                             G_CONNECT_SWAPPED);
 }
 
 static void
@@ -2172,7 +2336,6 @@ terminal_window_init (TerminalWindow *window)
         }
     };
     TerminalWindowPrivate *priv;
-    TerminalApp *app;
     GtkActionGroup *action_group;
     GtkAction *action;
     GtkUIManager *manager;
@@ -2229,7 +2392,7 @@ terminal_window_init (TerminalWindow *window)
     g_signal_connect_after (priv->notebook, "page-removed",
                             G_CALLBACK (notebook_page_removed_callback), window);
     g_signal_connect_data (priv->notebook, "page-reordered",
-                           G_CALLBACK (terminal_window_update_tabs_menu_sensitivity),
+                           G_CALLBACK (notebook_page_reordered_callback),
                            window, NULL, G_CONNECT_SWAPPED | G_CONNECT_AFTER);
 
     gtk_widget_add_events (priv->notebook, GDK_SCROLL_MASK);
@@ -2284,11 +2447,6 @@ terminal_window_init (TerminalWindow *window)
     G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
     action = gtk_action_group_get_action (priv->action_group, "PopupLeaveFullscreen");
     gtk_action_set_visible (action, FALSE);
-
-#ifndef ENABLE_SAVE
-    action = gtk_action_group_get_action (priv->action_group, "FileSaveContents");
-    gtk_action_set_visible (action, FALSE);
-#endif
     G_GNUC_END_IGNORE_DEPRECATIONS;
 
     /* Load the UI */
@@ -2306,14 +2464,10 @@ terminal_window_init (TerminalWindow *window)
     /* Add tabs menu */
     priv->tabs_menu = terminal_tabs_menu_new (window);
 
-    app = terminal_app_get ();
-    terminal_window_profile_list_changed_cb (app, window);
-    g_signal_connect (app, "profile-list-changed",
-                      G_CALLBACK (terminal_window_profile_list_changed_cb), window);
-
-    terminal_window_encoding_list_changed_cb (app, window);
-    g_signal_connect (app, "encoding-list-changed",
-                      G_CALLBACK (terminal_window_encoding_list_changed_cb), window);
+    /* The profile and encoding menus are built lazily */
+    terminal_window_sync_menus_on_show (window, "/menubar/File");
+    terminal_window_sync_menus_on_show (window, "/menubar/Terminal");
+    terminal_window_sync_menus_on_show (window, "/Popup");
 
     terminal_window_set_menubar_visible (window, TRUE);
     priv->use_default_menubar_visibility = TRUE;
@@ -2346,6 +2500,8 @@ terminal_window_class_init (TerminalWindowClass *klass)
     widget_class->map_event = terminal_window_map_event;
     widget_class->window_state_event = terminal_window_state_event;
     widget_class->screen_changed = terminal_window_screen_changed;
+    widget_class->style_updated = terminal_window_style_updated;
+    widget_class->configure_event = terminal_window_configure_event;
 }
 
 static void
@@ -2353,7 +2509,6 @@ terminal_window_dispose (GObject *object)
 {
     TerminalWindow *window = TERMINAL_WINDOW (object);
     TerminalWindowPrivate *priv = window->priv;
-    TerminalApp *app;
     GdkScreen *screen;
     GtkClipboard *clipboard;
 
@@ -2361,24 +2516,22 @@ terminal_window_dispose (GObject *object)
 
     priv->disposed = TRUE;
 
+    if (priv->update_idle_id != 0)
+    {
+        g_source_remove (priv->update_idle_id);
+        priv->update_idle_id = 0;
+    }
+
+    terminal_window_cancel_copy_selection (window);
+    terminal_window_cancel_incremental_search (window);
+    terminal_window_cancel_all_tabs_search (window);
+
     if (priv->tabs_menu)
     {
         g_object_unref (priv->tabs_menu);
         priv->tabs_menu = NULL;
     }
 
-    if (priv->profiles_action_group != NULL)
-        disconnect_profiles_from_actions_in_group (priv->profiles_action_group);
-    if (priv->new_terminal_action_group != NULL)
-        disconnect_profiles_from_actions_in_group (priv->new_terminal_action_group);
-
-    app = terminal_app_get ();
-    g_signal_handlers_disconnect_by_func (app,
-                                          G_CALLBACK (terminal_window_profile_list_changed_cb),
-                                          window);
-    g_signal_handlers_disconnect_by_func (app,
-                                          G_CALLBACK (terminal_window_encoding_list_changed_cb),
-                                          window);
     clipboard = gtk_widget_get_clipboard (GTK_WIDGET (window), GDK_SELECTION_CLIPBOARD);
     g_signal_handlers_disconnect_by_func (clipboard,
                                           G_CALLBACK (update_edit_menu),
@@ -2458,6 +2611,8 @@ terminal_window_show (GtkWidget *widget)
 #endif
     }
 
+    /* Requisitions taken before we were shown may not be final */
+    terminal_window_invalidate_geometry (window);
     terminal_window_update_geometry (window);
 
     _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
@@ -2497,6 +2652,8 @@ profile_set_callback (TerminalScreen *screen,
 {
     TerminalWindowPrivate *priv = window->priv;
 
+    terminal_app_mark_session_dirty (terminal_app_get (), window);
+
     if (!gtk_widget_get_realized (GTK_WIDGET (window)))
         return;
 
@@ -2513,6 +2670,11 @@ sync_screen_title (TerminalScreen *screen,
 {
     TerminalWindowPrivate *priv = window->priv;
 
+    /* Shells usually show the working directory in the title, so this is
+     * our hint that the saved working directory may be out of date.
+     */
+    terminal_app_mark_session_dirty (terminal_app_get (), window);
+
     if (screen != priv->active_screen)
         return;
 
@@ -2716,6 +2878,7 @@ terminal_window_set_menubar_visible (TerminalWindow *window,
         return;
 
     priv->menubar_visible = (setting != FALSE);
+    terminal_app_mark_session_dirty (terminal_app_get (), window);
 
     G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
     action = gtk_action_group_get_action (priv->action_group, "ViewMenubar");
@@ -2723,6 +2886,7 @@ terminal_window_set_menubar_visible (TerminalWindow *window,
     G_GNUC_END_IGNORE_DEPRECATIONS;
 
     g_object_set (priv->menubar, "visible", setting, NULL);
+    terminal_window_invalidate_geometry (window);
 
     /* FIXMEchpe: use gtk_widget_get_realized instead? */
     if (priv->active_screen)
@@ -3087,12 +3251,20 @@ notebook_page_selected_callback (GtkWidget       *notebook,
     if (priv->active_screen == screen)
         return;
 
+    /* Don't lose a selection that was still settling */
+    terminal_window_flush_copy_selection (window);
+
+    terminal_window_cancel_incremental_search (window);
+
     if (priv->active_screen != NULL)
     {
         terminal_screen_get_size (priv->active_screen, &old_grid_width, &old_grid_height);
 
-        /* This is so that we maintain the same grid */
-        vte_terminal_set_size (VTE_TERMINAL (screen), old_grid_width, old_grid_height);
+        /* This is so that we maintain the same grid. The screen is still
+         * hidden, so this only takes effect when it is shown below and
+         * replaces any size it was asked for in the background.
+         */
+        terminal_screen_set_size (screen, old_grid_width, old_grid_height);
     }
 
     /* Workaround to remove gtknotebook's feature of computing its size based on
@@ -3124,14 +3296,16 @@ notebook_page_selected_callback (GtkWidget       *notebook,
     _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
                            "[window %p] setting size after flipping notebook pages\n",
                            window);
-    terminal_window_update_size (window, screen, TRUE);
-
-    terminal_window_update_tabs_menu_sensitivity (window);
-    terminal_window_update_encoding_menu_active_encoding (window);
-    terminal_window_update_set_profile_menu_active_profile (window);
-    terminal_window_update_copy_sensitivity (screen, window);
-    terminal_window_update_zoom_sensitivity (window);
-    terminal_window_update_search_sensitivity (screen, window);
+    terminal_window_queue_update (window,
+                                  WINDOW_UPDATE_SIZE |
+                                  WINDOW_UPDATE_TABS_MENU |
+                                  WINDOW_UPDATE_ACTIVE_ENCODING |
+                                  WINDOW_UPDATE_ACTIVE_PROFILE |
+                                  WINDOW_UPDATE_COPY |
+                                  WINDOW_UPDATE_ZOOM |
+                                  WINDOW_UPDATE_SEARCH);
+    terminal_window_update_match_count (window);
+    terminal_app_mark_session_dirty (terminal_app_get (), window);
 }
 
 static void
@@ -3163,7 +3337,9 @@ notebook_page_added_callback (GtkWidget       *notebook,
     g_signal_connect (screen, "notify::icon-title-set",
                       G_CALLBACK (sync_screen_icon_title_set), window);
     g_signal_connect (screen, "selection-changed",
-                      G_CALLBACK (terminal_window_update_copy_sensitivity), window);
+                      G_CALLBACK (screen_selection_changed_cb), window);
+    g_signal_connect (screen, "button-release-event",
+                      G_CALLBACK (screen_button_release_cb), window);
 
     g_signal_connect (screen, "show-popup-menu",
                       G_CALLBACK (screen_show_popup_menu_callback), window);
@@ -3175,9 +3351,14 @@ notebook_page_added_callback (GtkWidget       *notebook,
     g_signal_connect (screen, "close-screen",
                       G_CALLBACK (screen_close_cb), window);
 
+    g_signal_connect (screen, "search-matches-changed",
+                      G_CALLBACK (screen_search_matches_changed_cb), window);
+    g_signal_connect (screen, "wake-scrollback",
+                      G_CALLBACK (screen_wake_scrollback_cb), window);
+
     update_tab_visibility (window, 0);
-    terminal_window_update_tabs_menu_sensitivity (window);
-    terminal_window_update_search_sensitivity (screen, window);
+    terminal_window_queue_update (window, WINDOW_UPDATE_TABS_MENU | WINDOW_UPDATE_SEARCH);
+    terminal_app_mark_session_dirty (terminal_app_get (), window);
 
 #if 0
     /* FIXMEchpe: wtf is this doing? */
@@ -3202,7 +3383,7 @@ notebook_page_added_callback (GtkWidget       *notebook,
         priv->present_on_insert = FALSE;
     }
     pages = gtk_notebook_get_n_pages (GTK_NOTEBOOK (notebook));
-    if (pages == 2) terminal_window_update_size (window, priv->active_screen, TRUE);
+    if (pages == 2) terminal_window_queue_update (window, WINDOW_UPDATE_SIZE);
 }
 
 static void
@@ -3241,9 +3422,15 @@ notebook_page_removed_callback (GtkWidget       *notebook,
                                           window);
 
     g_signal_handlers_disconnect_by_func (G_OBJECT (screen),
-                                          G_CALLBACK (terminal_window_update_copy_sensitivity),
+                                          G_CALLBACK (screen_selection_changed_cb),
+                                          window);
+    g_signal_handlers_disconnect_by_func (G_OBJECT (screen),
+                                          G_CALLBACK (screen_button_release_cb),
                                           window);
 
+    if (priv->copy_selection_screen == screen)
+        terminal_window_cancel_copy_selection (window);
+
     g_signal_handlers_disconnect_by_func (screen,
                                           G_CALLBACK (screen_show_popup_menu_callback),
                                           window);
@@ -3259,14 +3446,23 @@ notebook_page_removed_callback (GtkWidget       *notebook,
                                           G_CALLBACK (screen_close_cb),
                                           window);
 
-    terminal_window_update_tabs_menu_sensitivity (window);
+    g_signal_handlers_disconnect_by_func (screen,
+                                          G_CALLBACK (screen_search_matches_changed_cb),
+                                          window);
+    g_signal_handlers_disconnect_by_func (screen,
+                                          G_CALLBACK (screen_wake_scrollback_cb),
+                                          window);
+
+    terminal_window_forget_all_tabs_search_screen (window, screen);
+
     update_tab_visibility (window, 0);
-    terminal_window_update_search_sensitivity (screen, window);
+    terminal_window_queue_update (window, WINDOW_UPDATE_TABS_MENU | WINDOW_UPDATE_SEARCH);
+    terminal_app_mark_session_dirty (terminal_app_get (), window);
 
     pages = gtk_notebook_get_n_pages (GTK_NOTEBOOK (notebook));
     if (pages == 1)
     {
-        terminal_window_update_size (window, priv->active_screen, TRUE);
+        terminal_window_queue_update (window, WINDOW_UPDATE_SIZE);
     }
     else if (pages == 0)
     {
@@ -3370,6 +3566,21 @@ terminal_window_update_geometry (TerminalWindow *window)
      */
     terminal_screen_get_cell_size (priv->active_screen, &char_width, &char_height);
 
+    /* Measuring the chrome means a size negotiation, so reuse the last
+     * measurement unless something that can change it happened. A font
+     * change shows up as a different cell size.
+     */
+    if (priv->geometry_valid &&
+        widget == GTK_WIDGET (priv->old_geometry_widget) &&
+        char_width == priv->old_char_width &&
+        char_height == priv->old_char_height)
+    {
+        _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
+                               "[window %p] geometry unchanged, using cached chrome %dx%d px\n",
+                               window, priv->old_chrome_width, priv->old_chrome_height);
+        return;
+    }
+
     terminal_screen_get_size (priv->active_screen, &grid_width, &grid_height);
     _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY, "%dx%d cells of %dx%d px = %dx%d px\n",
                            grid_width, grid_height, char_width, char_height,
@@ -3455,9 +3666,24 @@ terminal_window_update_geometry (TerminalWindow *window)
     priv->old_chrome_height = chrome_height;
     priv->old_padding_width = padding.left + padding.right;
     priv->old_padding_height = padding.top + padding.bottom;
+    priv->geometry_valid = TRUE;
 }
 
-static void
+/**
+ * terminal_window_invalidate_geometry:
+ * @window:
+ *
+ * Makes the next terminal_window_update_geometry() measure the window
+ * chrome and the terminal padding again. Call this when their size may
+ * have changed.
+ */
+void
+terminal_window_invalidate_geometry (TerminalWindow *window)
+{
+    window->priv->geometry_valid = FALSE;
+}
+
+static void
 file_new_window_callback (GtkAction *action,
                           TerminalWindow *window)
 {
@@ -3633,15 +3859,44 @@ file_close_window_callback (GtkAction *action,
     gtk_widget_destroy (GTK_WIDGET (window));
 }
 
-#ifdef ENABLE_SAVE
+typedef struct
+{
+    GFile *file;
+    TerminalContentsFormat format;
+    gboolean compress;
+    GdkRGBA foreground;
+    GdkRGBA background;
+} SaveContentsData;
+
+static void
+save_contents_wake_cb (GObject      *source,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+    TerminalScreen *screen = TERMINAL_SCREEN (source);
+    SaveContentsData *data = user_data;
+
+    if (terminal_screen_wake_scrollback_finish (screen, result, NULL))
+    {
+        GtkWindow *parent;
+
+        parent = (GtkWindow*) gtk_widget_get_ancestor (GTK_WIDGET (screen), GTK_TYPE_WINDOW);
+        terminal_save_contents (VTE_TERMINAL (screen), data->file, data->format, data->compress,
+                                &data->foreground, &data->background, parent);
+    }
+
+    g_object_unref (data->file);
+    g_slice_free (SaveContentsData, data);
+}
+
 static void
 save_contents_dialog_on_response (GtkDialog *dialog, gint response_id, gpointer terminal)
 {
-    GtkWindow *parent;
+    GtkWidget *compress_checkbutton, *format_combo;
     gchar *filename_uri = NULL;
-    GFile *file;
-    GOutputStream *stream;
-    GError *error = NULL;
+    SaveContentsData *data;
+    TerminalContentsFormat format;
+    gboolean compress;
 
     if (response_id != GTK_RESPONSE_ACCEPT)
     {
@@ -3649,46 +3904,81 @@ save_contents_dialog_on_response (GtkDialog *dialog, gint response_id, gpointer
         return;
     }
 
-    parent = (GtkWindow*) gtk_widget_get_ancestor (GTK_WIDGET (terminal), GTK_TYPE_WINDOW);
     filename_uri = gtk_file_chooser_get_uri (GTK_FILE_CHOOSER (dialog));
+    compress_checkbutton = g_object_get_data (G_OBJECT (dialog), "compress-checkbutton");
+    compress = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (compress_checkbutton));
+    format_combo = g_object_get_data (G_OBJECT (dialog), "format-combo");
+    format = gtk_combo_box_get_active (GTK_COMBO_BOX (format_combo));
 
     gtk_widget_destroy (GTK_WIDGET (dialog));
 
     if (filename_uri == NULL)
         return;
 
-    file = g_file_new_for_uri (filename_uri);
-    stream = G_OUTPUT_STREAM (g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error));
-
-    if (stream)
+    if (g_str_has_suffix (filename_uri, ".gz"))
+        compress = TRUE;
+    else if (compress)
     {
-        /* FIXME
-         * Should be replaced with the async version when vte implements that.
-         */
-        vte_terminal_write_contents_sync (terminal, stream,
-                                          VTE_WRITE_DEFAULT,
-                                          NULL, &error);
-        g_object_unref (stream);
+        gchar *gz_uri = g_strconcat (filename_uri, ".gz", NULL);
+
+        g_free (filename_uri);
+        filename_uri = gz_uri;
     }
 
-    if (error)
+    if (format == TERMINAL_CONTENTS_FORMAT_TEXT &&
+        (g_str_has_suffix (filename_uri, ".html") ||
+         g_str_has_suffix (filename_uri, ".htm") ||
+         g_str_has_suffix (filename_uri, ".html.gz") ||
+         g_str_has_suffix (filename_uri, ".htm.gz")))
+        format = TERMINAL_CONTENTS_FORMAT_HTML;
+
+    data = g_slice_new (SaveContentsData);
+    data->file = g_file_new_for_uri (filename_uri);
+    data->format = format;
+    data->compress = compress;
+    terminal_screen_get_colors (TERMINAL_SCREEN (terminal), &data->foreground, &data->background);
+
+    /* Only save once a hibernating scrollback is back */
+    terminal_screen_wake_scrollback_async (TERMINAL_SCREEN (terminal), NULL,
+                                           save_contents_wake_cb, data);
+
+    g_free(filename_uri);
+}
+
+/* Keeps the ".gz" suffix of the name in step, so that overwriting is
+ * confirmed for the file that is actually written.
+ */
+static void
+save_contents_compress_toggled_cb (GtkToggleButton *button,
+                                   GtkFileChooser  *chooser)
+{
+    gchar *name, *new_name = NULL;
+
+    name = gtk_file_chooser_get_current_name (chooser);
+    if (name == NULL || name[0] == '\0')
     {
-        terminal_util_show_error_dialog (parent, NULL, error,
-                                         "%s", _("Could not save contents"));
-        g_error_free (error);
+        g_free (name);
+        return;
     }
 
-    g_object_unref(file);
-    g_free(filename_uri);
+    if (gtk_toggle_button_get_active (button) && !g_str_has_suffix (name, ".gz"))
+        new_name = g_strconcat (name, ".gz", NULL);
+    else if (!gtk_toggle_button_get_active (button) && g_str_has_suffix (name, ".gz"))
+        new_name = g_strndup (name, strlen (name) - strlen (".gz"));
+
+    if (new_name != NULL)
+        gtk_file_chooser_set_current_name (chooser, new_name);
+
+    g_free (new_name);
+    g_free (name);
 }
-#endif /* ENABLE_SAVE */
 
 static void
 file_save_contents_callback (GtkAction *action,
                              TerminalWindow *window)
 {
-#ifdef ENABLE_SAVE
     GtkWidget *dialog = NULL;
+    GtkWidget *hbox, *label, *format_combo, *compress_checkbutton;
     TerminalWindowPrivate *priv = window->priv;
     VteTerminal *terminal;
 
@@ -3709,6 +3999,30 @@ file_save_contents_callback (GtkAction *action,
     /* XXX where should we save to? */
     gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER (dialog), g_get_user_special_dir (G_USER_DIRECTORY_DESKTOP));
 
+    hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 12);
+
+    label = gtk_label_new_with_mnemonic (_("_Format:"));
+    gtk_box_pack_start (GTK_BOX (hbox), label, FALSE, FALSE, 0);
+
+    /* In the order of TerminalContentsFormat */
+    format_combo = gtk_combo_box_text_new ();
+    gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (format_combo), _("Plain text"));
+    gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (format_combo), _("HTML"));
+    gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (format_combo), _("Text with ANSI colors"));
+    gtk_combo_box_set_active (GTK_COMBO_BOX (format_combo), TERMINAL_CONTENTS_FORMAT_TEXT);
+    gtk_label_set_mnemonic_widget (GTK_LABEL (label), format_combo);
+    gtk_box_pack_start (GTK_BOX (hbox), format_combo, FALSE, FALSE, 0);
+    g_object_set_data (G_OBJECT (dialog), "format-combo", format_combo);
+
+    compress_checkbutton = gtk_check_button_new_with_mnemonic (_("C_ompress with gzip"));
+    gtk_box_pack_start (GTK_BOX (hbox), compress_checkbutton, FALSE, FALSE, 0);
+    g_object_set_data (G_OBJECT (dialog), "compress-checkbutton", compress_checkbutton);
+    g_signal_connect (compress_checkbutton, "toggled",
+                      G_CALLBACK (save_contents_compress_toggled_cb), dialog);
+
+    gtk_widget_show_all (hbox);
+    gtk_file_chooser_set_extra_widget (GTK_FILE_CHOOSER (dialog), hbox);
+
     gtk_window_set_transient_for (GTK_WINDOW (dialog), GTK_WINDOW(window));
     gtk_window_set_modal (GTK_WINDOW (dialog), TRUE);
     gtk_window_set_destroy_with_parent (GTK_WINDOW (dialog), TRUE);
@@ -3717,7 +4031,6 @@ file_save_contents_callback (GtkAction *action,
     g_signal_connect (dialog, "delete_event", G_CALLBACK (terminal_util_dialog_response_on_delete), NULL);
 
     gtk_window_present (GTK_WINDOW (dialog));
-#endif /* ENABLE_SAVE */
 }
 
 static void
@@ -4026,6 +4339,374 @@ view_zoom_normal_callback (GtkAction *action,
     terminal_window_update_zoom_sensitivity (window);
 }
 
+static void
+terminal_window_update_match_count (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+    guint position, count;
+    gboolean complete;
+
+    if (priv->search_find_dialog == NULL || priv->active_screen == NULL)
+        return;
+
+    /* The label counts the results of all tabs then */
+    if (terminal_search_dialog_get_search_flags (priv->search_find_dialog) & TERMINAL_SEARCH_FLAG_ALL_TABS)
+        return;
+
+    if (terminal_screen_get_search_match_count (priv->active_screen, &position, &count, &complete))
+        terminal_search_dialog_set_match_count (priv->search_find_dialog, position, count, complete);
+    else
+        terminal_search_dialog_clear_match_count (priv->search_find_dialog);
+}
+
+static void
+screen_search_matches_changed_cb (TerminalScreen *screen,
+                                  TerminalWindow *window)
+{
+    if (screen == window->priv->active_screen)
+        terminal_window_update_match_count (window);
+}
+
+/* The rows of the results from @screen are about to be renumbered */
+static void
+screen_wake_scrollback_cb (TerminalScreen *screen,
+                           TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+
+    if (priv->search_find_dialog != NULL)
+        terminal_search_dialog_remove_results (priv->search_find_dialog, screen);
+}
+
+static void
+terminal_window_cancel_incremental_search (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+
+    if (priv->incremental_search == NULL)
+        return;
+
+    terminal_search_scan_cancel (priv->incremental_search);
+    priv->incremental_search = NULL;
+}
+
+static gboolean
+incremental_search_match_cb (TerminalSearchScan        *scan,
+                             const TerminalSearchMatch *match,
+                             TerminalWindow            *window)
+{
+    VteTerminal *terminal = terminal_search_scan_get_terminal (scan);
+    GtkAdjustment *adjustment;
+    double page_size;
+
+    adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (terminal));
+    page_size = gtk_adjustment_get_page_size (adjustment);
+
+    /* Without a selection, VTE searches forwards from the top of the view
+     * and backwards from its bottom. Scroll the match there and let VTE
+     * find and select it, so Find Next/Previous carry on from it.
+     */
+    if (window->priv->incremental_search_backwards)
+    {
+        gtk_adjustment_set_value (adjustment, match->row - page_size + 1);
+        vte_terminal_unselect_all (terminal);
+        vte_terminal_search_find_previous (terminal);
+    }
+    else
+    {
+        gtk_adjustment_set_value (adjustment, match->row);
+        vte_terminal_unselect_all (terminal);
+        vte_terminal_search_find_next (terminal);
+    }
+
+    /* Updates the match count */
+    terminal_screen_set_search_current (TERMINAL_SCREEN (terminal), match->row, match->column);
+
+    return FALSE;
+}
+
+static void
+incremental_search_done_cb (TerminalSearchScan *scan,
+                            TerminalWindow     *window)
+{
+    window->priv->incremental_search = NULL;
+}
+
+static void
+terminal_window_start_incremental_search (TerminalWindow *window,
+                                          GtkWidget      *dialog)
+{
+    TerminalWindowPrivate *priv = window->priv;
+    TerminalSearchFlags flags;
+    VteTerminal *terminal;
+    VteRegex *regex;
+    GRegex *scan_regex;
+    GtkAdjustment *adjustment;
+    glong start_row;
+
+    /* A new pattern supersedes whatever we were still looking for */
+    terminal_window_cancel_incremental_search (window);
+
+    if (G_UNLIKELY (!priv->active_screen))
+        return;
+
+    regex = terminal_search_dialog_get_regex (dialog);
+    scan_regex = terminal_search_dialog_get_scan_regex (dialog);
+    if (regex == NULL || scan_regex == NULL)
+        return;
+
+    flags = terminal_search_dialog_get_search_flags (dialog);
+    terminal = VTE_TERMINAL (priv->active_screen);
+
+    vte_terminal_search_set_regex (terminal, regex, 0);
+    vte_terminal_search_set_wrap_around (terminal, (flags & TERMINAL_SEARCH_FLAG_WRAP_AROUND));
+    terminal_screen_set_search_highlight (priv->active_screen, scan_regex);
+
+    /* Start from what is shown, which after the first hit is the hit */
+    adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (terminal));
+    start_row = (glong) gtk_adjustment_get_value (adjustment);
+    if (flags & TERMINAL_SEARCH_FLAG_BACKWARDS)
+        start_row += (glong) gtk_adjustment_get_page_size (adjustment) - 1;
+
+    priv->incremental_search_backwards = (flags & TERMINAL_SEARCH_FLAG_BACKWARDS) != 0;
+    priv->incremental_search = terminal_search_scan_new (terminal, scan_regex, start_row,
+                                                         (flags & TERMINAL_SEARCH_FLAG_BACKWARDS),
+                                                         (flags & TERMINAL_SEARCH_FLAG_WRAP_AROUND),
+                                                         (TerminalSearchScanMatchFunc) incremental_search_match_cb,
+                                                         (TerminalSearchScanDoneFunc) incremental_search_done_cb,
+                                                         window);
+
+    terminal_window_update_search_sensitivity (priv->active_screen, window);
+}
+
+static void
+terminal_window_cancel_all_tabs_search (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+
+    if (priv->all_tabs_search != NULL)
+    {
+        terminal_search_scan_cancel (priv->all_tabs_search);
+        priv->all_tabs_search = NULL;
+    }
+
+    g_list_free (priv->all_tabs_search_pending);
+    priv->all_tabs_search_pending = NULL;
+
+    if (priv->all_tabs_search_wake != NULL)
+    {
+        g_cancellable_cancel (priv->all_tabs_search_wake);
+        g_clear_object (&priv->all_tabs_search_wake);
+        priv->all_tabs_search_waking = NULL;
+    }
+
+    if (priv->all_tabs_search_regex != NULL)
+    {
+        g_regex_unref (priv->all_tabs_search_regex);
+        priv->all_tabs_search_regex = NULL;
+    }
+}
+
+static gboolean
+all_tabs_search_match_cb (TerminalSearchScan        *scan,
+                          const TerminalSearchMatch *match,
+                          TerminalWindow            *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+    VteTerminal *terminal = terminal_search_scan_get_terminal (scan);
+    char *text;
+
+    if (priv->search_find_dialog == NULL)
+        return FALSE;
+
+    text = vte_terminal_get_text_range (terminal,
+                                        match->row, 0,
+                                        match->row, vte_terminal_get_column_count (terminal) - 1,
+                                        NULL, NULL, NULL);
+    if (text != NULL)
+        g_strchomp (text);
+
+    terminal_search_dialog_add_result (priv->search_find_dialog,
+                                       terminal, match->row,
+                                       terminal_screen_get_title (TERMINAL_SCREEN (terminal)),
+                                       text ? text : "");
+    g_free (text);
+
+    return ++priv->all_tabs_search_results < ALL_TABS_SEARCH_MAX_RESULTS;
+}
+
+static void all_tabs_search_done_cb (TerminalSearchScan *scan,
+                                     TerminalWindow     *window);
+
+static void
+all_tabs_search_wake_cb (GObject      *source,
+                         GAsyncResult *result,
+                         gpointer      user_data)
+{
+    TerminalWindow *window = TERMINAL_WINDOW (user_data);
+    TerminalWindowPrivate *priv = window->priv;
+    TerminalScreen *screen = TERMINAL_SCREEN (source);
+    GtkAdjustment *adjustment;
+
+    /* Fails if the search was cancelled or the tab closed meanwhile */
+    if (!terminal_screen_wake_scrollback_finish (screen, result, NULL))
+    {
+        g_object_unref (window);
+        return;
+    }
+
+    g_clear_object (&priv->all_tabs_search_wake);
+    priv->all_tabs_search_waking = NULL;
+
+    adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+    priv->all_tabs_search = terminal_search_scan_new (VTE_TERMINAL (screen),
+                                                      priv->all_tabs_search_regex,
+                                                      (glong) gtk_adjustment_get_lower (adjustment),
+                                                      FALSE, FALSE,
+                                                      (TerminalSearchScanMatchFunc) all_tabs_search_match_cb,
+                                                      (TerminalSearchScanDoneFunc) all_tabs_search_done_cb,
+                                                      window);
+
+    g_object_unref (window);
+}
+
+static void
+terminal_window_search_next_tab (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+    TerminalScreen *screen;
+    gboolean complete;
+
+    if (priv->search_find_dialog == NULL)
+    {
+        terminal_window_cancel_all_tabs_search (window);
+        return;
+    }
+
+    complete = priv->all_tabs_search_pending == NULL ||
+               priv->all_tabs_search_results >= ALL_TABS_SEARCH_MAX_RESULTS;
+
+    /* Past the limit, all we know is that there are at least that many */
+    terminal_search_dialog_set_match_count (priv->search_find_dialog,
+                                            0, priv->all_tabs_search_results,
+                                            priv->all_tabs_search_pending == NULL &&
+                                            priv->all_tabs_search_results < ALL_TABS_SEARCH_MAX_RESULTS);
+
+    if (complete)
+    {
+        terminal_window_cancel_all_tabs_search (window);
+        return;
+    }
+
+    /* One tab at a time, so the time slices of the scans don't add up */
+    screen = priv->all_tabs_search_pending->data;
+    priv->all_tabs_search_pending = g_list_delete_link (priv->all_tabs_search_pending,
+                                                        priv->all_tabs_search_pending);
+
+    /* The scan starts once a hibernating scrollback is back */
+    priv->all_tabs_search_waking = screen;
+    priv->all_tabs_search_wake = g_cancellable_new ();
+    terminal_screen_wake_scrollback_async (screen, priv->all_tabs_search_wake,
+                                           all_tabs_search_wake_cb, g_object_ref (window));
+}
+
+static void
+all_tabs_search_done_cb (TerminalSearchScan *scan,
+                         TerminalWindow     *window)
+{
+    window->priv->all_tabs_search = NULL;
+    terminal_window_search_next_tab (window);
+}
+
+static void
+terminal_window_start_all_tabs_search (TerminalWindow *window,
+                                       GtkWidget      *dialog)
+{
+    TerminalWindowPrivate *priv = window->priv;
+    GRegex *regex;
+    GList *tabs, *l;
+
+    terminal_window_cancel_all_tabs_search (window);
+    terminal_search_dialog_clear_results (dialog);
+
+    regex = terminal_search_dialog_get_scan_regex (dialog);
+    if (regex == NULL)
+        return;
+
+    priv->all_tabs_search_regex = g_regex_ref (regex);
+    priv->all_tabs_search_results = 0;
+
+    tabs = terminal_window_list_screen_containers (window);
+    for (l = tabs; l != NULL; l = l->next)
+        priv->all_tabs_search_pending =
+            g_list_prepend (priv->all_tabs_search_pending,
+                            terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (l->data)));
+    g_list_free (tabs);
+
+    priv->all_tabs_search_pending = g_list_reverse (priv->all_tabs_search_pending);
+
+    terminal_window_search_next_tab (window);
+}
+
+/* Drops @screen from a running search of all tabs and from its results */
+static void
+terminal_window_forget_all_tabs_search_screen (TerminalWindow *window,
+                                               TerminalScreen *screen)
+{
+    TerminalWindowPrivate *priv = window->priv;
+
+    priv->all_tabs_search_pending = g_list_remove (priv->all_tabs_search_pending, screen);
+
+    if (priv->search_find_dialog != NULL)
+        terminal_search_dialog_remove_results (priv->search_find_dialog, screen);
+
+    if (priv->all_tabs_search != NULL &&
+        terminal_search_scan_get_terminal (priv->all_tabs_search) == VTE_TERMINAL (screen))
+    {
+        terminal_search_scan_cancel (priv->all_tabs_search);
+        priv->all_tabs_search = NULL;
+        terminal_window_search_next_tab (window);
+    }
+    else if (priv->all_tabs_search_waking == screen)
+    {
+        g_cancellable_cancel (priv->all_tabs_search_wake);
+        g_clear_object (&priv->all_tabs_search_wake);
+        priv->all_tabs_search_waking = NULL;
+        terminal_window_search_next_tab (window);
+    }
+}
+
+static void
+terminal_window_activate_search_result (TerminalWindow *window,
+                                        GtkWidget      *dialog)
+{
+    TerminalWindowPrivate *priv = window->priv;
+    TerminalScreen *screen;
+    GtkAdjustment *adjustment;
+    VteRegex *regex;
+    gpointer result_screen;
+    glong row;
+
+    if (!terminal_search_dialog_get_selected_result (dialog, &result_screen, &row))
+        return;
+
+    /* Results of closed tabs are removed, see notebook_page_removed_callback() */
+    screen = TERMINAL_SCREEN (result_screen);
+
+    terminal_window_switch_screen (window, screen);
+
+    regex = terminal_search_dialog_get_regex (dialog);
+    if (regex != NULL)
+        vte_terminal_search_set_regex (VTE_TERMINAL (screen), regex, 0);
+    terminal_screen_set_search_highlight (screen, terminal_search_dialog_get_scan_regex (dialog));
+
+    /* Show the row a few lines below the top, with some context */
+    adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+    gtk_adjustment_set_value (adjustment, row - ALL_TABS_SEARCH_CONTEXT_ROWS);
+
+    terminal_window_update_search_sensitivity (screen, window);
+}
+
 static void
 search_find_response_callback (GtkWidget *dialog,
                                int        response,
@@ -4036,27 +4717,51 @@ search_find_response_callback (GtkWidget *dialog,
     TerminalSearchFlags flags;
     VteRegex *regex;
 
+    if (response == TERMINAL_SEARCH_DIALOG_RESPONSE_INCREMENTAL)
+    {
+        terminal_window_start_incremental_search (window, dialog);
+        return;
+    }
+
+    if (response == TERMINAL_SEARCH_DIALOG_RESPONSE_ACTIVATE_RESULT)
+    {
+        terminal_window_activate_search_result (window, dialog);
+        return;
+    }
+
+    terminal_window_cancel_incremental_search (window);
+
     if (response != GTK_RESPONSE_ACCEPT)
+    {
+        terminal_window_cancel_all_tabs_search (window);
         return;
+    }
 
     if (G_UNLIKELY (!priv->active_screen))
         return;
 
+    flags = terminal_search_dialog_get_search_flags (dialog);
+
+    if (flags & TERMINAL_SEARCH_FLAG_ALL_TABS)
+    {
+        terminal_window_start_all_tabs_search (window, dialog);
+        return;
+    }
+
     regex = terminal_search_dialog_get_regex (dialog);
     g_return_if_fail (regex != NULL);
 
-    flags = terminal_search_dialog_get_search_flags (dialog);
-
     vte_terminal_search_set_regex (VTE_TERMINAL (priv->active_screen), regex, 0);
     vte_terminal_search_set_wrap_around (VTE_TERMINAL (priv->active_screen),
                                          (flags & TERMINAL_SEARCH_FLAG_WRAP_AROUND));
 
-    if (flags & TERMINAL_SEARCH_FLAG_BACKWARDS)
-        vte_terminal_search_find_previous (VTE_TERMINAL (priv->active_screen));
-    else
-        vte_terminal_search_find_next (VTE_TERMINAL (priv->active_screen));
+    terminal_screen_set_search_highlight (priv->active_screen,
+                                          terminal_search_dialog_get_scan_regex (dialog));
+
+    terminal_screen_search_find (priv->active_screen, (flags & TERMINAL_SEARCH_FLAG_BACKWARDS) != 0);
 
     terminal_window_update_search_sensitivity (priv->active_screen, window);
+    terminal_window_update_match_count (window);
 }
 
 static gboolean
@@ -4091,6 +4796,40 @@ search_find_callback (GtkAction *action,
     terminal_search_dialog_present (priv->search_find_dialog);
 }
 
+static void
+search_find_next_wake_cb (GObject      *source,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+    TerminalWindow *window = TERMINAL_WINDOW (user_data);
+    TerminalScreen *screen = TERMINAL_SCREEN (source);
+
+    if (terminal_screen_wake_scrollback_finish (screen, result, NULL) &&
+        window->priv->active_screen == screen)
+    {
+        terminal_screen_search_find (screen, FALSE);
+    }
+
+    g_object_unref (window);
+}
+
+static void
+search_find_prev_wake_cb (GObject      *source,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+    TerminalWindow *window = TERMINAL_WINDOW (user_data);
+    TerminalScreen *screen = TERMINAL_SCREEN (source);
+
+    if (terminal_screen_wake_scrollback_finish (screen, result, NULL) &&
+        window->priv->active_screen == screen)
+    {
+        terminal_screen_search_find (screen, TRUE);
+    }
+
+    g_object_unref (window);
+}
+
 static void
 search_find_next_callback (GtkAction *action,
                            TerminalWindow *window)
@@ -4098,7 +4837,9 @@ search_find_next_callback (GtkAction *action,
     if (G_UNLIKELY (!window->priv->active_screen))
         return;
 
-    vte_terminal_search_find_next (VTE_TERMINAL (window->priv->active_screen));
+    /* Search once a hibernating scrollback is back */
+    terminal_screen_wake_scrollback_async (window->priv->active_screen, NULL,
+                                           search_find_next_wake_cb, g_object_ref (window));
 }
 
 static void
@@ -4108,7 +4849,8 @@ search_find_prev_callback (GtkAction *action,
     if (G_UNLIKELY (!window->priv->active_screen))
         return;
 
-    vte_terminal_search_find_previous (VTE_TERMINAL (window->priv->active_screen));
+    terminal_screen_wake_scrollback_async (window->priv->active_screen, NULL,
+                                           search_find_prev_wake_cb, g_object_ref (window));
 }
 
 static void
@@ -4119,6 +4861,7 @@ search_clear_highlight_callback (GtkAction *action,
         return;
 
     vte_terminal_search_set_regex (VTE_TERMINAL (window->priv->active_screen), NULL, 0);
+    terminal_screen_set_search_highlight (window->priv->active_screen, NULL);
 }
 
 static void
@@ -533,7 +533,22 @@ main (int argc, char **argv)
 	const char *display_name = gdk_display_get_name (gdk_display_get_default ());
 	options->display_name = g_strdup (display_name);
 
-	if (options->use_factory)
+	if (options->import_profiles || options->export_profiles)
+	{
+		/* Profiles live in GSettings, so there's no need to go through the
+		 * factory; a running instance picks up an import from its profile
+		 * list notification.
+		 */
+		gtk_init(&argc, &argv);
+		if (!terminal_app_handle_options (terminal_app_get (), options, FALSE, &error))
+		{
+			g_printerr ("Error handling options: %s\n", error->message);
+			g_error_free (error);
+			ret = EXIT_FAILURE;
+		}
+		terminal_options_free (options);
+	}
+	else if (options->use_factory)
 	{
 		OwnData *data;
 		guint owner_id;